@@ -2,31 +2,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "ast.h"
 
-extern ASTNode *ast_root;
-extern int yylineno;
-void yyerror(const char *s);
-int yylex(void);
+/* The parse stack lives on the heap and doubles on demand; allow deeply
+   nested blocks and expressions instead of bison's default 10000 */
+#define YYMAXDEPTH 1000000
+%}
+
+/* Pure parser: all state lives in the flex scanner and the ParseContext
+   handed to yyparse, so separate compilations can run concurrently. */
+%define api.pure full
+%locations
+%parse-param {void *scanner} {ParseContext *ctx}
+%lex-param {void *scanner}
 
-static ASTNode* node_with_line(ASTNode* node) {
-    if (node) node->line = yylineno;
-    return node;
+%code requires {
+#include "ast.h"
+#include "parser_driver.h"
 }
-%}
 
 %union {
     int ival;
-    char *sval;
+    int sym;              /* interned identifier */
     ASTNode *node;
+    struct { ASTNode *head, *tail; } list;  /* statements linked by next */
 }
 
-%token VAR IF ELSE WHILE FOR ASSIGN SEMI LBRACE RBRACE LPAREN RPAREN
+%token VAR IF ELSE WHILE FOR FUNC RETURN ASSIGN SEMI LBRACE RBRACE LPAREN RPAREN LBRACKET RBRACKET COMMA
 %token PLUS MINUS MUL DIV EQ NE LT GT LE GE
 %token <ival> INTEGER
-%token <sval> IDENTIFIER
+%token <sym> IDENTIFIER
 
-%type <node> program stmt_list stmt block expr for_assign
+%type <node> program stmt block expr for_assign
+%type <list> stmt_list param_list arg_list
 
 /* Precedence to fix Dangling Else conflict */
 %nonassoc LOWER_THAN_ELSE
@@ -38,69 +45,103 @@ static ASTNode* node_with_line(ASTNode* node) {
 
 %start program
 
+%code {
+int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, void *scanner);
+void yyerror(YYLTYPE *loc, void *scanner, ParseContext *ctx, const char *s);
+
+/* Tags a node with the line its first token is on */
+static ASTNode* node_with_line(YYLTYPE loc, ASTNode* node) {
+    if (node) node->line = loc.first_line;
+    return node;
+}
+}
+
 %%
 
 program
-    : /* empty */ { ast_root = NULL; }
-    | stmt_list   { ast_root = ast_make_block($1); }
+    : /* empty */ { ctx->root = NULL; }
+    | stmt_list   { ctx->root = ast_make_block(ctx->arena, $1.head); }
     ;
 
+/* Left recursive with a tail pointer: O(1) per statement, and the
+   parser stack stays flat however long the list is */
 stmt_list
-    : stmt { $$ = $1; }
+    : stmt { $$.head = $$.tail = $1; }
     | stmt_list stmt {
-        if ($1 == NULL) { $$ = $2; }
-        else {
-            ASTNode *n = $1;
-            while (n->next) n = n->next;
-            n->next = $2;
-            $$ = $1;
-        }
+        $$ = $1;
+        if ($2 == NULL) { /* empty statement */ }
+        else if ($$.tail == NULL) { $$.head = $$.tail = $2; }
+        else { $$.tail->next = $2; $$.tail = $2; }
     }
     ;
 
 stmt
     /* ✅ WRAP ALL ACTIONS WITH node_with_line(...) */
-    : VAR IDENTIFIER SEMI { $$ = node_with_line(ast_make_var_decl($2, NULL)); }
-    | VAR IDENTIFIER ASSIGN expr SEMI { $$ = node_with_line(ast_make_var_decl($2, $4)); }
-    | IDENTIFIER ASSIGN expr SEMI { $$ = node_with_line(ast_make_assign(ast_make_ident($1), $3)); }
-    | IF LPAREN expr RPAREN stmt %prec LOWER_THAN_ELSE { $$ = node_with_line(ast_make_if($3, $5, NULL)); }
-    | IF LPAREN expr RPAREN stmt ELSE stmt { $$ = node_with_line(ast_make_if($3, $5, $7)); }
-    | WHILE LPAREN expr RPAREN stmt { $$ = node_with_line(ast_make_while($3, $5)); }
-    | FOR LPAREN stmt expr SEMI for_assign RPAREN stmt { $$ = node_with_line(ast_make_for($3, $4, $6, $8)); }
+    : VAR IDENTIFIER SEMI { $$ = node_with_line(@$, ast_make_var_decl(ctx->arena, $2, NULL)); }
+    | VAR IDENTIFIER ASSIGN expr SEMI { $$ = node_with_line(@$, ast_make_var_decl(ctx->arena, $2, $4)); }
+    | VAR IDENTIFIER LBRACKET INTEGER RBRACKET SEMI { $$ = node_with_line(@$, ast_make_array_decl(ctx->arena, $2, $4)); }
+    | IDENTIFIER ASSIGN expr SEMI { $$ = node_with_line(@$, ast_make_assign(ctx->arena, ast_make_ident(ctx->arena, $1), $3)); }
+    | IDENTIFIER LBRACKET expr RBRACKET ASSIGN expr SEMI { $$ = node_with_line(@$, ast_make_assign(ctx->arena, ast_make_index(ctx->arena, $1, $3), $6)); }
+    | IF LPAREN expr RPAREN stmt %prec LOWER_THAN_ELSE { $$ = node_with_line(@$, ast_make_if(ctx->arena, $3, $5, NULL)); }
+    | IF LPAREN expr RPAREN stmt ELSE stmt { $$ = node_with_line(@$, ast_make_if(ctx->arena, $3, $5, $7)); }
+    | WHILE LPAREN expr RPAREN stmt { $$ = node_with_line(@$, ast_make_while(ctx->arena, $3, $5)); }
+    | FOR LPAREN stmt expr SEMI for_assign RPAREN stmt { $$ = node_with_line(@$, ast_make_for(ctx->arena, $3, $4, $6, $8)); }
+    | FUNC IDENTIFIER LPAREN RPAREN block { $$ = node_with_line(@$, ast_make_func(ctx->arena, $2, NULL, $5)); }
+    | FUNC IDENTIFIER LPAREN param_list RPAREN block { $$ = node_with_line(@$, ast_make_func(ctx->arena, $2, $4.head, $6)); }
+    | RETURN SEMI { $$ = node_with_line(@$, ast_make_return(ctx->arena, NULL)); }
+    | RETURN expr SEMI { $$ = node_with_line(@$, ast_make_return(ctx->arena, $2)); }
     | block { $$ = $1; } /* Block usually inherits or doesn't need specific line */
     | SEMI { $$ = NULL; }
     ;
 
 for_assign
-    : IDENTIFIER ASSIGN expr { $$ = node_with_line(ast_make_assign(ast_make_ident($1), $3)); }
+    : IDENTIFIER ASSIGN expr { $$ = node_with_line(@$, ast_make_assign(ctx->arena, ast_make_ident(ctx->arena, $1), $3)); }
+    | IDENTIFIER LBRACKET expr RBRACKET ASSIGN expr { $$ = node_with_line(@$, ast_make_assign(ctx->arena, ast_make_index(ctx->arena, $1, $3), $6)); }
     ;
 
 
 
+param_list
+    : IDENTIFIER { $$.head = $$.tail = node_with_line(@$, ast_make_ident(ctx->arena, $1)); }
+    | param_list COMMA IDENTIFIER {
+        $$ = $1;
+        $$.tail->next = node_with_line(@3, ast_make_ident(ctx->arena, $3));
+        $$.tail = $$.tail->next;
+    }
+    ;
+
+arg_list
+    : expr { $$.head = $$.tail = $1; }
+    | arg_list COMMA expr { $$ = $1; $$.tail->next = $3; $$.tail = $3; }
+    ;
+
 block
-    : LBRACE stmt_list RBRACE { $$ = ast_make_block($2); }
-    | LBRACE RBRACE { $$ = ast_make_block(NULL); }
+    : LBRACE stmt_list RBRACE { $$ = ast_make_block(ctx->arena, $2.head); }
+    | LBRACE RBRACE { $$ = ast_make_block(ctx->arena, NULL); }
     ;
 
 expr
-    : INTEGER { $$ = node_with_line(ast_make_int($1)); }
-    | IDENTIFIER { $$ = node_with_line(ast_make_ident($1)); }
-    | expr PLUS  expr { $$ = node_with_line(ast_make_binop(AST_OP_ADD, $1, $3)); }
-    | expr MINUS expr { $$ = node_with_line(ast_make_binop(AST_OP_SUB, $1, $3)); }
-    | expr MUL   expr { $$ = node_with_line(ast_make_binop(AST_OP_MUL, $1, $3)); }
-    | expr DIV   expr { $$ = node_with_line(ast_make_binop(AST_OP_DIV, $1, $3)); }
-    | expr EQ    expr { $$ = node_with_line(ast_make_binop(AST_OP_EQ,  $1, $3)); }
-    | expr NE    expr { $$ = node_with_line(ast_make_binop(AST_OP_NE,  $1, $3)); }
-    | expr LT    expr { $$ = node_with_line(ast_make_binop(AST_OP_LT,  $1, $3)); }
-    | expr GT    expr { $$ = node_with_line(ast_make_binop(AST_OP_GT,  $1, $3)); }
-    | expr LE    expr { $$ = node_with_line(ast_make_binop(AST_OP_LE,  $1, $3)); }
-    | expr GE    expr { $$ = node_with_line(ast_make_binop(AST_OP_GE,  $1, $3)); }
+    : INTEGER { $$ = node_with_line(@$, ast_make_int(ctx->arena, $1)); }
+    | IDENTIFIER { $$ = node_with_line(@$, ast_make_ident(ctx->arena, $1)); }
+    | IDENTIFIER LBRACKET expr RBRACKET { $$ = node_with_line(@$, ast_make_index(ctx->arena, $1, $3)); }
+    | IDENTIFIER LPAREN RPAREN { $$ = node_with_line(@$, ast_make_call(ctx->arena, $1, NULL)); }
+    | IDENTIFIER LPAREN arg_list RPAREN { $$ = node_with_line(@$, ast_make_call(ctx->arena, $1, $3.head)); }
+    | expr PLUS  expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_ADD, $1, $3)); }
+    | expr MINUS expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_SUB, $1, $3)); }
+    | expr MUL   expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_MUL, $1, $3)); }
+    | expr DIV   expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_DIV, $1, $3)); }
+    | expr EQ    expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_EQ,  $1, $3)); }
+    | expr NE    expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_NE,  $1, $3)); }
+    | expr LT    expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_LT,  $1, $3)); }
+    | expr GT    expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_GT,  $1, $3)); }
+    | expr LE    expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_LE,  $1, $3)); }
+    | expr GE    expr { $$ = node_with_line(@$, ast_make_binop(ctx->arena, AST_OP_GE,  $1, $3)); }
     | LPAREN expr RPAREN { $$ = $2; }
     ;
 
 %%
 
-void yyerror(const char *s) {
-    extern int yylineno;
-    fprintf(stderr, "Parser error at line %d: %s\n", yylineno, s);
+void yyerror(YYLTYPE *loc, void *scanner, ParseContext *ctx, const char *s) {
+    (void)scanner;
+    fprintf(ctx->diag, "Parser error at line %d: %s\n", loc->first_line, s);
 }
\ No newline at end of file
@@ -1,27 +1,86 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "ast.h"
+#include "parser_driver.h"
 
-extern ASTNode *ast_root;
-extern int yyparse();
-extern FILE *yyin;
-extern int yylineno;
+/* Reentrant flex scanner (lex.yy.c) and pure bison parser (parser.tab.c) */
+extern int yylex_init_extra(ParseContext *ctx, void **scanner);
+extern int yylex_destroy(void *scanner);
+extern void *yy_scan_buffer(char *base, size_t size, void *scanner);
+extern void yyset_lineno(int line, void *scanner);
+extern int yyparse(void *scanner, ParseContext *ctx);
 
-ASTNode* parse_source(const char* source_file) {
-    FILE *f = fopen(source_file, "r");
-    if (!f) {
-        perror("Error opening file");
-        return NULL;
+/* =========================
+   Source text
+   ========================= */
+
+/* The file is read rather than mapped: a mapped file that shrinks while
+   it is scanned (an editor or generator rewriting a watched source)
+   faults with SIGBUS, and would take the whole shell down. size is
+   what fstat reported, so a regular file usually takes one read. */
+static int source_read(int fd, size_t size, SourceText *src) {
+    size_t cap = size + 4096, n = 0;
+    char *buf = (char*)malloc(cap);
+    ssize_t got;
+    while ((got = read(fd, buf + n, cap - n - 2)) > 0) {
+        n += got;
+        if (n + 2 == cap) {
+            cap *= 2;
+            buf = (char*)realloc(buf, cap);
+        }
+    }
+    if (got < 0) {
+        free(buf);
+        return 0;
     }
-    
-    yylineno = 1; // Reset line counter
-    yyin = f;
-    ast_root = NULL;
-
-    if (yyparse() == 0) {
-        fclose(f);
-        return ast_root;
+    buf[n] = buf[n + 1] = '\0';
+    src->text = buf;
+    src->len = n;
+    return 1;
+}
+
+int source_open(const char *path, SourceText *src, FILE *diag) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(diag, "Error opening file: %s\n", strerror(errno));
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    int ok = source_read(fd, S_ISREG(st.st_mode) ? (size_t)st.st_size : 0, src);
+    if (!ok) fprintf(diag, "Error reading file: %s\n", strerror(errno));
+    close(fd);
+    return ok;
+}
+
+void source_close(SourceText *src) {
+    free(src->text);
+    src->text = NULL;
+}
+
+/* =========================
+   Parsing
+   ========================= */
+
+ASTNode* parse_text(SourceText *src, ASTArena *arena, FILE *diag) {
+    ParseContext ctx = { arena, NULL, diag };
+    void *scanner;
+    if (yylex_init_extra(&ctx, &scanner) != 0) return NULL;
+
+    // scan the text where it lies instead of copying it through FILE*
+    if (!yy_scan_buffer(src->text, src->len + 2, scanner)) {
+        yylex_destroy(scanner);
+        return NULL;
     }
-    
-    fclose(f);
-    return NULL;
+    yyset_lineno(1, scanner);
+
+    int status = yyparse(scanner, &ctx);
+
+    yylex_destroy(scanner);
+    return (status == 0) ? ctx.root : NULL;
 }
\ No newline at end of file
@@ -1,10 +1,32 @@
 #ifndef PARSER_DRIVER_H
 #define PARSER_DRIVER_H
 
+#include <stdio.h>
+#include <stddef.h>
 #include "ast.h"
 #include "ir.h"
 
-/* ✅ Fixed signature: Returns the AST root pointer, takes only the filename */
-ASTNode* parse_source(const char *filename);
+/* Per-parse state threaded through the pure parser */
+typedef struct ParseContext {
+    ASTArena *arena;        /* owns every node of the tree */
+    ASTNode *root;
+    FILE *diag;             /* where lexer and parser errors go */
+} ParseContext;
+
+/* A whole source file in memory, followed by two NUL bytes so the
+   scanner can run over it in place */
+typedef struct {
+    char *text;
+    size_t len;             /* without the terminating NULs */
+} SourceText;
+
+/* 1 on success; a file that cannot be read is reported on diag */
+int source_open(const char *path, SourceText *src, FILE *diag);
+void source_close(SourceText *src);
+
+/* Returns the AST root, NULL on a syntax error, which is reported on
+   diag; nodes are allocated from arena, which the caller releases once
+   it is done with the tree. Safe to call from several threads at once. */
+ASTNode* parse_text(SourceText *src, ASTArena *arena, FILE *diag);
 
 #endif
\ No newline at end of file
@@ -3,102 +3,176 @@
 #include <string.h>
 #include "ast.h"
 
-/* The actual definition of the global AST root */
-ASTNode *ast_root = NULL;
+/* =========================
+   Node arena
+   =========================
+   Nodes are carved out of blocks that double in size, so a tree costs
+   a handful of mallocs and is released by walking the block list
+   rather than the tree. */
 
-static ASTNode *new_node(ASTNodeType type) {
-    ASTNode *n = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!n) return NULL;
+#define ARENA_FIRST_BLOCK 256       /* nodes */
+#define ARENA_MAX_BLOCK   65536
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    int used, cap;
+    ASTNode nodes[];
+} ArenaBlock;
+
+struct ASTArena {
+    ArenaBlock *blocks;             /* newest first */
+};
+
+ASTArena *ast_arena_create(void) {
+    return (ASTArena*)calloc(1, sizeof(ASTArena));
+}
+
+void ast_arena_destroy(ASTArena *arena) {
+    if (!arena) return;
+    while (arena->blocks) {
+        ArenaBlock *b = arena->blocks;
+        arena->blocks = b->next;
+        free(b);
+    }
+    free(arena);
+}
+
+static ASTNode *new_node(ASTArena *a, ASTNodeType type) {
+    ArenaBlock *b = a->blocks;
+    if (!b || b->used == b->cap) {
+        int cap = b ? b->cap * 2 : ARENA_FIRST_BLOCK;
+        if (cap > ARENA_MAX_BLOCK) cap = ARENA_MAX_BLOCK;
+        ArenaBlock *nb = (ArenaBlock*)malloc(sizeof(ArenaBlock) + sizeof(ASTNode) * cap);
+        if (!nb) return NULL;
+        nb->next = b;
+        nb->used = 0;
+        nb->cap = cap;
+        a->blocks = b = nb;
+    }
+
+    ASTNode *n = &b->nodes[b->used++];
     memset(n, 0, sizeof(ASTNode));
     n->type = type;
     return n;
 }
 
-ASTNode *ast_make_int(int v) {
-    ASTNode *n = new_node(AST_INT);
+ASTNode *ast_make_int(ASTArena *a, int v) {
+    ASTNode *n = new_node(a, AST_INT);
     n->value = v;
     return n;
 }
 
-ASTNode *ast_make_ident(char *name) {
-    ASTNode *n = new_node(AST_IDENT);
-    strncpy(n->name, name, 31);
-    free(name);
+ASTNode *ast_make_ident(ASTArena *a, int sym) {
+    ASTNode *n = new_node(a, AST_IDENT);
+    n->sym = sym;
     return n;
 }
 
-ASTNode *ast_make_binop(ASTOp op, ASTNode *lhs, ASTNode *rhs) {
-    ASTNode *n = new_node(AST_BINOP);
+ASTNode *ast_make_binop(ASTArena *a, ASTOp op, ASTNode *lhs, ASTNode *rhs) {
+    ASTNode *n = new_node(a, AST_BINOP);
     n->op = op;
     n->left = lhs;
     n->right = rhs;
     return n;
 }
 
-ASTNode *ast_make_assign(ASTNode *lhs, ASTNode *rhs) {
-    ASTNode *n = new_node(AST_ASSIGN);
+ASTNode *ast_make_assign(ASTArena *a, ASTNode *lhs, ASTNode *rhs) {
+    ASTNode *n = new_node(a, AST_ASSIGN);
     n->left = lhs;
     n->right = rhs;
     return n;
 }
 
-ASTNode *ast_make_var_decl(char *name, ASTNode *init) {
-    ASTNode *n = new_node(AST_VAR_DECL);
-    strncpy(n->name, name, 31);
+ASTNode *ast_make_var_decl(ASTArena *a, int sym, ASTNode *init) {
+    ASTNode *n = new_node(a, AST_VAR_DECL);
+    n->sym = sym;
     n->left = init;
-    free(name);
     return n;
 }
 
-ASTNode *ast_make_block(ASTNode *stmts) {
-    ASTNode *n = new_node(AST_BLOCK);
+ASTNode *ast_make_array_decl(ASTArena *a, int sym, int length) {
+    ASTNode *n = new_node(a, AST_ARRAY_DECL);
+    n->sym = sym;
+    n->value = length;
+    return n;
+}
+
+ASTNode *ast_make_index(ASTArena *a, int sym, ASTNode *index) {
+    ASTNode *n = new_node(a, AST_INDEX);
+    n->sym = sym;
+    n->left = index;
+    return n;
+}
+
+ASTNode *ast_make_block(ASTArena *a, ASTNode *stmts) {
+    ASTNode *n = new_node(a, AST_BLOCK);
     n->left = stmts;
     return n;
 }
 
-ASTNode *ast_make_if(ASTNode *cond, ASTNode *thenb, ASTNode *elseb) {
-    ASTNode *n = new_node(AST_IF);
+ASTNode *ast_make_if(ASTArena *a, ASTNode *cond, ASTNode *thenb, ASTNode *elseb) {
+    ASTNode *n = new_node(a, AST_IF);
     n->left = cond;
     n->right = thenb;
     n->third = elseb;
     return n;
 }
 
-ASTNode *ast_make_while(ASTNode *cond, ASTNode *body) {
-    ASTNode *n = new_node(AST_WHILE);
+ASTNode *ast_make_while(ASTArena *a, ASTNode *cond, ASTNode *body) {
+    ASTNode *n = new_node(a, AST_WHILE);
     n->left = cond;
     n->right = body;
     return n;
 }
 
-ASTNode *ast_make_for(ASTNode *init,
+/* Parameters (AST_IDENT) and arguments come linked by next */
+static int list_length(ASTNode *n) {
+    int count = 0;
+    for (; n; n = n->next) count++;
+    return count;
+}
+
+ASTNode *ast_make_func(ASTArena *a, int sym, ASTNode *params, ASTNode *body) {
+    ASTNode *n = new_node(a, AST_FUNC);
+    n->sym = sym;
+    n->left = params;
+    n->right = body;
+    n->value = list_length(params);
+    return n;
+}
+
+ASTNode *ast_make_call(ASTArena *a, int sym, ASTNode *args) {
+    ASTNode *n = new_node(a, AST_CALL);
+    n->sym = sym;
+    n->left = args;
+    n->value = list_length(args);
+    return n;
+}
+
+ASTNode *ast_make_return(ASTArena *a, ASTNode *value) {
+    ASTNode *n = new_node(a, AST_RETURN);
+    n->left = value;
+    return n;
+}
+
+ASTNode *ast_make_for(ASTArena *a,
+                      ASTNode *init,
                       ASTNode *cond,
                       ASTNode *step,
                       ASTNode *body) {
 
-    // append step to the end of body block
-    ASTNode *n = body;
-    if (n) {
-        while (n->next) n = n->next;
-        n->next = step;
+    // step runs after the body: the parser hands us the body as a single
+    // statement, so it goes right behind it without walking a list
+    if (body) {
+        body->next = step;
     } else {
         body = step;
     }
 
-    ASTNode *f = new_node(AST_FOR);
+    ASTNode *f = new_node(a, AST_FOR);
     f->left  = init;
     f->right = cond;
     f->third = body;
     f->next  = NULL;   // IMPORTANT
     return f;
 }
-
-
-void ast_free(ASTNode *n) {
-    if (!n) return;
-    ast_free(n->left);
-    ast_free(n->right);
-    ast_free(n->third);
-    ast_free(n->next);
-    free(n);
-}
\ No newline at end of file
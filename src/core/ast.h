@@ -8,31 +8,48 @@ typedef enum {
 
 typedef enum {
     AST_BLOCK, AST_VAR_DECL, AST_ASSIGN, AST_BINOP,
-    AST_INT, AST_IDENT, AST_IF, AST_WHILE, AST_FOR
+    AST_INT, AST_IDENT, AST_IF, AST_WHILE, AST_FOR,
+    AST_ARRAY_DECL,     /* var sym[value]; */
+    AST_INDEX,          /* sym[left], as an operand or an assignment target */
+    AST_FUNC,           /* func sym(left...) right; value = parameter count */
+    AST_CALL,           /* sym(left...); value = argument count */
+    AST_RETURN          /* return left; (left may be NULL) */
 } ASTNodeType;
 
 typedef struct ASTNode {
     ASTNodeType type;
     struct ASTNode *left, *right, *third, *next;
-    char name[32];
+    int sym;        /* interned name */
     int value;
     ASTOp op;
 
     int line;
 } ASTNode;
 
-ASTNode *ast_make_int(int v);
-ASTNode *ast_make_ident(char *name);
-ASTNode *ast_make_binop(ASTOp op, ASTNode *lhs, ASTNode *rhs);
-ASTNode *ast_make_assign(ASTNode *lhs, ASTNode *rhs);
-ASTNode *ast_make_var_decl(char *name, ASTNode *init);
-ASTNode *ast_make_block(ASTNode *stmts);
-ASTNode *ast_make_if(ASTNode *cond, ASTNode *thenb, ASTNode *elseb);
-ASTNode *ast_make_while(ASTNode *cond, ASTNode *body);
-ASTNode *ast_make_for(ASTNode *init,
+/* Every node made by ast_make_* comes from the given arena and lives
+   until the arena is destroyed; there is no per-node free. */
+typedef struct ASTArena ASTArena;
+
+ASTArena *ast_arena_create(void);
+void ast_arena_destroy(ASTArena *arena);
+
+ASTNode *ast_make_int(ASTArena *a, int v);
+ASTNode *ast_make_ident(ASTArena *a, int sym);
+ASTNode *ast_make_binop(ASTArena *a, ASTOp op, ASTNode *lhs, ASTNode *rhs);
+ASTNode *ast_make_assign(ASTArena *a, ASTNode *lhs, ASTNode *rhs);
+ASTNode *ast_make_var_decl(ASTArena *a, int sym, ASTNode *init);
+ASTNode *ast_make_array_decl(ASTArena *a, int sym, int length);
+ASTNode *ast_make_index(ASTArena *a, int sym, ASTNode *index);
+ASTNode *ast_make_block(ASTArena *a, ASTNode *stmts);
+ASTNode *ast_make_if(ASTArena *a, ASTNode *cond, ASTNode *thenb, ASTNode *elseb);
+ASTNode *ast_make_while(ASTArena *a, ASTNode *cond, ASTNode *body);
+ASTNode *ast_make_func(ASTArena *a, int sym, ASTNode *params, ASTNode *body);
+ASTNode *ast_make_call(ASTArena *a, int sym, ASTNode *args);
+ASTNode *ast_make_return(ASTArena *a, ASTNode *value);
+ASTNode *ast_make_for(ASTArena *a,
+                      ASTNode *init,
                       ASTNode *cond,
                       ASTNode *step,
                       ASTNode *body);
-void ast_free(ASTNode *node);
 
 #endif
\ No newline at end of file
@@ -1,53 +1,108 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include "compiler.h"
 #include "ast.h"
 #include "ir.h"
+#include "peephole.h"
+#include "range.h"
+#include "ir_cache.h"
+#include "ir_io.h"
 #include "../compiler/parser_driver.h"
 
 /* ✅ Bridge for C++ Linking */
 #ifdef __cplusplus
 extern "C" {
 #endif
-    int semantic_analysis(ASTNode* root);
+    int semantic_analysis(ASTNode* root, FILE* diag);
     IR* generate_ir(ASTNode* root);
 #ifdef __cplusplus
 }
 #endif
 
-int compile_program(Program* p) {
+int compiler_verbose = 1;
+
+int compiler_is_bytecode(const char* path) {
+    size_t n = strlen(path);
+    return n > 5 && strcmp(path + n - 5, ".edmc") == 0;
+}
+
+static int compile(Program* p, FILE* diag, int verbose) {
     if (!p || !p->source_path) return 0;
 
-    printf("DEBUG: compile_program() called for PID %d\n", p->pid);
+    if (verbose) printf("DEBUG: compile_program() called for PID %d\n", p->pid);
+
+    // Precompiled bytecode: map it and run it in place
+    if (compiler_is_bytecode(p->source_path)) {
+        const char* why = NULL;
+        IR* mapped = ir_map(p->source_path, &why);
+        if (!mapped) {
+            fprintf(diag, "Cannot load %s: %s\n", p->source_path, why);
+            return 0;
+        }
+        p->ir = mapped;
+        p->state = PROGRAM_READY;
+        return 1;
+    }
+
+    // Read once: the text is both the cache key and the scanner's input
+    SourceText source;
+    if (!source_open(p->source_path, &source, diag)) return 0;
 
-    ASTNode* root = parse_source(p->source_path);
+    // Cache hit: the linked IR is already on disk, skip the whole front end
+    IRCacheKey key = ir_cache_key(source.text, source.len);
+    IR* cached = ir_cache_load(&key);
+    if (cached) {
+        source_close(&source);
+        p->ir = cached;
+        if (verbose) printf("DEBUG: IR loaded from compile cache.\n");
+        p->state = PROGRAM_READY;
+        return 1;
+    }
+
+    ASTArena* arena = ast_arena_create();
+    ASTNode* root = parse_text(&source, arena, diag);
+    source_close(&source);
 
     if (root == NULL) {
-        printf("DEBUG: parse_source failed (returned NULL).\n");
+        if (verbose) printf("DEBUG: parse_text failed (returned NULL).\n");
+        ast_arena_destroy(arena);
         return 0;
     }
 
     // Semantic Analysis
-    if (semantic_analysis(root) != 0) {
-        printf("DEBUG: Semantic analysis failed.\n");
-        ast_free(root);          // <-- important
+    if (semantic_analysis(root, diag) != 0) {
+        if (verbose) printf("DEBUG: Semantic analysis failed.\n");
+        ast_arena_destroy(arena);  // <-- important
         return 0;
     }
 
     // IR Generation 
     IR* generated_ir_ptr = generate_ir(root);
-    ast_free(root);              // <-- AST no longer needed
+    ast_arena_destroy(arena);      // <-- whole AST released at once
 
     if (!generated_ir_ptr) {
-        printf("DEBUG: IR generation failed.\n");
+        if (verbose) printf("DEBUG: IR generation failed.\n");
         return 0;
     }
 
     ir_resolve_labels(generated_ir_ptr);
+    ir_peephole(generated_ir_ptr);
+    ir_pack(generated_ir_ptr);
+    ir_range(generated_ir_ptr);
+    ir_cache_store(&key, generated_ir_ptr);
 
     p->ir = generated_ir_ptr;
-    printf("DEBUG: IR generated successfully.\n");
+    if (verbose) printf("DEBUG: IR generated successfully.\n");
     p->state = PROGRAM_READY; 
     return 1;
 }
+
+int compile_program(Program* p) {
+    return compile(p, stdout, compiler_verbose);
+}
+
+int compile_program_to(Program* p, FILE* diag) {
+    return compile(p, diag, 0);
+}
@@ -5,10 +5,29 @@
 extern "C" {
 #endif
 
+#include <stdio.h>
 #include "program.h"
 
+/* Part of every compile cache key: bump whenever the generated IR for a
+   given source can change (new passes, opcode or encoding changes). */
+#define COMPILER_VERSION "edm-ir-6"
+
+/* 1 on success; errors are printed on stdout */
 int compile_program(Program *p);
 
+/* Same, but errors are reported on diag and no DEBUG lines are printed:
+   for compiles off the shell's thread, whose output must not land in
+   whatever the shell is writing at the time */
+int compile_program_to(Program *p, FILE *diag);
+
+/* Nonzero (the default) prints DEBUG progress lines while compiling;
+   the shell clears it in batch mode */
+extern int compiler_verbose;
+
+/* Paths ending in .edmc hold linked IR written by `emit`; compiling
+   them just maps the file */
+int compiler_is_bytecode(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
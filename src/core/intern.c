@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "intern.h"
+
+/* Strings live in large append-only chunks so their addresses never move
+   when the index grows. The table is shared by every compilation, so all
+   access goes through one mutex. */
+#define CHUNK_SIZE (64 * 1024)
+
+typedef struct Chunk {
+    struct Chunk *next;
+    size_t used, size;
+    char data[];
+} Chunk;
+
+typedef struct {
+    const char *str;
+    size_t len;
+    unsigned hash;
+    int sym;
+} Entry;
+
+static Chunk *chunks = NULL;
+static Entry *table = NULL;     /* open addressing, linear probing */
+static int table_cap = 0;
+static int table_count = 0;
+static const char **names = NULL;   /* by symbol id */
+static int names_cap = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned hash_bytes(const char *s, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static const char *store(const char *s, size_t len) {
+    if (!chunks || chunks->size - chunks->used < len + 1) {
+        size_t size = (len + 1 > CHUNK_SIZE) ? len + 1 : CHUNK_SIZE;
+        Chunk *c = (Chunk*)malloc(sizeof(Chunk) + size);
+        c->next = chunks;
+        c->used = 0;
+        c->size = size;
+        chunks = c;
+    }
+    char *out = chunks->data + chunks->used;
+    memcpy(out, s, len);
+    out[len] = '\0';
+    chunks->used += len + 1;
+    return out;
+}
+
+static void grow(void) {
+    Entry *old = table;
+    int old_cap = table_cap;
+
+    table_cap = old_cap ? old_cap * 2 : 1024;
+    table = (Entry*)calloc(table_cap, sizeof(Entry));
+
+    unsigned mask = (unsigned)table_cap - 1;
+    for (int i = 0; i < old_cap; i++) {
+        if (!old[i].str) continue;
+        unsigned h = old[i].hash & mask;
+        while (table[h].str) h = (h + 1) & mask;
+        table[h] = old[i];
+    }
+    free(old);
+}
+
+int intern_n(const char *s, size_t len) {
+    pthread_mutex_lock(&lock);
+    if ((table_count + 1) * 2 > table_cap) grow();
+
+    unsigned hash = hash_bytes(s, len);
+    unsigned mask = (unsigned)table_cap - 1;
+    unsigned h = hash & mask;
+    for (; table[h].str; h = (h + 1) & mask) {
+        Entry *e = &table[h];
+        if (e->hash == hash && e->len == len && memcmp(e->str, s, len) == 0) {
+            pthread_mutex_unlock(&lock);
+            return e->sym;
+        }
+    }
+
+    if (table_count >= names_cap) {
+        names_cap = names_cap ? names_cap * 2 : 1024;
+        names = (const char**)realloc(names, sizeof(char*) * names_cap);
+    }
+
+    table[h].str = store(s, len);
+    table[h].len = len;
+    table[h].hash = hash;
+    table[h].sym = table_count;
+    names[table_count] = table[h].str;
+    int sym = table_count++;
+    pthread_mutex_unlock(&lock);
+    return sym;
+}
+
+int intern(const char *s) {
+    return intern_n(s, strlen(s));
+}
+
+const char *intern_name(int sym) {
+    pthread_mutex_lock(&lock);
+    const char *name = (sym >= 0 && sym < table_count) ? names[sym] : "?";
+    pthread_mutex_unlock(&lock);
+    return name;
+}
+
+int intern_count(void) {
+    pthread_mutex_lock(&lock);
+    int n = table_count;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
@@ -0,0 +1,31 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* =========================
+   Interned identifiers
+   =========================
+   Every distinct name is stored exactly once for the lifetime of the
+   process and numbered densely from 0. The AST, MIR and IR carry these
+   symbol ids instead of strings, so comparing names is an integer
+   compare and per-name tables can be plain arrays indexed by id. */
+
+int intern(const char *s);
+int intern_n(const char *s, size_t len);
+
+/* Text of a symbol; the pointer stays valid for the whole process */
+const char *intern_name(int sym);
+
+/* Number of distinct names seen so far */
+int intern_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
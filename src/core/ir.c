@@ -1,13 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "ir.h"
+#include "intern.h"
 
 IR* ir_create() {
-    IR *ir = (IR*)malloc(sizeof(IR));
+    IR *ir = (IR*)calloc(1, sizeof(IR));
     ir->capacity = 32;
     ir->size = 0;
     ir->instructions = (IRInstr*)malloc(sizeof(IRInstr) * ir->capacity);
+    ir->max_stack = -1;
     return ir;
 }
 
@@ -19,34 +22,45 @@ void ir_emit(IR *p, IRInstr instr) {
     p->instructions[p->size++] = instr;
 }
 
-IRInstr make_instr(IROp op, int value, const char* name, int line) {
+IRInstr make_instr(IROp op, int value, int sym, int line) {
     IRInstr instr;
     memset(&instr, 0, sizeof(IRInstr));
     instr.op = op;
     instr.value = value;
+    instr.sym = sym;
     instr.line = line;
-    if (name) {
-        strncpy(instr.name, name, 31);
-    }
     return instr;
 }
 
+/* A variable operand as the dump shows it: its name, or %t<k> for the
+   k-th compiler temporary */
+static const char *var_label(IR *p, int pc, int sym, char *buf, size_t n) {
+    if (sym != IR_NO_SYM || !p->ops) return intern_name(sym);
+    IROp op = (IROp)p->ops[pc];
+    int slot = (op == IR_INC_VAR || op == IR_NEW_ARRAY) ? p->pool[p->args[pc]] : p->args[pc];
+    snprintf(buf, n, "%%t%d", slot - p->nnamed);
+    return buf;
+}
+
 void ir_dump(IR *p) {
     if (!p || p->size == 0) {
         printf("  (No instructions generated)\n");
         return;
     }
     for (int i = 0; i < p->size; i++) {
-        IRInstr instr = p->instructions[i];
+        IRInstr instr = ir_at(p, i);
+        char buf[16];
+        const char *var = var_label(p, i, instr.sym, buf, sizeof(buf));
         printf("[%03d] (L%d) ", i, instr.line);
         switch(instr.op) {
             case IR_LOAD_CONST: printf("LOAD_CONST %d\n", instr.value); break;
-            case IR_LOAD_VAR:   printf("LOAD_VAR   %s\n", instr.name); break;
-            case IR_STORE_VAR:  printf("STORE_VAR  %s\n", instr.name); break;
+            case IR_LOAD_VAR:   printf("LOAD_VAR   %s\n", var); break;
+            case IR_STORE_VAR:  printf("STORE_VAR  %s\n", var); break;
             case IR_ADD:        printf("ADD\n"); break;
             case IR_SUB:        printf("SUB\n"); break;
             case IR_MUL:        printf("MUL\n"); break;
             case IR_DIV:        printf("DIV\n"); break;
+            case IR_DIV_NZ:     printf("DIV_NZ\n"); break;
             case IR_EQ:         printf("CMP_EQ\n"); break;
             case IR_NE:         printf("CMP_NE\n"); break;
             case IR_LT:         printf("CMP_LT\n"); break;
@@ -55,7 +69,20 @@ void ir_dump(IR *p) {
             case IR_GE:         printf("CMP_GE\n"); break;
             case IR_JMP:   printf("JMP L%d\n", instr.value); break;
             case IR_JZ:    printf("JZ L%d\n", instr.value); break;
+            case IR_JNZ:   printf("JNZ L%d\n", instr.value); break;
+            case IR_DUP:   printf("DUP\n"); break;
+            case IR_INC_VAR: printf("INC_VAR    %s, %d\n", var, instr.value); break;
+            case IR_NEW_ARRAY: printf("NEW_ARRAY  %s, %d\n", var, instr.value); break;
+            case IR_LOAD_ELEM:    printf("LOAD_ELEM  %s\n", var); break;
+            case IR_STORE_ELEM:   printf("STORE_ELEM %s\n", var); break;
+            case IR_LOAD_ELEM_IB:  printf("LOAD_ELEM_IB  %s\n", var); break;
+            case IR_STORE_ELEM_IB: printf("STORE_ELEM_IB %s\n", var); break;
+            case IR_CALL:  printf("CALL L%d\n", instr.value); break;
+            case IR_RET:   printf("RET\n"); break;
+            case IR_LOAD_LOCAL:  printf("LOAD_LOCAL  #%d\n", instr.value); break;
+            case IR_STORE_LOCAL: printf("STORE_LOCAL #%d\n", instr.value); break;
             case IR_LABEL: printf("L%d:\n", instr.value); break;
+            case IR_NOP:   printf("NOP\n"); break;
             default:            printf("UNKNOWN_OP\n"); break;
         }
     }
@@ -64,67 +91,209 @@ void ir_dump(IR *p) {
 void ir_free(IR *p) {
     if (p) {
         free(p->instructions);
+        free(p->procs);
+        free(p->syms);
+        if (p->map) {
+            munmap(p->map, p->map_size);
+        } else {
+            free(p->ops);
+            free(p->args);
+            free(p->pool);
+            free(p->lines);
+            free(p->line_index);
+        }
         free(p);
     }
 }
 
 /* =========================
-   Variable store
+   Linked form
    ========================= */
 
-typedef struct Var {
-    char name[32];
-    int value;
-    struct Var *next;
-} Var;
+static int cmp_line_run(const void *a, const void *b) {
+    const IRLineRun *x = (const IRLineRun*)a;
+    const IRLineRun *y = (const IRLineRun*)b;
+    if (x->line != y->line) return (x->line < y->line) ? -1 : 1;
+    return (x->pc > y->pc) - (x->pc < y->pc);
+}
 
-static Var *var_table = NULL;
+/* Slots are handed out in order of first use */
+static int slot_for(IR *ir, int *slot_of, int sym) {
+    if (slot_of[sym] < 0) {
+        slot_of[sym] = ir->nsyms;
+        ir->syms[ir->nsyms++] = sym;
+    }
+    return slot_of[sym];
+}
 
-static Var* find_var(const char *name) {
-    for (Var *v = var_table; v; v = v->next) {
-        if (strcmp(v->name, name) == 0)
-            return v;
+static int is_var_op(IROp op) {
+    switch (op) {
+        case IR_LOAD_VAR: case IR_STORE_VAR:
+        case IR_LOAD_ELEM: case IR_STORE_ELEM:
+        case IR_LOAD_ELEM_IB: case IR_STORE_ELEM_IB:
+        case IR_INC_VAR: case IR_NEW_ARRAY:
+            return 1;
+        default:
+            return 0;
     }
-    return NULL;
 }
 
-void ir_reset_vars() {
-    while (var_table) {
-        Var *tmp = var_table;
-        var_table = var_table->next;
-        free(tmp);
+void ir_pack(IR *ir) {
+    if (!ir || ir->ops) return;
+
+    int n = ir->size;
+    ir->ops = (unsigned char*)malloc(n ? n : 1);
+    ir->args = (int*)malloc(sizeof(int) * (n ? n : 1));
+    ir->lines = (IRLineRun*)malloc(sizeof(IRLineRun) * (n ? n : 1));
+    ir->nlines = 0;
+
+    int pooled = 0;
+    for (int i = 0; i < n; i++) {
+        IROp op = ir->instructions[i].op;
+        if (op == IR_INC_VAR || op == IR_NEW_ARRAY) pooled += 2;
+    }
+    pooled += 3 * ir->nprocs;
+    ir->pool = (int*)malloc(sizeof(int) * (pooled ? pooled : 1));
+    ir->pool_size = 0;
+
+    // one triple per procedure, shared by all of its calls
+    int *proc_at = (int*)malloc(sizeof(int) * (ir->nprocs ? ir->nprocs : 1));
+    for (int f = 0; f < ir->nprocs; f++) proc_at[f] = -1;
+
+    // every symbol in the program was interned before codegen
+    int nglobal = intern_count();
+    int *slot_of = (int*)malloc(sizeof(int) * (nglobal ? nglobal : 1));
+    memset(slot_of, -1, sizeof(int) * nglobal);
+    ir->syms = (int*)malloc(sizeof(int) * (nglobal ? nglobal : 1));
+    ir->nsyms = 0;
+
+    // the program's variables take the low slots, compiler temporaries
+    // the rest
+    for (int temps = 0; temps < 2; temps++) {
+        for (int i = 0; i < n; i++) {
+            IRInstr *in = &ir->instructions[i];
+            if (is_var_op(in->op) && (intern_name(in->sym)[0] == '$') == temps)
+                slot_for(ir, slot_of, in->sym);
+        }
+        if (!temps) ir->nnamed = ir->nsyms;
+    }
+    for (int k = ir->nnamed; k < ir->nsyms; k++) ir->syms[k] = IR_NO_SYM;
+
+    for (int i = 0; i < n; i++) {
+        IRInstr *in = &ir->instructions[i];
+        ir->ops[i] = (unsigned char)in->op;
+
+        switch (in->op) {
+            case IR_LOAD_VAR:
+            case IR_STORE_VAR:
+            case IR_LOAD_ELEM:
+            case IR_STORE_ELEM:
+            case IR_LOAD_ELEM_IB:
+            case IR_STORE_ELEM_IB:
+                ir->args[i] = slot_for(ir, slot_of, in->sym);
+                break;
+            case IR_INC_VAR:
+            case IR_NEW_ARRAY:
+                ir->args[i] = ir->pool_size;
+                ir->pool[ir->pool_size++] = slot_for(ir, slot_of, in->sym);
+                ir->pool[ir->pool_size++] = in->value;
+                break;
+            case IR_CALL: {
+                IRProc *f = &ir->procs[in->value];
+                if (proc_at[in->value] < 0) {
+                    proc_at[in->value] = ir->pool_size;
+                    ir->pool[ir->pool_size++] = f->entry;
+                    ir->pool[ir->pool_size++] = f->nparams;
+                    ir->pool[ir->pool_size++] = f->nlocals;
+                }
+                ir->args[i] = proc_at[in->value];
+                break;
+            }
+            default:
+                ir->args[i] = in->value;
+                break;
+        }
+
+        if (ir->nlines == 0 || ir->lines[ir->nlines - 1].line != in->line) {
+            ir->lines[ir->nlines].pc = i;
+            ir->lines[ir->nlines].line = in->line;
+            ir->nlines++;
+        }
     }
-    var_table = NULL;
+
+    free(slot_of);
+    free(proc_at);
+    ir->syms = (int*)realloc(ir->syms, sizeof(int) * (ir->nsyms ? ir->nsyms : 1));
+
+    ir->lines = (IRLineRun*)realloc(ir->lines, sizeof(IRLineRun) * (ir->nlines ? ir->nlines : 1));
+    ir->line_index = (IRLineRun*)malloc(sizeof(IRLineRun) * (ir->nlines ? ir->nlines : 1));
+    memcpy(ir->line_index, ir->lines, sizeof(IRLineRun) * ir->nlines);
+    qsort(ir->line_index, ir->nlines, sizeof(IRLineRun), cmp_line_run);
+
+    free(ir->instructions);
+    ir->instructions = NULL;
+    ir->capacity = 0;
+    free(ir->procs);
+    ir->procs = NULL;
+    ir->nprocs = 0;
 }
 
-int ir_get_var(const char *name) {
-    Var *v = find_var(name);
-    if (!v) {
-        printf("Runtime Error: Variable '%s' not found\n", name);
-        exit(1);
+/* Decoded instruction at pc, from whichever form the IR is in */
+IRInstr ir_at(IR *ir, int pc) {
+    if (!ir->ops) return ir->instructions[pc];
+
+    IROp op = (IROp)ir->ops[pc];
+    int arg = ir->args[pc];
+    int line = ir_line_at(ir, pc);
+
+    switch (op) {
+        case IR_LOAD_VAR:
+        case IR_STORE_VAR:
+        case IR_LOAD_ELEM:
+        case IR_STORE_ELEM:
+        case IR_LOAD_ELEM_IB:
+        case IR_STORE_ELEM_IB:
+            return make_instr(op, 0, ir->syms[arg], line);
+        case IR_INC_VAR:
+        case IR_NEW_ARRAY:
+            return make_instr(op, ir->pool[arg + 1], ir->syms[ir->pool[arg]], line);
+        case IR_CALL:
+            return make_instr(op, ir->pool[arg], IR_NO_SYM, line);
+        default:
+            return make_instr(op, arg, IR_NO_SYM, line);
     }
-    return v->value;
 }
 
-void ir_set_var(const char *name, int value) {
-    Var *v = find_var(name);
-    if (!v) {
-        v = malloc(sizeof(Var));
-        strcpy(v->name, name);
-        v->value = value;
-        v->next = var_table;
-        var_table = v;
-    } else {
-        v->value = value;
+int ir_line_at(IR *ir, int pc) {
+    if (!ir->ops) return ir->instructions[pc].line;
+
+    // last run starting at or before pc
+    int lo = 0, hi = ir->nlines - 1, found = 0;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (ir->lines[mid].pc <= pc) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
     }
+    return ir->nlines ? ir->lines[found].line : 0;
 }
 
-void ir_print_vars() {
-    printf("\n--- VM Final State ---\n");
-    for (Var *v = var_table; v; v = v->next) {
-        printf("%s = %d\n", v->name, v->value);
+int ir_first_pc_of_line(IR *ir, int line) {
+    // first run of line in (line, pc) order holds its lowest pc
+    int lo = 0, hi = ir->nlines - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (ir->line_index[mid].line >= line) {
+            if (ir->line_index[mid].line == line) found = mid;
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
     }
-    printf("----------------------\n");
+    return (found >= 0) ? ir->line_index[found].pc : -1;
 }
 
 void ir_resolve_labels(IR *ir) {
@@ -155,7 +324,7 @@ void ir_resolve_labels(IR *ir) {
     // 3. Update Jump Instructions
     for (int i = 0; i < ir->size; i++) {
         IROp op = ir->instructions[i].op;
-        if (op == IR_JMP || op == IR_JZ) {
+        if (op == IR_JMP || op == IR_JZ || op == IR_JNZ) {
             int lbl_id = ir->instructions[i].value;
             
             if (lbl_id >= 0 && lbl_id <= max_label && label_map[lbl_id] != -1) {
@@ -167,5 +336,11 @@ void ir_resolve_labels(IR *ir) {
         }
     }
 
+    for (int f = 0; f < ir->nprocs; f++) {
+        int lbl_id = ir->procs[f].entry;
+        if (lbl_id >= 0 && lbl_id <= max_label && label_map[lbl_id] != -1)
+            ir->procs[f].entry = label_map[lbl_id];
+    }
+
     free(label_map);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef IR_H
 #define IR_H
 
+#include <stddef.h>
 #include "ast.h"
 
 typedef enum {
@@ -8,39 +9,111 @@ typedef enum {
     IR_LOAD_VAR,
     IR_STORE_VAR,
     IR_ADD, IR_SUB, IR_MUL, IR_DIV,
+    IR_DIV_NZ,      /* DIV whose divisor was proven non-zero (see range.h) */
     IR_EQ, IR_NE, IR_LT, IR_GT, IR_LE, IR_GE,
     IR_JMP,
     IR_JZ,
-    IR_LABEL
+    IR_JNZ,
+    IR_DUP,
+    IR_INC_VAR,
+    IR_NEW_ARRAY,       /* var = zeroed array of value elements */
+    IR_LOAD_ELEM,       /* push var[pop] */
+    IR_STORE_ELEM,      /* value = pop, index = pop: var[index] = value */
+    IR_LOAD_ELEM_IB,    /* the same with the index proven in bounds (see range.h) */
+    IR_STORE_ELEM_IB,
+    IR_CALL,            /* pop the arguments into a new frame, jump to the procedure */
+    IR_RET,             /* leave the frame; the result stays on the stack */
+    IR_LOAD_LOCAL,      /* push frame slot value */
+    IR_STORE_LOCAL,     /* frame slot value = pop */
+    IR_LABEL,
+    IR_NOP
 } IROp;
 
+/* sym operand of instructions that do not name a variable */
+#define IR_NO_SYM (-1)
+
+/* Longest array a program may declare, in elements */
+#define IR_MAX_ARRAY (1 << 24)
+
+/* Most frame slots one procedure may use */
+#define IR_MAX_LOCALS (1 << 12)
+
 typedef struct {
     IROp op;
     int value;
-    char name[32];
+    int sym;        /* interned variable name, IR_NO_SYM if none */
     int line;
 } IRInstr;
 
+/* Procedure called by IR_CALL: entry is a label until
+   ir_resolve_labels, then a pc. Parameters are the first frame slots. */
+typedef struct {
+    int entry;
+    int nparams;
+    int nlocals;
+} IRProc;
+
+/* pc -> source line table entry: instructions from pc up to the next
+   run's pc all came from line */
+typedef struct {
+    int pc;
+    int line;
+} IRLineRun;
+
 typedef struct {
+    /* Construction form for irgen, label resolution and the peephole
+       pass; released by ir_pack */
     IRInstr *instructions;
     int size;
     int capacity;
+    IRProc *procs;          /* indexed by CALL's value */
+    int nprocs;
+
+    /* Linked form: one opcode byte and one operand per instruction. The
+       operand is the constant, jump target, variable or frame slot; for
+       INC_VAR and NEW_ARRAY it indexes a {slot, delta} or {slot, length}
+       pair in pool, and for CALL an {entry, nparams, nlocals} triple.
+       Slots number this program's variables densely and syms maps them
+       back to interned names, so the arrays hold nothing
+       process-specific. The program's own variables come first; slots
+       from nnamed on are compiler temporaries (names starting with '$',
+       which no identifier can), nameless in syms (IR_NO_SYM) and never
+       shown as variables. */
+    unsigned char *ops;
+    int *args;
+    int *pool;
+    int pool_size;
+    int *syms;              /* by slot */
+    int nsyms;
+    int nnamed;             /* slots with a name: the rest are temporaries */
+
+    IRLineRun *lines;       /* run-length encoded, ordered by pc */
+    IRLineRun *line_index;  /* the same runs ordered by (line, pc) */
+    int nlines;
+
+    /* Set when ops, args, pool and the line tables point into a mapped
+       .edmc file (see ir_io.h) instead of separate allocations */
+    void *map;
+    size_t map_size;
+
+    /* Deepest operand stack on any path, -1 if not proven (range.h) */
+    int max_stack;
 } IR;
 
 /* IR functions */
 IR* ir_create();
 void ir_emit(IR *p, IRInstr instr);
-IRInstr make_instr(IROp op, int value, const char* name, int line);
+IRInstr make_instr(IROp op, int value, int sym, int line);
 void ir_dump(IR *p);
 void ir_free(IR *p);
 
 void ir_resolve_labels(IR *ir);
 
-/* Variable store (VM interface) */
-int ir_get_var(const char *name);
-void ir_set_var(const char *name, int value);
-void ir_print_vars();
-void ir_reset_vars();
+/* Linked form */
+void ir_pack(IR *ir);
+IRInstr ir_at(IR *ir, int pc);      /* sym fields hold interned ids */
+int ir_line_at(IR *ir, int pc);
+int ir_first_pc_of_line(IR *ir, int line);   /* -1 if no code */
 
 
 #endif
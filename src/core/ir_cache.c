@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "ir_cache.h"
+#include "ir_io.h"
+#include "compiler.h"
+
+static IRCacheStats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void count(long *field) {
+    pthread_mutex_lock(&stats_lock);
+    (*field)++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/* =========================
+   Key
+   ========================= */
+
+/* Two independent 64-bit hashes: FNV-1a and a multiply-xorshift mix
+   over 8-byte words. Either alone would do for a cache; together a
+   false hit needs a simultaneous collision in both. */
+static uint64_t fnv1a(uint64_t h, const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t wordhash(uint64_t h, const unsigned char *p, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = mix(h ^ w) + 0x9e3779b97f4a7c15ULL;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p + i, n - i);
+    return mix(h ^ tail ^ ((uint64_t)n << 56));
+}
+
+IRCacheKey ir_cache_key(const char *source, size_t len) {
+    static const char version[] = COMPILER_VERSION;
+    uint64_t a = fnv1a(0xcbf29ce484222325ULL, (const unsigned char*)version, sizeof(version));
+    a = fnv1a(a, (const unsigned char*)source, len);
+    uint64_t b = wordhash(len, (const unsigned char*)version, sizeof(version));
+    b = wordhash(b, (const unsigned char*)source, len);
+
+    IRCacheKey key;
+    memcpy(key.bytes, &a, 8);
+    memcpy(key.bytes + 8, &b, 8);
+    return key;
+}
+
+/* =========================
+   Directory
+   ========================= */
+
+static char dir_path[1024];
+static pthread_once_t dir_once = PTHREAD_ONCE_INIT;
+
+static void make_dirs(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(path, 0755);
+        *p = '/';
+    }
+    mkdir(path, 0755);
+}
+
+static void init_dir(void) {
+    const char *env = getenv("EDM_CACHE_DIR");
+    const char *home = getenv("HOME");
+    if (env && *env)
+        snprintf(dir_path, sizeof(dir_path), "%s", env);
+    else
+        snprintf(dir_path, sizeof(dir_path), "%s/.cache/edm", home && *home ? home : "/tmp");
+    make_dirs(dir_path);
+}
+
+const char *ir_cache_dir(void) {
+    pthread_once(&dir_once, init_dir);
+    return dir_path;
+}
+
+static void entry_path(const IRCacheKey *key, char *out, size_t size) {
+    char hex[33];
+    for (int i = 0; i < 16; i++)
+        sprintf(hex + 2 * i, "%02x", key->bytes[i]);
+    snprintf(out, size, "%s/%s.ir", ir_cache_dir(), hex);
+}
+
+static int is_entry(const char *name) {
+    size_t n = strlen(name);
+    return n == 35 && strcmp(name + 32, ".ir") == 0;
+}
+
+/* =========================
+   Lookup and store
+   ========================= */
+
+IR *ir_cache_load(const IRCacheKey *key) {
+    char path[1100];
+    entry_path(key, path, sizeof(path));
+
+    IR *ir = ir_map(path, NULL);
+    if (!ir) {
+        // stale format or damaged file: drop it and rebuild
+        if (access(path, F_OK) == 0) {
+            unlink(path);
+            count(&stats.errors);
+        }
+        count(&stats.misses);
+        return NULL;
+    }
+    utime(path, NULL);      // mtime doubles as last use for eviction
+    count(&stats.hits);
+    return ir;
+}
+
+void ir_cache_store(const IRCacheKey *key, IR *ir) {
+    char path[1100];
+    entry_path(key, path, sizeof(path));
+    count(ir_save(ir, path) ? &stats.stores : &stats.errors);
+}
+
+/* =========================
+   Eviction
+   ========================= */
+
+typedef struct {
+    char name[40];
+    long size;
+    time_t used;
+} CacheEntry;
+
+static int cmp_oldest(const void *a, const void *b) {
+    const CacheEntry *x = (const CacheEntry*)a, *y = (const CacheEntry*)b;
+    if (x->used != y->used) return x->used < y->used ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+static int list_entries(CacheEntry **out, long *total) {
+    const char *dir = ir_cache_dir();
+    DIR *d = opendir(dir);
+    int n = 0, cap = 0;
+    *out = NULL;
+    *total = 0;
+    if (!d) return 0;
+
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (!is_entry(e->d_name)) continue;
+        char path[1100];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (stat(path, &st) != 0) continue;
+
+        if (n >= cap) {
+            cap = cap ? cap * 2 : 64;
+            *out = (CacheEntry*)realloc(*out, sizeof(CacheEntry) * cap);
+        }
+        memcpy((*out)[n].name, e->d_name, strlen(e->d_name) + 1);   // is_entry bounds it
+        (*out)[n].size = st.st_size;
+        (*out)[n].used = st.st_mtime;
+        *total += st.st_size;
+        n++;
+    }
+    closedir(d);
+    return n;
+}
+
+void ir_cache_usage(int *entries, long *bytes) {
+    CacheEntry *list;
+    *entries = list_entries(&list, bytes);
+    free(list);
+}
+
+int ir_cache_evict(long max_bytes) {
+    CacheEntry *list;
+    long total;
+    int n = list_entries(&list, &total);
+    qsort(list, n, sizeof(CacheEntry), cmp_oldest);
+
+    int removed = 0;
+    for (int i = 0; i < n && total > max_bytes; i++) {
+        char path[1100];
+        snprintf(path, sizeof(path), "%s/%s", ir_cache_dir(), list[i].name);
+        if (unlink(path) == 0 || errno == ENOENT) {
+            total -= list[i].size;
+            removed++;
+        }
+    }
+    free(list);
+    return removed;
+}
+
+/* =========================
+   Statistics
+   ========================= */
+
+IRCacheStats ir_cache_stats(void) {
+    pthread_mutex_lock(&stats_lock);
+    IRCacheStats s = stats;
+    pthread_mutex_unlock(&stats_lock);
+    return s;
+}
+
+void ir_cache_reset_stats(void) {
+    pthread_mutex_lock(&stats_lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,53 @@
+#ifndef IR_CACHE_H
+#define IR_CACHE_H
+
+#include <stddef.h>
+#include "ir.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* =========================
+   On-disk compile cache
+   =========================
+   Linked IR keyed by a 128-bit hash of the compiler version and the
+   source bytes, one .edmc file (see ir_io.h) per entry under
+   $EDM_CACHE_DIR (default $HOME/.cache/edm), mapped on a hit. A hit
+   replaces the whole front end; an unreadable or stale entry is
+   treated as a miss. Entries are written with ir_save, so concurrent
+   compiles never see a partial file. */
+
+typedef struct {
+    unsigned char bytes[16];
+} IRCacheKey;
+
+typedef struct {
+    long hits;
+    long misses;
+    long stores;
+    long errors;        /* unreadable entries and failed writes */
+} IRCacheStats;
+
+IRCacheKey ir_cache_key(const char *source, size_t len);
+
+/* NULL on a miss */
+IR *ir_cache_load(const IRCacheKey *key);
+void ir_cache_store(const IRCacheKey *key, IR *ir);
+
+/* Removes least recently used entries until the cache holds at most
+   max_bytes (0 empties it). Returns the number of entries removed. */
+int ir_cache_evict(long max_bytes);
+
+/* Entries and bytes currently on disk */
+void ir_cache_usage(int *entries, long *bytes);
+const char *ir_cache_dir(void);
+
+IRCacheStats ir_cache_stats(void);
+void ir_cache_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
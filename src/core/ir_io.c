@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ir_io.h"
+#include "intern.h"
+#include "range.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+#define SECTION_ALIGN   8
+
+enum { SEC_OPS, SEC_ARGS, SEC_POOL, SEC_LINES, SEC_INDEX, SEC_NAMES, NSECTIONS };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t int_bytes;
+    uint32_t size;          /* instructions */
+    uint32_t pool_size;
+    uint32_t nlines;
+    uint32_t nsyms;
+    uint32_t nnamed;        /* slots with a stored name */
+    uint32_t names_bytes;
+    uint64_t offset[NSECTIONS];
+    uint64_t file_size;
+} IRFileHeader;
+
+static uint64_t align_up(uint64_t n) {
+    return (n + SECTION_ALIGN - 1) & ~(uint64_t)(SECTION_ALIGN - 1);
+}
+
+static int takes_slot(IROp op) {
+    return op == IR_LOAD_VAR || op == IR_STORE_VAR ||
+           op == IR_LOAD_ELEM || op == IR_STORE_ELEM ||
+           op == IR_LOAD_ELEM_IB || op == IR_STORE_ELEM_IB;
+}
+
+static int is_jump(IROp op) {
+    return op == IR_JMP || op == IR_JZ || op == IR_JNZ;
+}
+
+/* =========================
+   Writing
+   ========================= */
+
+int ir_write(IR *ir, FILE *out) {
+    if (!ir || !ir->ops || !out) return 0;
+
+    uint64_t len[NSECTIONS];
+    len[SEC_OPS] = ir->size;
+    len[SEC_ARGS] = sizeof(int) * (uint64_t)ir->size;
+    len[SEC_POOL] = sizeof(int) * (uint64_t)ir->pool_size;
+    len[SEC_LINES] = sizeof(IRLineRun) * (uint64_t)ir->nlines;
+    len[SEC_INDEX] = len[SEC_LINES];
+    len[SEC_NAMES] = 0;
+    for (int s = 0; s < ir->nnamed; s++)
+        len[SEC_NAMES] += strlen(intern_name(ir->syms[s])) + 1;
+
+    IRFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = IR_FILE_MAGIC;
+    h.version = IR_FILE_VERSION;
+    h.byte_order = BYTE_ORDER_MARK;
+    h.int_bytes = sizeof(int);
+    h.size = ir->size;
+    h.pool_size = ir->pool_size;
+    h.nlines = ir->nlines;
+    h.nsyms = ir->nsyms;
+    h.nnamed = ir->nnamed;
+    h.names_bytes = (uint32_t)len[SEC_NAMES];
+
+    uint64_t at = align_up(sizeof(h));
+    for (int s = 0; s < NSECTIONS; s++) {
+        h.offset[s] = at;
+        at = align_up(at + len[s]);
+    }
+    h.file_size = at;
+
+    const void *data[NSECTIONS - 1] = { ir->ops, ir->args, ir->pool, ir->lines, ir->line_index };
+    static const char zeros[SECTION_ALIGN];
+    uint64_t pos = sizeof(h);
+
+    int ok = fwrite(&h, sizeof(h), 1, out) == 1;
+    for (int s = 0; ok && s < NSECTIONS; s++) {
+        ok = fwrite(zeros, 1, h.offset[s] - pos, out) == h.offset[s] - pos;
+        pos = h.offset[s];
+        if (s < SEC_NAMES) {
+            ok = ok && fwrite(data[s], 1, len[s], out) == len[s];
+        } else {
+            for (int k = 0; ok && k < ir->nnamed; k++) {
+                const char *name = intern_name(ir->syms[k]);
+                ok = fwrite(name, 1, strlen(name) + 1, out) == strlen(name) + 1;
+            }
+        }
+        pos += len[s];
+    }
+    ok = ok && fwrite(zeros, 1, h.file_size - pos, out) == h.file_size - pos;
+    return ok && fflush(out) == 0;
+}
+
+int ir_save(IR *ir, const char *path) {
+    char tmp[4200];
+    if (snprintf(tmp, sizeof(tmp), "%s.%ld.%lx.tmp", path, (long)getpid(),
+                 (unsigned long)pthread_self()) >= (int)sizeof(tmp))
+        return 0;
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 0;
+    int ok = ir_write(ir, f);
+    if (fclose(f) != 0) ok = 0;
+    if (ok && rename(tmp, path) == 0) return 1;
+    unlink(tmp);
+    return 0;
+}
+
+/* =========================
+   Mapping
+   ========================= */
+
+static const char *check_header(const IRFileHeader *h, uint64_t file_size) {
+    if (h->magic != IR_FILE_MAGIC) return "not an .edmc file";
+    if (h->version != IR_FILE_VERSION) return "unsupported .edmc version";
+    if (h->byte_order != BYTE_ORDER_MARK || h->int_bytes != sizeof(int))
+        return "written on an incompatible machine";
+    if (h->file_size != file_size) return "truncated file";
+    if (h->size > INT32_MAX / 2 || h->pool_size > 3 * (uint64_t)h->size ||
+        h->nlines > h->size || h->nsyms > h->size || h->nnamed > h->nsyms)
+        return "corrupt header";
+
+    uint64_t len[NSECTIONS] = {
+        h->size, sizeof(int) * (uint64_t)h->size, sizeof(int) * (uint64_t)h->pool_size,
+        sizeof(IRLineRun) * (uint64_t)h->nlines, sizeof(IRLineRun) * (uint64_t)h->nlines,
+        h->names_bytes
+    };
+    uint64_t end = sizeof(IRFileHeader);
+    for (int s = 0; s < NSECTIONS; s++) {
+        if (h->offset[s] % SECTION_ALIGN || h->offset[s] < end || h->offset[s] + len[s] > file_size)
+            return "corrupt section table";
+        end = h->offset[s] + len[s];
+    }
+    return NULL;
+}
+
+/* Every operand must make sense for its opcode before the VM sees it */
+static const char *check_code(const IR *ir) {
+    for (int i = 0; i < ir->size; i++) {
+        IROp op = (IROp)ir->ops[i];
+        int arg = ir->args[i];
+        if (op > IR_NOP) return "bad opcode";
+        if (takes_slot(op) && (arg < 0 || arg >= ir->nsyms)) return "bad variable slot";
+        if (is_jump(op) && (arg < 0 || arg > ir->size)) return "bad jump target";
+        if ((op == IR_LOAD_LOCAL || op == IR_STORE_LOCAL) && (arg < 0 || arg >= IR_MAX_LOCALS))
+            return "bad frame slot";
+        if (op == IR_INC_VAR || op == IR_NEW_ARRAY) {
+            if (arg < 0 || arg >= ir->pool_size - 1) return "bad pool index";
+            if (ir->pool[arg] < 0 || ir->pool[arg] >= ir->nsyms) return "bad variable slot";
+        }
+        if (op == IR_NEW_ARRAY && (ir->pool[arg + 1] < 1 || ir->pool[arg + 1] > IR_MAX_ARRAY))
+            return "bad array length";
+        if (op == IR_CALL) {
+            if (arg < 0 || arg >= ir->pool_size - 2) return "bad pool index";
+            const int *f = &ir->pool[arg];
+            if (f[0] < 0 || f[0] >= ir->size) return "bad call target";
+            if (f[1] < 0 || f[1] > f[2] || f[2] > IR_MAX_LOCALS) return "bad call frame";
+        }
+    }
+
+    if (ir->size && !ir->nlines) return "missing line table";
+    for (int r = 0; r < ir->nlines; r++) {
+        if (ir->lines[r].pc < 0 || ir->lines[r].pc >= ir->size ||
+            (r && ir->lines[r].pc <= ir->lines[r - 1].pc))
+            return "corrupt line table";
+        if (ir->line_index[r].pc < 0 || ir->line_index[r].pc >= ir->size)
+            return "corrupt line index";
+    }
+    return NULL;
+}
+
+static const char *bind_names(IR *ir, const char *names, uint32_t bytes) {
+    ir->syms = (int*)malloc(sizeof(int) * (ir->nsyms ? ir->nsyms : 1));
+    uint32_t at = 0;
+    for (int s = ir->nnamed; s < ir->nsyms; s++) ir->syms[s] = IR_NO_SYM;
+    for (int s = 0; s < ir->nnamed; s++) {
+        const char *end = memchr(names + at, '\0', bytes - at);
+        if (!end || end == names + at) return "corrupt symbol table";
+        ir->syms[s] = intern_n(names + at, end - (names + at));
+        at = end - names + 1;
+    }
+    return NULL;
+}
+
+/* Read-only private mapping of the whole file, NULL on failure */
+static void *map_file(const char *path, size_t *size, const char **why) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        *why = "cannot open file";
+        return NULL;
+    }
+    if ((uint64_t)st.st_size < sizeof(IRFileHeader)) {
+        close(fd);
+        *why = "not an .edmc file";
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        *why = "cannot map file";
+        return NULL;
+    }
+    *size = st.st_size;
+    return map;
+}
+
+IR *ir_map(const char *path, const char **error) {
+    const char *why = NULL;
+    size_t size = 0;
+    void *map = map_file(path, &size, &why);
+    if (!map) {
+        if (error) *error = why;
+        return NULL;
+    }
+
+    const IRFileHeader *h = (const IRFileHeader*)map;
+    const char *base = (const char*)map;
+    if ((why = check_header(h, size))) {
+        munmap(map, size);
+        if (error) *error = why;
+        return NULL;
+    }
+
+    // the arrays are used in place; only the slot -> symbol table is built
+    IR *ir = (IR*)calloc(1, sizeof(IR));
+    ir->map = map;
+    ir->map_size = size;
+    ir->size = h->size;
+    ir->pool_size = h->pool_size;
+    ir->nlines = h->nlines;
+    ir->nsyms = h->nsyms;
+    ir->nnamed = h->nnamed;
+    ir->ops = (unsigned char*)(base + h->offset[SEC_OPS]);
+    ir->args = (int*)(base + h->offset[SEC_ARGS]);
+    ir->pool = (int*)(base + h->offset[SEC_POOL]);
+    ir->lines = (IRLineRun*)(base + h->offset[SEC_LINES]);
+    ir->line_index = (IRLineRun*)(base + h->offset[SEC_INDEX]);
+
+    why = check_code(ir);
+    if (!why) why = ir_range_verify(ir);
+    if (!why) why = bind_names(ir, base + h->offset[SEC_NAMES], h->names_bytes);
+    if (why) {
+        ir_free(ir);
+        if (error) *error = why;
+        return NULL;
+    }
+    return ir;
+}
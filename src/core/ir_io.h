@@ -0,0 +1,48 @@
+#ifndef IR_IO_H
+#define IR_IO_H
+
+#include <stdio.h>
+#include "ir.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* =========================
+   .edmc bytecode files
+   =========================
+   A packed IR (see ir_pack) laid out so it can be mapped and run in
+   place:
+
+     header | ops | args | pool | lines | line_index | names
+
+   Every section starts on an 8-byte boundary at the offset recorded in
+   the header. ops, args, pool and the line tables are exactly the
+   arrays the VM reads, so ir_map points the IR straight into the
+   mapping and processes running the same file share its pages. Only
+   the symbol table is rebuilt on load: names are stored once per named
+   slot (compiler temporaries have none), NUL-terminated, and
+   re-interned because symbol ids are private to a process. Values are
+   in host byte order; the header rejects files written with a
+   different layout. Code is checked before it runs:
+   operands must be in range, every DIV_NZ and in-bounds element
+   access must pass the same range analysis that produced it, and
+   procedures must keep to their frames (see range.h). */
+
+#define IR_FILE_MAGIC   0x434d4445u     /* "EDMC" */
+#define IR_FILE_VERSION 6
+
+/* 1 on success. ir_save writes a temp file and renames it over path,
+   so an IR already mapped from path keeps running the old file */
+int ir_write(IR *ir, FILE *out);
+int ir_save(IR *ir, const char *path);
+
+/* NULL if the file is missing or not a well-formed .edmc of this
+   version; errors describes why when non-NULL */
+IR *ir_map(const char *path, const char **error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
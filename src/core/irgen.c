@@ -1,128 +1,361 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include "irgen.h"
 #include "ast.h"
 #include "ir.h"
+#include "mir.h"
+#include "intern.h"
 
-static int next_label = 0;
-static int new_label() { return next_label++; }
-
-static void emit_label(IR *ir, int id,int line) {
-    ir_emit(ir, make_instr(IR_LABEL, id, NULL, line));
-}
-
-static void emit_jmp(IR *ir, int id,int line) {
-    ir_emit(ir, make_instr(IR_JMP, id, NULL, line));
-}
-
-static void emit_jz(IR *ir, int id,int line) {
-    ir_emit(ir, make_instr(IR_JZ, id, NULL, line));
-}
-
-static void gen_stmt(IR *ir, ASTNode *n);
-
-static void gen_expr(IR *ir, ASTNode *n) {
-    if (!n) return;
-    int l = n->line;
-    switch(n->type) {
-        case AST_INT:
-            ir_emit(ir, make_instr(IR_LOAD_CONST, n->value, NULL,l));
-            break;
-        case AST_IDENT:
-            ir_emit(ir, make_instr(IR_LOAD_VAR, 0, n->name,l));
-            break;
-        case AST_BINOP:
-            gen_expr(ir, n->left);
-            gen_expr(ir, n->right);
-            switch(n->op) {
-                case AST_OP_ADD: ir_emit(ir, make_instr(IR_ADD, 0, NULL,l)); break;
-                case AST_OP_SUB: ir_emit(ir, make_instr(IR_SUB, 0, NULL,l)); break;
-                case AST_OP_MUL: ir_emit(ir, make_instr(IR_MUL, 0, NULL,l)); break;
-                case AST_OP_DIV: ir_emit(ir, make_instr(IR_DIV, 0, NULL,l)); break;
-                case AST_OP_EQ:  ir_emit(ir, make_instr(IR_EQ,  0, NULL,l)); break;
-                case AST_OP_NE:  ir_emit(ir, make_instr(IR_NE,  0, NULL,l)); break;
-                case AST_OP_LT:  ir_emit(ir, make_instr(IR_LT,  0, NULL,l)); break;
-                case AST_OP_GT:  ir_emit(ir, make_instr(IR_GT,  0, NULL,l)); break;
-                case AST_OP_LE:  ir_emit(ir, make_instr(IR_LE,  0, NULL,l)); break;
-                case AST_OP_GE:  ir_emit(ir, make_instr(IR_GE,  0, NULL,l)); break;
-            }
-            break;
-        default: break;
+/* =========================
+   MIR -> stack IR lowering
+   =========================
+   Every MIR_STORE becomes a STORE_VAR, so a variable always holds the SSA
+   value that reached it in the source. That gives three ways to
+   materialize an operand:
+     - constants are reloaded with LOAD_CONST,
+     - operands read from a variable reload that variable,
+     - expression results are emitted inline at their only use, or parked
+       in a compiler temporary ("$t<id>") when they are shared.
+   Phis need no code: each predecessor already stored the incoming value
+   into the phi's variable. Array declarations and element stores are
+   emitted where they stand; element loads are operands like any other.
+
+   Procedures are laid out after the main program, which jumps over them
+   to the end. Inside one, variables and temporaries are frame slots
+   (LOAD_LOCAL / STORE_LOCAL): the variables first, parameters leading,
+   then one slot per parked value. Block labels of each body are offset
+   so they stay unique across the whole program. */
+
+/* Pending operand of an inlined expression tree, or (op set) the
+   operator that follows once all of its operands are emitted */
+typedef struct {
+    MirValue *v;
+    int src;
+    int line;
+    bool op;
+} EmitStep;
+
+typedef struct {
+    IR *ir;
+    MirFunc *fn;
+    bool *inlined;      /* by value id */
+    int *pos;           /* by value id: position inside its block */
+    int *slot;          /* procedures, by value id: frame slot + 1 of a parked value */
+    int nlocals;
+    int label_base;
+    int end_label;
+
+    /* Work stacks: inlined trees can be as deep as the longest
+       expression in the source */
+    EmitStep *steps;
+    int steps_cap;
+    MirValue **visit;
+    int visit_cap;
+} Lower;
+
+static int temp_sym(MirValue *v) {
+    char name[32];
+    snprintf(name, sizeof(name), "$t%d", v->id);
+    return intern(name);
+}
+
+static IRInstr load_var(Lower *lw, int var, int line) {
+    if (lw->fn->proc) return make_instr(IR_LOAD_LOCAL, var, IR_NO_SYM, line);
+    return make_instr(IR_LOAD_VAR, 0, lw->fn->var_syms[var], line);
+}
+
+static IRInstr store_var(Lower *lw, int var, int line) {
+    if (lw->fn->proc) return make_instr(IR_STORE_LOCAL, var, IR_NO_SYM, line);
+    return make_instr(IR_STORE_VAR, 0, lw->fn->var_syms[var], line);
+}
+
+static int temp_slot(Lower *lw, MirValue *v) {
+    if (!lw->slot[v->id]) lw->slot[v->id] = ++lw->nlocals;
+    return lw->slot[v->id] - 1;
+}
+
+static IRInstr load_temp(Lower *lw, MirValue *v, int line) {
+    if (lw->fn->proc) return make_instr(IR_LOAD_LOCAL, temp_slot(lw, v), IR_NO_SYM, line);
+    return make_instr(IR_LOAD_VAR, 0, temp_sym(v), line);
+}
+
+static IRInstr store_temp(Lower *lw, MirValue *v, int line) {
+    if (lw->fn->proc) return make_instr(IR_STORE_LOCAL, temp_slot(lw, v), IR_NO_SYM, line);
+    return make_instr(IR_STORE_VAR, 0, temp_sym(v), line);
+}
+
+static int label_of(Lower *lw, MirBlock *b) {
+    return lw->label_base + b->id;
+}
+
+static void push_step(Lower *lw, int *n, MirValue *v, int src, int line, bool op) {
+    if (*n >= lw->steps_cap) {
+        lw->steps_cap = lw->steps_cap ? lw->steps_cap * 2 : 64;
+        lw->steps = (EmitStep*)realloc(lw->steps, sizeof(EmitStep) * lw->steps_cap);
     }
+    EmitStep *s = &lw->steps[(*n)++];
+    s->v = v;
+    s->src = src;
+    s->line = line;
+    s->op = op;
 }
 
-static void gen_stmt(IR *ir, ASTNode *n) {
-    if (!n) return;
-    
-    // Iterate through linked list of nodes
-    for (ASTNode *curr = n; curr; curr = curr->next) {
-        int l = curr->line;
-        switch(curr->type) {
-            case AST_VAR_DECL:
-                if (curr->left) gen_expr(ir, curr->left);
-                else ir_emit(ir, make_instr(IR_LOAD_CONST, 0, NULL,l));
-                ir_emit(ir, make_instr(IR_STORE_VAR, 0, curr->name,l));
-                break;
-            case AST_ASSIGN:
-                gen_expr(ir, curr->right);
-                // LHS of assign is an AST_IDENT, get name from it
-                ir_emit(ir, make_instr(IR_STORE_VAR, 0, curr->left->name,l));
-                break;
-            case AST_BLOCK:
-                gen_stmt(ir, curr->left); // Recurse into block
-                break;
-            case AST_IF: {
-                int else_lbl = new_label();
-                int end_lbl = new_label();
-
-                gen_expr(ir, curr->left);
-                emit_jz(ir, else_lbl,l);
-                gen_stmt(ir, curr->right);
-                emit_jmp(ir, end_lbl,l);
-                emit_label(ir, else_lbl,l);
-                if (curr->third) gen_stmt(ir, curr->third);
-                emit_label(ir, end_lbl,l);
-                break;
-            }
-            case AST_WHILE: {
-                int start = new_label();
-                int end = new_label();
-
-                emit_label(ir, start,l);
-                gen_expr(ir, curr->left);
-                emit_jz(ir, end,l);
-                gen_stmt(ir, curr->right);
-                emit_jmp(ir, start,l);
-                emit_label(ir, end,l);
-                break;
-            }
-            case AST_FOR: {
-                int start = new_label();
-                int end = new_label();
-
-                gen_stmt(ir, curr->left);    // init
-                emit_label(ir, start,l);
-                gen_expr(ir, curr->right);  // condition
-                emit_jz(ir, end,l);
-                gen_stmt(ir, curr->third);  // body (already includes step)
-                emit_jmp(ir, start,l);
-                emit_label(ir, end,l);
-                break;
+/* Queues v's operator behind its operands, which run first */
+static void push_tree(Lower *lw, int *n, MirValue *v) {
+    push_step(lw, n, v, -1, v->line, true);
+    for (int a = v->nargs - 1; a >= 0; a--)
+        push_step(lw, n, v->args[a], v->arg_var[a], v->line, false);
+}
+
+static IRInstr tree_op(Lower *lw, MirValue *v, int line) {
+    if (v->kind == MIR_LOAD_ELEM)
+        return make_instr(IR_LOAD_ELEM, 0, lw->fn->var_syms[v->var], line);
+    if (v->kind == MIR_CALL)
+        return make_instr(IR_CALL, v->value, IR_NO_SYM, line);
+    return make_instr(v->op, 0, IR_NO_SYM, line);
+}
+
+static void emit_steps(Lower *lw, int n) {
+    while (n > 0) {
+        EmitStep s = lw->steps[--n];
+        if (s.op) {
+            ir_emit(lw->ir, tree_op(lw, s.v, s.line));
+            continue;
+        }
+
+        MirValue *v = mir_resolve(s.v);
+        if (v->kind == MIR_CONST || v->kind == MIR_UNDEF) {
+            int c = (v->kind == MIR_CONST) ? v->value : 0;
+            ir_emit(lw->ir, make_instr(IR_LOAD_CONST, c, IR_NO_SYM, s.line));
+        } else if (s.src >= 0) {
+            ir_emit(lw->ir, load_var(lw, s.src, s.line));
+        } else if (v->kind == MIR_PARAM) {
+            ir_emit(lw->ir, load_var(lw, v->var, s.line));
+        } else if (lw->inlined[v->id]) {
+            push_tree(lw, &n, v);
+        } else {
+            ir_emit(lw->ir, load_temp(lw, v, s.line));
+        }
+    }
+}
+
+static void emit_operand(Lower *lw, MirValue *v, int src, int line) {
+    int n = 0;
+    push_step(lw, &n, v, src, line, false);
+    emit_steps(lw, n);
+}
+
+static void emit_tree(Lower *lw, MirValue *v) {
+    int n = 0;
+    push_tree(lw, &n, v);
+    emit_steps(lw, n);
+}
+
+static void push_visit(Lower *lw, int *n, MirValue *v) {
+    if (*n >= lw->visit_cap) {
+        lw->visit_cap = lw->visit_cap ? lw->visit_cap * 2 : 64;
+        lw->visit = (MirValue**)realloc(lw->visit, sizeof(MirValue*) * lw->visit_cap);
+    }
+    lw->visit[(*n)++] = v;
+}
+
+/* Does the inlined tree rooted at v reload var, or load from it? */
+static bool tree_reads(Lower *lw, MirValue *v, int var) {
+    int n = 0;
+    push_visit(lw, &n, v);
+
+    while (n > 0) {
+        v = lw->visit[--n];
+        if (v->kind == MIR_LOAD_ELEM && v->var == var) return true;
+        for (int a = 0; a < v->nargs; a++) {
+            if (v->arg_var[a] == var) return true;
+            MirValue *w = mir_resolve(v->args[a]);
+            if (v->arg_var[a] < 0 && lw->inlined[w->id]) push_visit(lw, &n, w);
+        }
+    }
+    return false;
+}
+
+/* An expression can move down to its use as long as no store in between
+   overwrites a variable its leaves reload or an array it loads from. */
+static void mark_inlined(Lower *lw, MirBlock *b) {
+    for (int k = 0; k <= b->ninstrs; k++) {
+        MirValue *v = (k < b->ninstrs) ? b->instrs[k] : b->term;
+        if (!v) continue;
+        lw->pos[v->id] = k;
+
+        for (int a = 0; a < v->nargs; a++) {
+            if (v->arg_var[a] >= 0) continue;
+            MirValue *w = mir_resolve(v->args[a]);
+            if (w->kind != MIR_BINOP && w->kind != MIR_LOAD_ELEM && w->kind != MIR_CALL) continue;
+            if (w->block != b || w->uses != 1) continue;
+
+            bool clobbered = false;
+            for (int q = lw->pos[w->id] + 1; q < k && !clobbered; q++) {
+                MirValue *s = b->instrs[q];
+                bool writes = s->kind == MIR_STORE || s->kind == MIR_STORE_ELEM ||
+                              s->kind == MIR_NEW_ARRAY;
+                clobbered = writes && tree_reads(lw, w, s->var);
             }
-            default: break;
+            if (!clobbered) lw->inlined[w->id] = true;
+        }
+    }
+}
+
+/* next is the block laid out right after b: control falls into it */
+static void lower_block(Lower *lw, MirBlock *b, MirBlock *next) {
+    IR *ir = lw->ir;
+    MirFunc *fn = lw->fn;
+
+    ir_emit(ir, make_instr(IR_LABEL, label_of(lw, b), IR_NO_SYM, b->line));
+
+    for (int k = 0; k < b->ninstrs; k++) {
+        MirValue *v = b->instrs[k];
+        if (v->kind == MIR_STORE) {
+            emit_operand(lw, v->args[0], v->arg_var[0], v->line);
+            ir_emit(ir, store_var(lw, v->var, v->line));
+        } else if (v->kind == MIR_PARAM) {
+            continue;
+        } else if (v->kind == MIR_NEW_ARRAY) {
+            ir_emit(ir, make_instr(IR_NEW_ARRAY, v->value, fn->var_syms[v->var], v->line));
+        } else if (v->kind == MIR_STORE_ELEM) {
+            emit_operand(lw, v->args[0], v->arg_var[0], v->line);
+            emit_operand(lw, v->args[1], v->arg_var[1], v->line);
+            ir_emit(ir, make_instr(IR_STORE_ELEM, 0, fn->var_syms[v->var], v->line));
+        } else if (!lw->inlined[v->id]) {
+            emit_tree(lw, v);
+            ir_emit(ir, store_temp(lw, v, v->line));
+        }
+    }
+
+    // the end label is past any procedures laid out after main
+    MirValue *t = b->term;
+    if (!t) {
+        if (next || lw->ir->nprocs) ir_emit(ir, make_instr(IR_JMP, lw->end_label, IR_NO_SYM, b->line));
+    } else if (t->kind == MIR_RET) {
+        emit_operand(lw, t->args[0], t->arg_var[0], t->line);
+        ir_emit(ir, make_instr(IR_RET, 0, IR_NO_SYM, t->line));
+    } else if (t->kind == MIR_BR) {
+        emit_operand(lw, t->args[0], t->arg_var[0], t->line);
+        if (b->succ[1] == next) {
+            ir_emit(ir, make_instr(IR_JNZ, label_of(lw, b->succ[0]), IR_NO_SYM, t->line));
+        } else {
+            ir_emit(ir, make_instr(IR_JZ, label_of(lw, b->succ[1]), IR_NO_SYM, t->line));
+            if (b->succ[0] != next)
+                ir_emit(ir, make_instr(IR_JMP, label_of(lw, b->succ[0]), IR_NO_SYM, t->line));
+        }
+    } else if (b->succ[0] != next) {
+        ir_emit(ir, make_instr(IR_JMP, label_of(lw, b->succ[0]), IR_NO_SYM, t->line));
+    }
+}
+
+/* Appends fn's code and sets *nlocals to its frame size; returns the
+   last line, for the end label */
+static int lower(IR *ir, MirFunc *fn, int label_base, int end_label, int *nlocals) {
+    Lower lw;
+    lw.ir = ir;
+    lw.fn = fn;
+    lw.inlined = (bool*)calloc(fn->nvalues, sizeof(bool));
+    lw.pos = (int*)calloc(fn->nvalues, sizeof(int));
+    lw.slot = (int*)calloc(fn->nvalues, sizeof(int));
+    lw.nlocals = fn->nvars;
+    lw.label_base = label_base;
+    lw.end_label = end_label;
+    lw.steps = NULL;
+    lw.steps_cap = 0;
+    lw.visit = NULL;
+    lw.visit_cap = 0;
+
+    mir_count_uses(fn);
+    for (int i = 0; i < fn->nblocks; i++) {
+        if (!fn->blocks[i]->dead) mark_inlined(&lw, fn->blocks[i]);
+    }
+
+    int last_line = 0;
+    MirBlock *prev = NULL;
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        if (prev) lower_block(&lw, prev, b);
+        prev = b;
+    }
+    if (prev) {
+        lower_block(&lw, prev, NULL);
+        last_line = prev->line;
+    }
+
+    *nlocals = lw.nlocals;
+
+    free(lw.inlined);
+    free(lw.pos);
+    free(lw.slot);
+    free(lw.steps);
+    free(lw.visit);
+    return last_line;
+}
+
+/* Procedures still called somewhere in fn, queued in order of first call */
+static void queue_calls(MirFunc *fn, bool *queued, int *order, int *norder) {
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int k = 0; k < b->ninstrs; k++) {
+            MirValue *v = b->instrs[k];
+            if (v->kind != MIR_CALL || queued[v->value]) continue;
+            queued[v->value] = true;
+            order[(*norder)++] = v->value;
         }
     }
 }
 
 IR* generate_ir(ASTNode *root) {
+    if (!root) return ir_create();
+
+    MirProgram *prog = mir_program(root);
+    MirFunc *main_fn = mir_build(root, prog);
+    mir_optimize(main_fn);
+
+    int nprocs = prog->nprocs;
+    MirFunc **bodies = (MirFunc**)calloc(nprocs ? nprocs : 1, sizeof(MirFunc*));
+    bool *queued = (bool*)calloc(nprocs ? nprocs : 1, sizeof(bool));
+    int *order = (int*)malloc(sizeof(int) * (nprocs ? nprocs : 1));
+    int norder = 0;
+    queue_calls(main_fn, queued, order, &norder);
+    for (int i = 0; i < norder; i++) {
+        MirFunc *fn = mir_build_proc(prog, order[i]);
+        mir_optimize(fn);
+        queue_calls(fn, queued, order, &norder);
+        bodies[order[i]] = fn;
+    }
+
     IR *ir = ir_create();
-    if (!root) return ir;
+    if (norder) {
+        ir->procs = (IRProc*)malloc(sizeof(IRProc) * nprocs);
+        ir->nprocs = nprocs;
+        for (int f = 0; f < nprocs; f++) ir->procs[f].entry = -1;
+    }
 
-    if (root->type == AST_BLOCK) {
-        gen_stmt(ir, root->left);
-    } else {
-        gen_stmt(ir, root);
+    int end_label = main_fn->next_block_id;
+    int label_base = end_label + 1;
+    int nlocals;
+    int last_line = lower(ir, main_fn, 0, end_label, &nlocals);
+    for (int i = 0; i < norder; i++) {
+        MirFunc *fn = bodies[order[i]];
+        IRProc *p = &ir->procs[order[i]];
+        p->entry = label_base + fn->blocks[0]->id;
+        p->nparams = fn->nparams;
+        lower(ir, fn, label_base, end_label, &p->nlocals);
+        label_base += fn->next_block_id;
+        mir_free(fn);
     }
+    ir_emit(ir, make_instr(IR_LABEL, end_label, IR_NO_SYM, last_line));
+
+    mir_free(main_fn);
+    mir_program_free(prog);
+    free(bodies);
+    free(queued);
+    free(order);
     return ir;
-}
\ No newline at end of file
+}
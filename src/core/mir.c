@@ -0,0 +1,1177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mir.h"
+#include "intern.h"
+
+/* =========================
+   Allocation helpers
+   ========================= */
+
+#define GROW(arr, n, cap) do {                                        \
+        if ((n) >= (cap)) {                                           \
+            (cap) = (cap) ? (cap) * 2 : 4;                            \
+            (arr) = realloc((arr), sizeof(*(arr)) * (size_t)(cap));   \
+        }                                                             \
+    } while (0)
+
+MirValue *mir_new_value(MirFunc *fn, MirKind kind, int line) {
+    MirValue *v = (MirValue*)calloc(1, sizeof(MirValue));
+    v->id = fn->nvalues;
+    v->kind = kind;
+    v->var = -1;
+    v->line = line;
+    GROW(fn->values, fn->nvalues, fn->values_cap);
+    fn->values[fn->nvalues++] = v;
+    return v;
+}
+
+void mir_add_arg(MirValue *v, MirValue *arg, int var) {
+    if (v->nargs >= v->args_cap) {
+        v->args_cap = v->args_cap ? v->args_cap * 2 : 2;
+        v->args = realloc(v->args, sizeof(MirValue*) * v->args_cap);
+        v->arg_var = realloc(v->arg_var, sizeof(int) * v->args_cap);
+    }
+    v->args[v->nargs] = arg;
+    v->arg_var[v->nargs] = var;
+    v->nargs++;
+}
+
+MirValue *mir_const(MirFunc *fn, int value, int line) {
+    MirValue *v = mir_new_value(fn, MIR_CONST, line);
+    v->value = value;
+    return v;
+}
+
+static MirValue *get_undef(MirFunc *fn) {
+    if (!fn->undef) fn->undef = mir_new_value(fn, MIR_UNDEF, 0);
+    return fn->undef;
+}
+
+/* Follow forwarding pointers left behind by folded values */
+MirValue *mir_resolve(MirValue *v) {
+    MirValue *root = v;
+    while (root->replaced) root = root->replaced;
+    while (v->replaced && v->replaced != root) {
+        MirValue *next = v->replaced;
+        v->replaced = root;
+        v = next;
+    }
+    return root;
+}
+
+static MirBlock *new_block(MirFunc *fn) {
+    MirBlock *b = (MirBlock*)calloc(1, sizeof(MirBlock));
+    b->id = fn->next_block_id++;
+    b->rpo = -1;
+    return b;
+}
+
+/* Blocks join the layout when code starts flowing into them */
+static void place_block(MirFunc *fn, MirBlock *b) {
+    GROW(fn->blocks, fn->nblocks, fn->blocks_cap);
+    fn->blocks[fn->nblocks++] = b;
+}
+
+static void add_edge(MirBlock *from, MirBlock *to) {
+    from->succ[from->nsucc++] = to;
+    GROW(to->preds, to->npreds, to->preds_cap);
+    to->preds[to->npreds++] = from;
+}
+
+void mir_append_instr(MirBlock *b, MirValue *v) {
+    v->block = b;
+    GROW(b->instrs, b->ninstrs, b->instrs_cap);
+    b->instrs[b->ninstrs++] = v;
+}
+
+void mir_remove_pred(MirBlock *b, int index) {
+    for (int i = index; i + 1 < b->npreds; i++)
+        b->preds[i] = b->preds[i + 1];
+    b->npreds--;
+
+    for (int p = 0; p < b->nphis; p++) {
+        MirValue *phi = b->phis[p];
+        for (int i = index; i + 1 < phi->nargs; i++) {
+            phi->args[i] = phi->args[i + 1];
+            phi->arg_var[i] = phi->arg_var[i + 1];
+        }
+        phi->nargs--;
+    }
+}
+
+/* =========================
+   Variables
+   ========================= */
+
+static unsigned hash_sym(int sym) {
+    return (unsigned)sym * 2654435761u;
+}
+
+static void var_hash_insert(MirFunc *fn, int index) {
+    unsigned mask = (unsigned)fn->var_hash_cap - 1;
+    unsigned h = hash_sym(fn->var_syms[index]) & mask;
+    while (fn->var_hash[h] >= 0) h = (h + 1) & mask;
+    fn->var_hash[h] = index;
+}
+
+int mir_var_index(MirFunc *fn, int sym) {
+    if (fn->var_hash_cap) {
+        unsigned mask = (unsigned)fn->var_hash_cap - 1;
+        for (unsigned h = hash_sym(sym) & mask; fn->var_hash[h] >= 0; h = (h + 1) & mask) {
+            if (fn->var_syms[fn->var_hash[h]] == sym)
+                return fn->var_hash[h];
+        }
+    }
+
+    GROW(fn->var_syms, fn->nvars, fn->vars_cap);
+    fn->var_syms[fn->nvars] = sym;
+    int index = fn->nvars++;
+
+    if (fn->nvars * 2 > fn->var_hash_cap) {
+        free(fn->var_hash);
+        fn->var_hash_cap = fn->var_hash_cap ? fn->var_hash_cap * 2 : 64;
+        fn->var_hash = (int*)malloc(sizeof(int) * fn->var_hash_cap);
+        for (int i = 0; i < fn->var_hash_cap; i++) fn->var_hash[i] = -1;
+        for (int i = 0; i < fn->nvars; i++) var_hash_insert(fn, i);
+    } else {
+        var_hash_insert(fn, index);
+    }
+    return index;
+}
+
+/* =========================
+   SSA construction
+   =========================
+   Braun et al., "Simple and Efficient Construction of SSA Form": the
+   current definition of each variable is tracked per block and phis are
+   created on demand when a read reaches a merge point. Loop headers stay
+   unsealed until the back edge is known.
+
+   An inlined call builds the callee's body right at the call site, its
+   names renamed apart ("$i<k>.<name>") so each expansion has variables
+   of its own. A parameter that the body never assigns is simply another
+   name for the caller variable passed to it, when there is one. */
+
+typedef struct {
+    uint64_t key;
+    MirValue *value;
+} DefSlot;
+
+/* A variable read waiting on the value that reaches the end of
+   blk->preds[next]; phi is NULL when blk has a single predecessor */
+typedef struct {
+    MirBlock *blk;
+    MirValue *phi;
+    int next;
+} ReadFrame;
+
+/* Expression walk: a binop is visited once on the way down and once
+   more, with expanded set, when both operand results are ready */
+typedef struct {
+    ASTNode *node;
+    bool expanded;
+} ExprWork;
+
+typedef struct {
+    MirValue *value;
+    int src;
+} ExprResult;
+
+/* Statement walk: a statement list still being built, or the code that
+   closes an if or a loop once the list under it is done */
+typedef enum {
+    STMT_LIST,
+    STMT_THEN_DONE,
+    STMT_ELSE_DONE,
+    STMT_FOR_INIT_DONE,
+    STMT_BODY_DONE
+} StmtStep;
+
+typedef struct {
+    StmtStep step;
+    ASTNode *node;          /* STMT_LIST: next statement to build */
+    MirBlock *target;       /* join block, or loop header */
+    MirBlock *exit;         /* else block, or loop exit */
+} StmtFrame;
+
+/* One expansion of an inlined call; callee names map to caller
+   variables */
+typedef struct Inline {
+    struct Inline *parent;
+    MirProc *proc;
+    int id;
+    int *from, *to;         /* symbol pairs */
+    int nmap, map_cap;
+
+    MirBlock *exit;         /* !single_exit: returns jump here... */
+    int ret;                /* ...with the result in this variable */
+    MirValue *result;       /* single_exit: the returned value */
+    int result_src;
+} Inline;
+
+typedef struct {
+    MirFunc *fn;
+    MirBlock *cur;
+    MirProgram *prog;
+    Inline *inl;            /* innermost expansion being built, or NULL */
+    int ninlines;
+
+    DefSlot *defs;          /* (block, var) -> current definition */
+    int defs_cap, ndefs;
+
+    /* Work stacks for the walks below, which never recurse on the C
+       stack however long or deeply nested the program is */
+    ReadFrame *reads;
+    int reads_cap;
+    ExprWork *ework;
+    int nework, ework_cap;
+    ExprResult *eresults;
+    int neresults, eresults_cap;
+    StmtFrame *frames;
+    int nframes, frames_cap;
+} Builder;
+
+static uint64_t def_key(MirBlock *b, int var) {
+    return ((uint64_t)(uint32_t)b->id << 32) | (uint32_t)var;
+}
+
+static uint64_t hash_key(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static void defs_grow(Builder *b) {
+    DefSlot *old = b->defs;
+    int old_cap = b->defs_cap;
+
+    b->defs_cap = old_cap ? old_cap * 2 : 256;
+    b->defs = (DefSlot*)calloc(b->defs_cap, sizeof(DefSlot));
+    b->ndefs = 0;
+
+    unsigned mask = (unsigned)b->defs_cap - 1;
+    for (int i = 0; i < old_cap; i++) {
+        if (!old[i].value) continue;
+        unsigned h = (unsigned)hash_key(old[i].key) & mask;
+        while (b->defs[h].value) h = (h + 1) & mask;
+        b->defs[h] = old[i];
+        b->ndefs++;
+    }
+    free(old);
+}
+
+static void def_put(Builder *b, MirBlock *blk, int var, MirValue *v) {
+    if ((b->ndefs + 1) * 2 > b->defs_cap) defs_grow(b);
+
+    uint64_t key = def_key(blk, var);
+    unsigned mask = (unsigned)b->defs_cap - 1;
+    unsigned h = (unsigned)hash_key(key) & mask;
+    while (b->defs[h].value && b->defs[h].key != key) h = (h + 1) & mask;
+    if (!b->defs[h].value) b->ndefs++;
+    b->defs[h].key = key;
+    b->defs[h].value = v;
+}
+
+static MirValue *def_get(Builder *b, MirBlock *blk, int var) {
+    if (!b->defs_cap) return NULL;
+    uint64_t key = def_key(blk, var);
+    unsigned mask = (unsigned)b->defs_cap - 1;
+    for (unsigned h = (unsigned)hash_key(key) & mask; b->defs[h].value; h = (h + 1) & mask) {
+        if (b->defs[h].key == key) return b->defs[h].value;
+    }
+    return NULL;
+}
+
+MirValue *mir_new_phi(MirFunc *fn, MirBlock *b, int var) {
+    MirValue *phi = mir_new_value(fn, MIR_PHI, b->line);
+    phi->var = var;
+    phi->block = b;
+    GROW(b->phis, b->nphis, b->phis_cap);
+    b->phis[b->nphis++] = phi;
+    return phi;
+}
+
+/* A phi whose operands are all the same value (or itself) is that value */
+static MirValue *try_remove_trivial_phi(MirFunc *fn, MirValue *phi) {
+    MirValue *same = NULL;
+    for (int i = 0; i < phi->nargs; i++) {
+        MirValue *a = mir_resolve(phi->args[i]);
+        if (a == same || a == phi) continue;
+        if (same) return phi;
+        same = a;
+    }
+    if (!same) same = get_undef(fn);
+    phi->replaced = same;
+    phi->dead = true;
+    return same;
+}
+
+/* The recursive lookup of Braun et al., with the pending reads kept on
+   b->reads: a read may walk back through every block of the program. */
+static MirValue *read_var(Builder *b, int var, MirBlock *blk) {
+    MirValue *ret = NULL;
+    MirBlock *call = blk;
+    int n = 0;
+
+    for (;;) {
+        if (call) {
+            MirValue *v = def_get(b, call, var);
+            if (v) {
+                ret = mir_resolve(v);
+            } else if (!call->sealed) {
+                ret = mir_new_phi(b->fn, call, var);
+                GROW(call->incomplete, call->nincomplete, call->incomplete_cap);
+                call->incomplete[call->nincomplete++] = ret;
+                def_put(b, call, var, ret);
+            } else if (call->npreds == 0) {
+                ret = get_undef(b->fn);
+                def_put(b, call, var, ret);
+            } else {
+                MirValue *phi = NULL;
+                if (call->npreds > 1) {
+                    // break cycles through loops before visiting predecessors
+                    phi = mir_new_phi(b->fn, call, var);
+                    def_put(b, call, var, phi);
+                }
+                GROW(b->reads, n, b->reads_cap);
+                b->reads[n].blk = call;
+                b->reads[n].phi = phi;
+                b->reads[n].next = 0;
+                n++;
+                call = call->preds[0];
+                continue;
+            }
+            call = NULL;
+        }
+
+        // ret answers the innermost pending read
+        if (n == 0) return ret;
+        ReadFrame *f = &b->reads[n - 1];
+        if (f->phi) {
+            mir_add_arg(f->phi, ret, var);
+            if (++f->next < f->blk->npreds) {
+                call = f->blk->preds[f->next];
+                continue;
+            }
+            ret = try_remove_trivial_phi(b->fn, f->phi);
+        }
+        def_put(b, f->blk, var, ret);
+        n--;
+    }
+}
+
+static MirValue *add_phi_operands(Builder *b, MirValue *phi) {
+    MirBlock *blk = phi->block;
+    for (int i = 0; i < blk->npreds; i++)
+        mir_add_arg(phi, read_var(b, phi->var, blk->preds[i]), phi->var);
+    return try_remove_trivial_phi(b->fn, phi);
+}
+
+static void seal_block(Builder *b, MirBlock *blk) {
+    for (int i = 0; i < blk->nincomplete; i++)
+        add_phi_operands(b, blk->incomplete[i]);
+    free(blk->incomplete);
+    blk->incomplete = NULL;
+    blk->nincomplete = blk->incomplete_cap = 0;
+    blk->sealed = true;
+}
+
+static void start_block(Builder *b, MirBlock *blk, int line) {
+    blk->line = line;
+    place_block(b->fn, blk);
+    b->cur = blk;
+}
+
+static void terminate_jmp(Builder *b, MirBlock *to, int line) {
+    MirValue *t = mir_new_value(b->fn, MIR_JMP, line);
+    t->block = b->cur;
+    b->cur->term = t;
+    add_edge(b->cur, to);
+}
+
+static void terminate_br(Builder *b, MirValue *cond, int src,
+                         MirBlock *nonzero, MirBlock *zero, int line) {
+    MirValue *t = mir_new_value(b->fn, MIR_BR, line);
+    t->block = b->cur;
+    mir_add_arg(t, cond, src);
+    b->cur->term = t;
+    add_edge(b->cur, nonzero);
+    add_edge(b->cur, zero);
+}
+
+static IROp binop_to_ir(ASTOp op) {
+    switch (op) {
+        case AST_OP_ADD: return IR_ADD;
+        case AST_OP_SUB: return IR_SUB;
+        case AST_OP_MUL: return IR_MUL;
+        case AST_OP_DIV: return IR_DIV;
+        case AST_OP_EQ:  return IR_EQ;
+        case AST_OP_NE:  return IR_NE;
+        case AST_OP_LT:  return IR_LT;
+        case AST_OP_GT:  return IR_GT;
+        case AST_OP_LE:  return IR_LE;
+        case AST_OP_GE:  return IR_GE;
+    }
+    return IR_ADD;
+}
+
+static void push_expr(Builder *b, ASTNode *node, bool expanded) {
+    GROW(b->ework, b->nework, b->ework_cap);
+    b->ework[b->nework].node = node;
+    b->ework[b->nework].expanded = expanded;
+    b->nework++;
+}
+
+/* Variable index of a name as the code being built sees it */
+static int var_of(Builder *b, int sym) {
+    Inline *in = b->inl;
+    if (in) {
+        int k = 0;
+        while (k < in->nmap && in->from[k] != sym) k++;
+        if (k == in->nmap) {
+            char name[256];
+            snprintf(name, sizeof(name), "$i%d.%s", in->id, intern_name(sym));
+            if (in->nmap >= in->map_cap) {
+                in->map_cap = in->map_cap ? in->map_cap * 2 : 8;
+                in->from = realloc(in->from, sizeof(int) * (size_t)in->map_cap);
+                in->to = realloc(in->to, sizeof(int) * (size_t)in->map_cap);
+            }
+            in->from[k] = sym;
+            in->to[k] = intern(name);
+            in->nmap++;
+        }
+        sym = in->to[k];
+    }
+    return mir_var_index(b->fn, sym);
+}
+
+static MirValue *build_call(Builder *b, ASTNode *call, const ExprResult *args, int *src);
+
+/* Returns the SSA value of n; *src is the variable it was read from, if
+   any. Operands are built left to right, as a recursive walk would. The
+   work stacks are shared with the walks an inlined call starts, so each
+   walk only pops what it pushed. */
+static MirValue *build_expr(Builder *b, ASTNode *n, int *src) {
+    int wbase = b->nework, rbase = b->neresults;
+    push_expr(b, n, false);
+
+    while (b->nework > wbase) {
+        ExprWork w = b->ework[--b->nework];
+        ASTNode *node = w.node;
+        ExprResult r = { NULL, -1 };
+
+        if (!node) {
+            r.value = mir_const(b->fn, 0, 0);
+        } else if (node->type == AST_BINOP && !w.expanded) {
+            push_expr(b, node, true);
+            push_expr(b, node->right, false);
+            push_expr(b, node->left, false);
+            continue;
+        } else if (node->type == AST_BINOP) {
+            ExprResult rhs = b->eresults[--b->neresults];
+            ExprResult lhs = b->eresults[--b->neresults];
+            MirValue *v = mir_new_value(b->fn, MIR_BINOP, node->line);
+            v->op = binop_to_ir(node->op);
+            mir_add_arg(v, lhs.value, lhs.src);
+            mir_add_arg(v, rhs.value, rhs.src);
+            mir_append_instr(b->cur, v);
+            r.value = v;
+        } else if (node->type == AST_INDEX && !w.expanded) {
+            push_expr(b, node, true);
+            push_expr(b, node->left, false);
+            continue;
+        } else if (node->type == AST_INDEX) {
+            ExprResult index = b->eresults[--b->neresults];
+            MirValue *v = mir_new_value(b->fn, MIR_LOAD_ELEM, node->line);
+            v->var = var_of(b, node->sym);
+            mir_add_arg(v, index.value, index.src);
+            mir_append_instr(b->cur, v);
+            r.value = v;
+        } else if (node->type == AST_CALL && !w.expanded) {
+            // arguments are pushed in reverse so the first is built first
+            push_expr(b, node, true);
+            int first = b->nework;
+            for (ASTNode *a = node->left; a; a = a->next) push_expr(b, a, false);
+            for (int lo = first, hi = b->nework - 1; lo < hi; lo++, hi--) {
+                ExprWork t = b->ework[lo];
+                b->ework[lo] = b->ework[hi];
+                b->ework[hi] = t;
+            }
+            continue;
+        } else if (node->type == AST_CALL) {
+            // the callee's own walks reuse the result stack above these
+            int nargs = node->value;
+            ExprResult *args = (ExprResult*)malloc(sizeof(ExprResult) * (nargs ? nargs : 1));
+            b->neresults -= nargs;
+            memcpy(args, &b->eresults[b->neresults], sizeof(ExprResult) * nargs);
+            r.value = build_call(b, node, args, &r.src);
+            free(args);
+        } else if (node->type == AST_INT) {
+            r.value = mir_const(b->fn, node->value, node->line);
+        } else if (node->type == AST_IDENT) {
+            r.src = var_of(b, node->sym);
+            r.value = read_var(b, r.src, b->cur);
+        } else {
+            r.value = mir_const(b->fn, 0, node->line);
+        }
+
+        GROW(b->eresults, b->neresults, b->eresults_cap);
+        b->eresults[b->neresults++] = r;
+    }
+
+    *src = b->eresults[rbase].src;
+    MirValue *v = b->eresults[rbase].value;
+    b->neresults = rbase;
+    return v;
+}
+
+static void build_store(Builder *b, int var, MirValue *v, int src, int line) {
+    MirValue *st = mir_new_value(b->fn, MIR_STORE, line);
+    st->var = var;
+    mir_add_arg(st, v, src);
+    mir_append_instr(b->cur, st);
+    def_put(b, b->cur, var, v);
+}
+
+static void build_store_elem(Builder *b, ASTNode *target, ASTNode *rhs, int line) {
+    int isrc, vsrc;
+    MirValue *index = build_expr(b, target->left, &isrc);
+    MirValue *v = build_expr(b, rhs, &vsrc);
+    MirValue *st = mir_new_value(b->fn, MIR_STORE_ELEM, line);
+    st->var = var_of(b, target->sym);
+    mir_add_arg(st, index, isrc);
+    mir_add_arg(st, v, vsrc);
+    mir_append_instr(b->cur, st);
+}
+
+/* Code after a return: reachable from nowhere, dropped by SCCP */
+static void start_unreachable(Builder *b, int line) {
+    MirBlock *dead = new_block(b->fn);
+    dead->sealed = true;
+    start_block(b, dead, line);
+}
+
+static void build_return(Builder *b, MirValue *v, int src, int line) {
+    Inline *in = b->inl;
+    if (in && in->proc->single_exit) {
+        // the last statement of the body: the value is the call's result
+        in->result = v;
+        in->result_src = src;
+        return;
+    }
+    if (in) {
+        build_store(b, in->ret, v, src, line);
+        terminate_jmp(b, in->exit, line);
+    } else {
+        MirValue *t = mir_new_value(b->fn, MIR_RET, line);
+        t->block = b->cur;
+        mir_add_arg(t, v, src);
+        b->cur->term = t;
+    }
+    start_unreachable(b, line);
+}
+
+/* Loops are rotated into guarded do-while form:
+
+       guard:  br cond ? pre : exit
+       pre:    jmp body              (preheader, home for hoisted code)
+       body:   ...                   (loop header)
+       latch:  br cond ? body : exit
+
+   so an iteration costs one conditional branch instead of a test at the
+   top plus a jump back. The condition is simply built twice; the body
+   block stays unsealed until the latch edge exists. loop_begin leaves
+   the header current for the body; loop_end adds the latch. */
+static void loop_begin(Builder *b, ASTNode *cond, int line,
+                       MirBlock **header_out, MirBlock **exit_out) {
+    MirBlock *pre = new_block(b->fn);
+    MirBlock *header = new_block(b->fn);
+    MirBlock *exit = new_block(b->fn);
+
+    int src;
+    MirValue *c = build_expr(b, cond, &src);
+    terminate_br(b, c, src, pre, exit, line);
+
+    seal_block(b, pre);
+    start_block(b, pre, line);
+    terminate_jmp(b, header, line);
+
+    start_block(b, header, line);
+    *header_out = header;
+    *exit_out = exit;
+}
+
+static void loop_end(Builder *b, ASTNode *cond, int line, MirBlock *header, MirBlock *exit) {
+    int src;
+    MirValue *c = build_expr(b, cond, &src);
+    terminate_br(b, c, src, header, exit, line);
+
+    seal_block(b, header);
+    seal_block(b, exit);
+    start_block(b, exit, line);
+}
+
+/* Leaves the then block current; the else block is NULL without else */
+static void if_begin(Builder *b, ASTNode *n, MirBlock **join_out, MirBlock **else_out) {
+    int line = n->line;
+    int src;
+    MirValue *c = build_expr(b, n->left, &src);
+
+    MirBlock *then_b = new_block(b->fn);
+    MirBlock *else_b = n->third ? new_block(b->fn) : NULL;
+    MirBlock *join = new_block(b->fn);
+
+    terminate_br(b, c, src, then_b, else_b ? else_b : join, line);
+
+    seal_block(b, then_b);
+    start_block(b, then_b, line);
+    *join_out = join;
+    *else_out = else_b;
+}
+
+static void if_join(Builder *b, MirBlock *join, int line) {
+    seal_block(b, join);
+    start_block(b, join, line);
+}
+
+static void push_frame(Builder *b, StmtStep step, ASTNode *node,
+                       MirBlock *target, MirBlock *exit) {
+    GROW(b->frames, b->nframes, b->frames_cap);
+    StmtFrame *f = &b->frames[b->nframes++];
+    f->step = step;
+    f->node = node;
+    f->target = target;
+    f->exit = exit;
+}
+
+static void build_stmts(Builder *b, ASTNode *list) {
+    int base = b->nframes;
+    push_frame(b, STMT_LIST, list, NULL, NULL);
+
+    while (b->nframes > base) {
+        StmtFrame f = b->frames[b->nframes - 1];
+
+        if (f.step != STMT_LIST) {
+            b->nframes--;
+            ASTNode *s = f.node;
+            switch (f.step) {
+                case STMT_THEN_DONE:
+                    terminate_jmp(b, f.target, s->line);
+                    if (f.exit) {
+                        seal_block(b, f.exit);
+                        start_block(b, f.exit, s->line);
+                        push_frame(b, STMT_ELSE_DONE, s, f.target, NULL);
+                        push_frame(b, STMT_LIST, s->third, NULL, NULL);
+                    } else {
+                        if_join(b, f.target, s->line);
+                    }
+                    break;
+                case STMT_ELSE_DONE:
+                    terminate_jmp(b, f.target, s->line);
+                    if_join(b, f.target, s->line);
+                    break;
+                case STMT_FOR_INIT_DONE: {
+                    MirBlock *header, *exit;
+                    loop_begin(b, s->right, s->line, &header, &exit);
+                    push_frame(b, STMT_BODY_DONE, s, header, exit);
+                    push_frame(b, STMT_LIST, s->third, NULL, NULL);
+                    break;
+                }
+                case STMT_BODY_DONE: {
+                    ASTNode *cond = (s->type == AST_FOR) ? s->right : s->left;
+                    loop_end(b, cond, s->line, f.target, f.exit);
+                    break;
+                }
+                default:
+                    break;
+            }
+            continue;
+        }
+
+        ASTNode *curr = f.node;
+        if (!curr) {
+            b->nframes--;
+            continue;
+        }
+        b->frames[b->nframes - 1].node = curr->next;
+
+        int l = curr->line;
+        int src = -1;
+        switch (curr->type) {
+            case AST_VAR_DECL: {
+                MirValue *v = curr->left ? build_expr(b, curr->left, &src)
+                                         : mir_const(b->fn, 0, l);
+                build_store(b, var_of(b, curr->sym), v, src, l);
+                break;
+            }
+            case AST_ARRAY_DECL: {
+                MirValue *v = mir_new_value(b->fn, MIR_NEW_ARRAY, l);
+                v->var = var_of(b, curr->sym);
+                v->value = curr->value;
+                mir_append_instr(b->cur, v);
+                break;
+            }
+            case AST_ASSIGN: {
+                if (curr->left->type == AST_INDEX) {
+                    build_store_elem(b, curr->left, curr->right, l);
+                    break;
+                }
+                MirValue *v = build_expr(b, curr->right, &src);
+                build_store(b, var_of(b, curr->left->sym), v, src, l);
+                break;
+            }
+            case AST_RETURN: {
+                MirValue *v = curr->left ? build_expr(b, curr->left, &src)
+                                         : mir_const(b->fn, 0, l);
+                build_return(b, v, src, l);
+                break;
+            }
+            case AST_BLOCK:
+                push_frame(b, STMT_LIST, curr->left, NULL, NULL);
+                break;
+            case AST_IF: {
+                MirBlock *join, *else_b;
+                if_begin(b, curr, &join, &else_b);
+                push_frame(b, STMT_THEN_DONE, curr, join, else_b);
+                push_frame(b, STMT_LIST, curr->right, NULL, NULL);
+                break;
+            }
+            case AST_WHILE: {
+                MirBlock *header, *exit;
+                loop_begin(b, curr->left, l, &header, &exit);
+                push_frame(b, STMT_BODY_DONE, curr, header, exit);
+                push_frame(b, STMT_LIST, curr->right, NULL, NULL);
+                break;
+            }
+            case AST_FOR:
+                push_frame(b, STMT_FOR_INIT_DONE, curr, NULL, NULL);
+                push_frame(b, STMT_LIST, curr->left, NULL, NULL);     // init
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Expands a call to an inlined function in place. Every return of a
+   single-exit body is its last statement, so the value it returns is
+   the result; otherwise returns store into a result variable and jump
+   to a join block. */
+static MirValue *build_inline(Builder *b, MirProc *p, const ExprResult *args, int line, int *src) {
+    MirFunc *fn = b->fn;
+    Inline in;
+    memset(&in, 0, sizeof(in));
+    in.parent = b->inl;
+    in.proc = p;
+    in.id = b->ninlines++;
+    in.result_src = -1;
+
+    // arguments bind in the caller's names, before the body renames
+    ASTNode *param = p->def->left;
+    for (int i = 0; i < p->nparams; i++, param = param->next) {
+        if (args[i].src >= 0 && !p->reassigned[i]) {
+            if (in.nmap >= in.map_cap) {
+                in.map_cap = in.map_cap ? in.map_cap * 2 : 8;
+                in.from = realloc(in.from, sizeof(int) * (size_t)in.map_cap);
+                in.to = realloc(in.to, sizeof(int) * (size_t)in.map_cap);
+            }
+            in.from[in.nmap] = param->sym;
+            in.to[in.nmap++] = fn->var_syms[args[i].src];
+        }
+    }
+    b->inl = &in;
+    param = p->def->left;
+    for (int i = 0; i < p->nparams; i++, param = param->next) {
+        if (args[i].src < 0 || p->reassigned[i])
+            build_store(b, var_of(b, param->sym), args[i].value, args[i].src, line);
+    }
+    if (!p->single_exit) {
+        in.exit = new_block(fn);
+        in.ret = var_of(b, intern("$ret"));
+    }
+
+    build_stmts(b, p->def->right);
+    b->inl = in.parent;
+
+    MirValue *v;
+    if (p->single_exit) {
+        v = in.result ? in.result : mir_const(fn, 0, line);
+        *src = in.result_src;
+    } else {
+        // falling off the end returns 0
+        build_store(b, in.ret, mir_const(fn, 0, line), -1, line);
+        terminate_jmp(b, in.exit, line);
+        seal_block(b, in.exit);
+        start_block(b, in.exit, line);
+        v = read_var(b, in.ret, b->cur);
+        *src = in.ret;
+    }
+
+    free(in.from);
+    free(in.to);
+    fn->stats.calls_inlined++;
+    return v;
+}
+
+static MirValue *build_call(Builder *b, ASTNode *call, const ExprResult *args, int *src) {
+    int proc = mir_proc_index(b->prog, call->sym);
+    MirProc *p = &b->prog->procs[proc];
+    if (p->inlined) return build_inline(b, p, args, call->line, src);
+
+    MirValue *v = mir_new_value(b->fn, MIR_CALL, call->line);
+    v->value = proc;
+    for (int i = 0; i < p->nparams; i++) mir_add_arg(v, args[i].value, args[i].src);
+    mir_append_instr(b->cur, v);
+    *src = -1;
+    return v;
+}
+
+static MirFunc *build(MirProgram *prog, ASTNode *body, MirProc *proc) {
+    MirFunc *fn = (MirFunc*)calloc(1, sizeof(MirFunc));
+    Builder b;
+    memset(&b, 0, sizeof(b));
+    b.fn = fn;
+    b.prog = prog;
+
+    MirBlock *entry = new_block(fn);
+    entry->sealed = true;
+    start_block(&b, entry, proc ? proc->def->line : 1);
+
+    if (proc) {
+        fn->proc = true;
+        fn->nparams = proc->nparams;
+        for (ASTNode *param = proc->def->left; param; param = param->next) {
+            MirValue *v = mir_new_value(fn, MIR_PARAM, proc->def->line);
+            v->var = mir_var_index(fn, param->sym);
+            mir_append_instr(entry, v);
+            def_put(&b, entry, v->var, v);
+        }
+    }
+
+    if (body) build_stmts(&b, body->type == AST_BLOCK ? body->left : body);
+
+    if (proc && !b.cur->term) {
+        // falling off the end returns 0
+        MirValue *t = mir_new_value(fn, MIR_RET, b.cur->line);
+        t->block = b.cur;
+        mir_add_arg(t, mir_const(fn, 0, b.cur->line), -1);
+        b.cur->term = t;
+    }
+
+    free(b.defs);
+    free(b.reads);
+    free(b.ework);
+    free(b.eresults);
+    free(b.frames);
+    mir_remove_trivial_phis(fn);
+    mir_sweep(fn);
+    return fn;
+}
+
+/* Function definitions in the statement list build nothing here */
+MirFunc *mir_build(ASTNode *root, MirProgram *prog) {
+    return build(prog, root, NULL);
+}
+
+MirFunc *mir_build_proc(MirProgram *prog, int proc) {
+    MirProc *p = &prog->procs[proc];
+    return build(prog, p->def->right, p);
+}
+
+/* =========================
+   Cleanup
+   ========================= */
+
+/* Worklist form: removing a phi only re-examines the phis that use it,
+   so a cascade through nested loops costs its length, not a full pass
+   over every phi per step. A removed phi's users are handed on to its
+   replacement, since they now read that value instead. */
+void mir_remove_trivial_phis(MirFunc *fn) {
+    int *head = (int*)malloc(sizeof(int) * (fn->nvalues ? fn->nvalues : 1));
+    int *tail = (int*)malloc(sizeof(int) * (fn->nvalues ? fn->nvalues : 1));
+    bool *queued = (bool*)calloc(fn->nvalues ? fn->nvalues : 1, sizeof(bool));
+    for (int i = 0; i < fn->nvalues; i++) head[i] = tail[i] = -1;
+
+    int *user = NULL, *next = NULL;
+    int nedges = 0, edges_cap = 0;
+    MirValue **work = NULL;
+    int nwork = 0, work_cap = 0;
+
+    for (int i = fn->nblocks - 1; i >= 0; i--) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int p = b->nphis - 1; p >= 0; p--) {
+            MirValue *phi = b->phis[p];
+            if (phi->dead) continue;
+            GROW(work, nwork, work_cap);
+            work[nwork++] = phi;
+            queued[phi->id] = true;
+
+            for (int a = 0; a < phi->nargs; a++) {
+                MirValue *arg = mir_resolve(phi->args[a]);
+                if (arg->kind != MIR_PHI || arg == phi) continue;
+                if (nedges >= edges_cap) {
+                    edges_cap = edges_cap ? edges_cap * 2 : 256;
+                    user = (int*)realloc(user, sizeof(int) * edges_cap);
+                    next = (int*)realloc(next, sizeof(int) * edges_cap);
+                }
+                user[nedges] = phi->id;
+                next[nedges] = -1;
+                if (tail[arg->id] >= 0) next[tail[arg->id]] = nedges;
+                else head[arg->id] = nedges;
+                tail[arg->id] = nedges++;
+            }
+        }
+    }
+
+    while (nwork > 0) {
+        MirValue *phi = work[--nwork];
+        queued[phi->id] = false;
+        if (phi->dead) continue;
+
+        MirValue *same = try_remove_trivial_phi(fn, phi);
+        if (same == phi) continue;
+
+        /* removed users are unlinked so handed-on lists stay short */
+        int prev = -1;
+        for (int e = head[phi->id]; e >= 0; e = next[e]) {
+            MirValue *u = fn->values[user[e]];
+            if (u->dead) {
+                if (prev >= 0) next[prev] = next[e];
+                else head[phi->id] = next[e];
+                continue;
+            }
+            prev = e;
+            if (queued[u->id]) continue;
+            GROW(work, nwork, work_cap);
+            work[nwork++] = u;
+            queued[u->id] = true;
+        }
+        tail[phi->id] = prev;
+        if (same->kind == MIR_PHI && head[phi->id] >= 0) {
+            if (tail[same->id] >= 0) next[tail[same->id]] = head[phi->id];
+            else head[same->id] = head[phi->id];
+            tail[same->id] = tail[phi->id];
+        }
+    }
+
+    free(head);
+    free(tail);
+    free(queued);
+    free(user);
+    free(next);
+    free(work);
+}
+
+static void resolve_args(MirValue *v) {
+    for (int i = 0; i < v->nargs; i++)
+        v->args[i] = mir_resolve(v->args[i]);
+}
+
+/* Drop dead phis and instructions and point every operand at its final value */
+void mir_sweep(MirFunc *fn) {
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+
+        int out = 0;
+        for (int p = 0; p < b->nphis; p++) {
+            if (b->phis[p]->dead) continue;
+            resolve_args(b->phis[p]);
+            b->phis[out++] = b->phis[p];
+        }
+        b->nphis = out;
+
+        out = 0;
+        for (int k = 0; k < b->ninstrs; k++) {
+            if (b->instrs[k]->dead) continue;
+            resolve_args(b->instrs[k]);
+            b->instrs[out++] = b->instrs[k];
+        }
+        b->ninstrs = out;
+
+        if (b->term) resolve_args(b->term);
+    }
+}
+
+/* =========================
+   Analyses
+   ========================= */
+
+/* Reverse postorder of the live blocks reachable from entry.
+   Sets b->rpo (-1 when unreachable); returns the count. */
+int mir_compute_rpo(MirFunc *fn, MirBlock ***order) {
+    int n = fn->nblocks;
+    MirBlock **post = (MirBlock**)malloc(sizeof(MirBlock*) * (n + 1));
+    MirBlock **stack = (MirBlock**)malloc(sizeof(MirBlock*) * (n + 1));
+    int *next_succ = (int*)calloc(fn->next_block_id, sizeof(int));
+    bool *seen = (bool*)calloc(fn->next_block_id, sizeof(bool));
+    int npost = 0, sp = 0;
+
+    for (int i = 0; i < n; i++) fn->blocks[i]->rpo = -1;
+
+    if (n > 0) {
+        stack[sp++] = fn->blocks[0];
+        seen[fn->blocks[0]->id] = true;
+    }
+    while (sp > 0) {
+        MirBlock *b = stack[sp - 1];
+        if (next_succ[b->id] < b->nsucc) {
+            MirBlock *s = b->succ[next_succ[b->id]++];
+            if (!seen[s->id] && !s->dead) {
+                seen[s->id] = true;
+                stack[sp++] = s;
+            }
+        } else {
+            post[npost++] = b;
+            sp--;
+        }
+    }
+
+    MirBlock **rpo = (MirBlock**)malloc(sizeof(MirBlock*) * (npost + 1));
+    for (int i = 0; i < npost; i++) {
+        rpo[i] = post[npost - 1 - i];
+        rpo[i]->rpo = i;
+    }
+
+    free(post);
+    free(stack);
+    free(next_succ);
+    free(seen);
+    *order = rpo;
+    return npost;
+}
+
+static MirBlock *intersect(MirBlock *a, MirBlock *b) {
+    while (a != b) {
+        while (a->rpo > b->rpo) a = a->idom;
+        while (b->rpo > a->rpo) b = b->idom;
+    }
+    return a;
+}
+
+/* Numbers the dominator tree in depth-first order, so that a dominates
+   b exactly when a's [dom_pre, dom_post] interval encloses b's. Walking
+   the idom chain instead costs the depth of the tree per query, which is
+   the length of the program for straight-line code. */
+static void number_dom_tree(MirFunc *fn, MirBlock **rpo, int n) {
+    int ids = fn->next_block_id;
+    int *child_start = (int*)calloc(ids + 1, sizeof(int));
+    int *fill = (int*)malloc(sizeof(int) * (ids + 1));
+    MirBlock **children = (MirBlock**)malloc(sizeof(MirBlock*) * (n + 1));
+    MirBlock **stack = (MirBlock**)malloc(sizeof(MirBlock*) * (n + 1));
+    int *next_child = (int*)calloc(ids, sizeof(int));
+
+    for (int i = 1; i < n; i++) child_start[rpo[i]->idom->id + 1]++;
+    for (int i = 0; i < ids; i++) child_start[i + 1] += child_start[i];
+    memcpy(fill, child_start, sizeof(int) * (ids + 1));
+    for (int i = 1; i < n; i++) children[fill[rpo[i]->idom->id]++] = rpo[i];
+
+    int clock = 0, sp = 0;
+    stack[sp++] = rpo[0];
+    rpo[0]->dom_pre = clock++;
+    while (sp > 0) {
+        MirBlock *b = stack[sp - 1];
+        int k = child_start[b->id] + next_child[b->id];
+        if (k < child_start[b->id + 1]) {
+            next_child[b->id]++;
+            children[k]->dom_pre = clock++;
+            stack[sp++] = children[k];
+        } else {
+            b->dom_post = clock++;
+            sp--;
+        }
+    }
+
+    free(child_start);
+    free(fill);
+    free(children);
+    free(stack);
+    free(next_child);
+}
+
+/* Cooper, Harvey & Kennedy, "A Simple, Fast Dominance Algorithm" */
+void mir_compute_dominators(MirFunc *fn) {
+    MirBlock **rpo;
+    int n = mir_compute_rpo(fn, &rpo);
+
+    for (int i = 0; i < fn->nblocks; i++) fn->blocks[i]->idom = NULL;
+    if (n == 0) { free(rpo); return; }
+    rpo[0]->idom = rpo[0];
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < n; i++) {
+            MirBlock *b = rpo[i];
+            MirBlock *new_idom = NULL;
+            for (int p = 0; p < b->npreds; p++) {
+                MirBlock *pred = b->preds[p];
+                if (pred->rpo < 0 || !pred->idom) continue;
+                new_idom = new_idom ? intersect(pred, new_idom) : pred;
+            }
+            if (new_idom && b->idom != new_idom) {
+                b->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    number_dom_tree(fn, rpo, n);
+    free(rpo);
+}
+
+/* O(1) via the dominator tree intervals */
+bool mir_dominates(MirBlock *a, MirBlock *b) {
+    if (a == b) return true;
+    if (!a->idom || !b->idom) return false;
+    return a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+/* Counts operand uses that need the value itself. Uses that came from a
+   variable read are served by reloading that variable when lowering. */
+void mir_count_uses(MirFunc *fn) {
+    for (int i = 0; i < fn->nvalues; i++) fn->values[i]->uses = 0;
+
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int k = 0; k <= b->ninstrs; k++) {
+            MirValue *v = (k < b->ninstrs) ? b->instrs[k] : b->term;
+            if (!v) continue;
+            for (int a = 0; a < v->nargs; a++) {
+                v->args[a] = mir_resolve(v->args[a]);
+                if (v->arg_var[a] < 0) v->args[a]->uses++;
+            }
+        }
+    }
+}
+
+/* =========================
+   Free
+   ========================= */
+
+void mir_free(MirFunc *fn) {
+    if (!fn) return;
+    for (int i = 0; i < fn->nvalues; i++) {
+        free(fn->values[i]->args);
+        free(fn->values[i]->arg_var);
+        free(fn->values[i]);
+    }
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        free(b->phis);
+        free(b->instrs);
+        free(b->preds);
+        free(b->incomplete);
+        free(b);
+    }
+    free(fn->var_syms);
+    free(fn->var_hash);
+    free(fn->values);
+    free(fn->blocks);
+    free(fn);
+}
@@ -0,0 +1,194 @@
+#ifndef MIR_H
+#define MIR_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "ir.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* =========================
+   Mid-level IR (SSA form)
+   =========================
+   A control flow graph of basic blocks built straight from the AST.
+   Every variable read becomes a reference to the SSA value that reaches
+   it; merges are expressed with phi nodes. Source-level assignments stay
+   visible as MIR_STORE so the lowered program keeps the same variable
+   state as the source, while optimizations only see values. Arrays are
+   not SSA values: element loads and stores name the array variable and
+   stay in block order, so nothing reorders them around each other.
+
+   A procedure (a function not expanded at every call site) is a MirFunc
+   of its own with proc set: its parameters are variables 0 .. nparams-1,
+   defined by MIR_PARAM in the entry block, and it leaves through
+   MIR_RET. */
+
+typedef enum {
+    MIR_CONST,      /* integer constant, not placed in a block */
+    MIR_UNDEF,      /* read of a variable that was never assigned (reads as 0) */
+    MIR_PHI,
+    MIR_BINOP,      /* op is one of IR_ADD .. IR_GE */
+    MIR_STORE,      /* var = args[0] */
+    MIR_NEW_ARRAY,  /* var = zeroed array of value elements */
+    MIR_LOAD_ELEM,  /* var[args[0]] */
+    MIR_STORE_ELEM, /* var[args[0]] = args[1] */
+    MIR_PARAM,      /* incoming value of parameter var */
+    MIR_CALL,       /* procedure value(args...) */
+    MIR_BR,         /* args[0] != 0 ? succ[0] : succ[1] */
+    MIR_JMP,        /* succ[0] */
+    MIR_RET         /* return args[0] */
+} MirKind;
+
+typedef struct MirValue {
+    int id;
+    MirKind kind;
+    IROp op;
+    int value;                  /* MIR_CONST, MIR_NEW_ARRAY length, MIR_CALL procedure */
+    int var;                    /* MIR_PHI / MIR_STORE / arrays: variable index */
+
+    struct MirValue **args;
+    int *arg_var;               /* variable the operand was read from, or -1 */
+    int nargs, args_cap;
+
+    struct MirBlock *block;
+    struct MirValue *replaced;  /* forwarding pointer once folded away */
+    int uses;                   /* operand uses not backed by a variable */
+    bool dead;
+    int line;
+} MirValue;
+
+typedef struct MirBlock {
+    int id;
+    MirValue **phis;
+    int nphis, phis_cap;
+    MirValue **instrs;
+    int ninstrs, instrs_cap;
+    MirValue *term;             /* MIR_BR / MIR_JMP / MIR_RET, NULL at program exit */
+
+    struct MirBlock *succ[2];
+    int nsucc;
+    struct MirBlock **preds;    /* phi operands follow this order */
+    int npreds, preds_cap;
+
+    /* construction */
+    bool sealed;
+    MirValue **incomplete;
+    int nincomplete, incomplete_cap;
+
+    /* analysis scratch */
+    bool dead;
+    int rpo;
+    struct MirBlock *idom;
+    int dom_pre, dom_post;      /* dominator tree interval, for mir_dominates */
+    int line;
+} MirBlock;
+
+typedef struct {
+    long consts_folded;
+    long branches_folded;
+    long blocks_removed;
+    long values_numbered;
+    long dead_removed;
+    long loops_closed;
+    long loop_hoisted;
+    long strength_reduced;
+    long calls_inlined;
+} MirStats;
+
+typedef struct MirFunc {
+    MirBlock **blocks;          /* layout order */
+    int nblocks, blocks_cap;
+    int next_block_id;
+
+    MirValue **values;          /* every value ever created, for freeing */
+    int nvalues, values_cap;
+    MirValue *undef;
+
+    int *var_syms;              /* by variable index: interned name */
+    int nvars, vars_cap;
+    int *var_hash;
+    int var_hash_cap;
+
+    bool proc;
+    int nparams;
+
+    MirStats stats;             /* this compile; folded into the totals by mir_optimize */
+} MirFunc;
+
+/* =========================
+   Functions and inlining (mir_inline.c)
+   =========================
+   Every top-level function of the program, with what the builder needs
+   to decide, per function, whether calls are expanded in place or go
+   through a call frame. */
+
+typedef struct {
+    int sym;
+    ASTNode *def;               /* AST_FUNC */
+    int nparams;
+    bool *reassigned;           /* by parameter: assigned somewhere in the body */
+
+    int size;                   /* AST nodes, with inlined callees expanded */
+    int sites;                  /* calls anywhere in the program */
+    bool recursive;             /* on a cycle of calls */
+    bool inlined;               /* every call is expanded in place */
+    bool single_exit;           /* no return, or one as the last statement */
+} MirProc;
+
+typedef struct {
+    MirProc *procs;
+    int nprocs;
+    int *proc_of;               /* by symbol id: index in procs, -1 if not a function */
+    int nsyms;
+} MirProgram;
+
+MirProgram *mir_program(ASTNode *root);
+void mir_program_free(MirProgram *prog);
+int mir_proc_index(MirProgram *prog, int sym);
+
+/* Construction */
+MirFunc *mir_build(ASTNode *root, MirProgram *prog);
+MirFunc *mir_build_proc(MirProgram *prog, int proc);
+void mir_free(MirFunc *fn);
+
+MirValue *mir_new_value(MirFunc *fn, MirKind kind, int line);
+MirValue *mir_new_phi(MirFunc *fn, MirBlock *b, int var);
+void mir_add_arg(MirValue *v, MirValue *arg, int var);
+void mir_append_instr(MirBlock *b, MirValue *v);
+MirValue *mir_const(MirFunc *fn, int value, int line);
+MirValue *mir_resolve(MirValue *v);
+int mir_var_index(MirFunc *fn, int sym);
+void mir_remove_pred(MirBlock *b, int index);
+void mir_remove_trivial_phis(MirFunc *fn);
+void mir_sweep(MirFunc *fn);
+
+/* Analyses (mir.c) */
+int mir_compute_rpo(MirFunc *fn, MirBlock ***order);
+void mir_compute_dominators(MirFunc *fn);
+bool mir_dominates(MirBlock *a, MirBlock *b);
+void mir_count_uses(MirFunc *fn);
+
+/* Optimizations (mir_opt.c) */
+bool mir_fold_binop(IROp op, int a, int b, int *out);
+bool mir_may_trap(MirValue *v);
+void mir_sccp(MirFunc *fn);
+void mir_gvn(MirFunc *fn);
+void mir_dce(MirFunc *fn);
+void mir_optimize(MirFunc *fn);
+
+/* Loop optimizations (mir_loop.c) */
+bool mir_closed_form(MirFunc *fn);
+void mir_licm(MirFunc *fn);
+void mir_strength_reduce(MirFunc *fn);
+
+/* Totals across all compiles */
+void mir_print_stats();
+void mir_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
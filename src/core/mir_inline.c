@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "mir.h"
+#include "intern.h"
+
+/* =========================
+   Inlining decisions
+   =========================
+   A function is expanded at every call site when its body is tiny (about
+   what the call itself costs) or when its size times the number of call
+   sites stays within a budget, so a small helper called from a hot loop
+   leaves no call behind while a large one called from many places is
+   not duplicated. Size is counted in AST nodes, with the bodies of
+   inlined callees counted in, so callees are decided first. Functions on
+   a cycle of calls always go through a call frame. */
+
+#define INLINE_TINY   16        /* AST nodes */
+#define INLINE_BUDGET 160       /* AST nodes x call sites */
+
+#define GROW(arr, n, cap) do {                                        \
+        if ((n) >= (cap)) {                                           \
+            (cap) = (cap) ? (cap) * 2 : 8;                            \
+            (arr) = realloc((arr), sizeof(*(arr)) * (size_t)(cap));   \
+        }                                                             \
+    } while (0)
+
+/* What one walk over a body found */
+typedef struct {
+    int *callee;            /* by call node, in source order */
+    int ncalls, calls_cap;
+    int nodes;
+    int nreturns;
+} Scan;
+
+int mir_proc_index(MirProgram *prog, int sym) {
+    return (sym >= 0 && sym < prog->nsyms) ? prog->proc_of[sym] : -1;
+}
+
+/* proc is the function whose body this is, NULL for the main program,
+   which skips the definitions in its statement list */
+static void scan_body(MirProgram *prog, ASTNode *body, MirProc *proc, Scan *sc) {
+    ASTNode **work = NULL;
+    int nwork = 0, work_cap = 0;
+    GROW(work, nwork, work_cap);
+    work[nwork++] = body;
+
+    while (nwork > 0) {
+        ASTNode *n = work[--nwork];
+        ASTNode *kids[4] = { n->next, n->third, n->right, n->left };
+        int nkids = 4;
+
+        if (n->type == AST_FUNC) {
+            nkids = 1;
+        } else {
+            sc->nodes++;
+            if (n->type == AST_CALL) {
+                int callee = mir_proc_index(prog, n->sym);
+                GROW(sc->callee, sc->ncalls, sc->calls_cap);
+                sc->callee[sc->ncalls++] = callee;
+                prog->procs[callee].sites++;
+            } else if (n->type == AST_RETURN) {
+                sc->nreturns++;
+            } else if (n->type == AST_ASSIGN && proc && n->left->type == AST_IDENT) {
+                int i = 0;
+                for (ASTNode *p = proc->def->left; p; p = p->next, i++)
+                    if (p->sym == n->left->sym) proc->reassigned[i] = true;
+            }
+        }
+
+        for (int k = 0; k < nkids; k++) {
+            if (!kids[k]) continue;
+            GROW(work, nwork, work_cap);
+            work[nwork++] = kids[k];
+        }
+    }
+    free(work);
+}
+
+/* Tarjan's strongly connected components of the call graph, with an
+   explicit stack so deep call chains cannot overflow ours. Components
+   come out callees first, which is the order order[] receives the
+   functions in; members of a component with more than one function are
+   marked recursive (self calls are left to the caller). */
+static void call_components(MirProgram *prog, Scan *scans, int *order) {
+    int n = prog->nprocs;
+    int *index = (int*)malloc(sizeof(int) * n);
+    int *low = (int*)malloc(sizeof(int) * n);
+    bool *on_stack = (bool*)calloc(n, sizeof(bool));
+    int *stack = (int*)malloc(sizeof(int) * n);
+    int *frame = (int*)malloc(sizeof(int) * n);     // function being walked
+    int *edge = (int*)malloc(sizeof(int) * n);      // its next call
+    int counter = 0, nstack = 0, norder = 0;
+    for (int f = 0; f < n; f++) index[f] = -1;
+
+    for (int root = 0; root < n; root++) {
+        if (index[root] >= 0) continue;
+        int depth = 0;
+        frame[0] = root;
+        edge[0] = 0;
+        index[root] = low[root] = counter++;
+        stack[nstack++] = root;
+        on_stack[root] = true;
+
+        while (depth >= 0) {
+            int v = frame[depth];
+            if (edge[depth] < scans[v].ncalls) {
+                int w = scans[v].callee[edge[depth]++];
+                if (index[w] < 0) {
+                    depth++;
+                    frame[depth] = w;
+                    edge[depth] = 0;
+                    index[w] = low[w] = counter++;
+                    stack[nstack++] = w;
+                    on_stack[w] = true;
+                } else if (on_stack[w] && index[w] < low[v]) {
+                    low[v] = index[w];
+                }
+                continue;
+            }
+
+            if (low[v] == index[v]) {
+                int first = norder, w;
+                do {
+                    w = stack[--nstack];
+                    on_stack[w] = false;
+                    order[norder++] = w;
+                } while (w != v);
+                for (int k = first; norder - first > 1 && k < norder; k++)
+                    prog->procs[order[k]].recursive = true;
+            }
+            if (--depth >= 0 && low[v] < low[frame[depth]]) low[frame[depth]] = low[v];
+        }
+    }
+
+    free(index);
+    free(low);
+    free(on_stack);
+    free(stack);
+    free(frame);
+    free(edge);
+}
+
+MirProgram *mir_program(ASTNode *root) {
+    MirProgram *prog = (MirProgram*)calloc(1, sizeof(MirProgram));
+    prog->nsyms = intern_count();
+    prog->proc_of = (int*)malloc(sizeof(int) * (prog->nsyms ? prog->nsyms : 1));
+    for (int i = 0; i < prog->nsyms; i++) prog->proc_of[i] = -1;
+
+    ASTNode *list = (root && root->type == AST_BLOCK) ? root->left : NULL;
+    for (ASTNode *s = list; s; s = s->next)
+        if (s->type == AST_FUNC) prog->nprocs++;
+    if (prog->nprocs == 0) return prog;
+
+    prog->procs = (MirProc*)calloc(prog->nprocs, sizeof(MirProc));
+    int f = 0;
+    for (ASTNode *s = list; s; s = s->next) {
+        if (s->type != AST_FUNC) continue;
+        MirProc *p = &prog->procs[f];
+        p->sym = s->sym;
+        p->def = s;
+        p->nparams = s->value;
+        p->reassigned = (bool*)calloc(p->nparams ? p->nparams : 1, sizeof(bool));
+        prog->proc_of[s->sym] = f++;
+    }
+
+    Scan main_scan;
+    memset(&main_scan, 0, sizeof(main_scan));
+    scan_body(prog, root, NULL, &main_scan);
+    free(main_scan.callee);
+
+    Scan *scans = (Scan*)calloc(prog->nprocs, sizeof(Scan));
+    for (f = 0; f < prog->nprocs; f++) {
+        MirProc *p = &prog->procs[f];
+        scan_body(prog, p->def->right, p, &scans[f]);
+
+        ASTNode *last = p->def->right->left;
+        while (last && last->next) last = last->next;
+        p->single_exit = scans[f].nreturns == 0 ||
+                         (scans[f].nreturns == 1 && last && last->type == AST_RETURN);
+    }
+
+    int *order = (int*)malloc(sizeof(int) * prog->nprocs);
+    call_components(prog, scans, order);
+    for (f = 0; f < prog->nprocs; f++) {
+        for (int c = 0; c < scans[f].ncalls; c++)
+            if (scans[f].callee[c] == f) prog->procs[f].recursive = true;
+    }
+
+    // callees before callers; outside the cycles the call graph is acyclic
+    for (int k = 0; k < prog->nprocs; k++) {
+        f = order[k];
+        MirProc *p = &prog->procs[f];
+        Scan *sc = &scans[f];
+        if (p->recursive) {
+            p->size = sc->nodes;
+            continue;
+        }
+        int size = sc->nodes;
+        for (int c = 0; c < sc->ncalls; c++) {
+            MirProc *g = &prog->procs[sc->callee[c]];
+            if (g->inlined) size += g->size - 1;
+        }
+        p->size = size;
+        p->inlined = size <= INLINE_TINY || (long)size * p->sites <= INLINE_BUDGET;
+    }
+
+    for (f = 0; f < prog->nprocs; f++) free(scans[f].callee);
+    free(scans);
+    free(order);
+    return prog;
+}
+
+void mir_program_free(MirProgram *prog) {
+    if (!prog) return;
+    for (int f = 0; f < prog->nprocs; f++) free(prog->procs[f].reassigned);
+    free(prog->procs);
+    free(prog->proc_of);
+    free(prog);
+}
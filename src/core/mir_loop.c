@@ -0,0 +1,737 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "mir.h"
+#include "intern.h"
+
+/* =========================
+   Loop discovery
+   =========================
+   Natural loops from back edges (an edge into a block that dominates its
+   source). Loops are processed innermost first, so code hoisted out of an
+   inner loop lands in a preheader that the outer loop can hoist again. */
+
+typedef struct {
+    MirBlock *header;
+    MirBlock *preheader;    /* only predecessor from outside, falls into header */
+    MirBlock *latch;        /* NULL when there are several back edges */
+    MirBlock **blocks;      /* reverse postorder */
+    int nblocks;
+} Loop;
+
+typedef struct {
+    MirFunc *fn;
+    Loop *loops;
+    int nloops;
+    int *mark;              /* by block id: tag of the loop being processed */
+    int tag;
+} LoopForest;
+
+#define GROW(arr, n, cap) do {                                        \
+        if ((n) >= (cap)) {                                           \
+            (cap) = (cap) ? (cap) * 2 : 8;                            \
+            (arr) = realloc((arr), sizeof(*(arr)) * (size_t)(cap));   \
+        }                                                             \
+    } while (0)
+
+static int by_rpo(const void *a, const void *b) {
+    return (*(MirBlock* const*)a)->rpo - (*(MirBlock* const*)b)->rpo;
+}
+
+static int by_size(const void *a, const void *b) {
+    return ((const Loop*)a)->nblocks - ((const Loop*)b)->nblocks;
+}
+
+static bool in_loop(LoopForest *lf, MirBlock *b) {
+    return b && lf->mark[b->id] == lf->tag;
+}
+
+static void enter_loop(LoopForest *lf, Loop *l) {
+    lf->tag++;
+    for (int i = 0; i < l->nblocks; i++) lf->mark[l->blocks[i]->id] = lf->tag;
+}
+
+/* Blocks that reach a back edge without passing through the header */
+static void collect_body(LoopForest *lf, Loop *l) {
+    int cap = 0;
+    MirBlock **work = NULL;
+    int nwork = 0, work_cap = 0;
+
+    lf->tag++;
+    lf->mark[l->header->id] = lf->tag;
+    GROW(l->blocks, l->nblocks, cap);
+    l->blocks[l->nblocks++] = l->header;
+
+    for (int p = 0; p < l->header->npreds; p++) {
+        MirBlock *pred = l->header->preds[p];
+        if (pred->rpo >= 0 && mir_dominates(l->header, pred)) {
+            GROW(work, nwork, work_cap);
+            work[nwork++] = pred;
+        }
+    }
+    while (nwork > 0) {
+        MirBlock *b = work[--nwork];
+        if (lf->mark[b->id] == lf->tag) continue;
+        lf->mark[b->id] = lf->tag;
+        GROW(l->blocks, l->nblocks, cap);
+        l->blocks[l->nblocks++] = b;
+        for (int p = 0; p < b->npreds; p++) {
+            if (b->preds[p]->rpo < 0) continue;
+            GROW(work, nwork, work_cap);
+            work[nwork++] = b->preds[p];
+        }
+    }
+    free(work);
+    qsort(l->blocks, l->nblocks, sizeof(MirBlock*), by_rpo);
+
+    MirBlock *outside = NULL;
+    int nlatch = 0, noutside = 0;
+    for (int p = 0; p < l->header->npreds; p++) {
+        MirBlock *pred = l->header->preds[p];
+        if (lf->mark[pred->id] == lf->tag) {
+            l->latch = pred;
+            nlatch++;
+        } else {
+            outside = pred;
+            noutside++;
+        }
+    }
+    if (nlatch != 1) l->latch = NULL;
+    if (noutside == 1 && outside->nsucc == 1) l->preheader = outside;
+}
+
+static void find_loops(MirFunc *fn, LoopForest *lf) {
+    memset(lf, 0, sizeof(*lf));
+    lf->fn = fn;
+    lf->mark = (int*)calloc(fn->next_block_id, sizeof(int));
+
+    mir_compute_dominators(fn);
+
+    int cap = 0;
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *h = fn->blocks[i];
+        if (h->dead || h->rpo < 0) continue;
+
+        bool is_header = false;
+        for (int p = 0; p < h->npreds && !is_header; p++) {
+            MirBlock *pred = h->preds[p];
+            is_header = pred->rpo >= 0 && mir_dominates(h, pred);
+        }
+        if (!is_header) continue;
+
+        GROW(lf->loops, lf->nloops, cap);
+        Loop *l = &lf->loops[lf->nloops++];
+        memset(l, 0, sizeof(*l));
+        l->header = h;
+        collect_body(lf, l);
+    }
+    qsort(lf->loops, lf->nloops, sizeof(Loop), by_size);
+}
+
+static void free_loops(LoopForest *lf) {
+    for (int i = 0; i < lf->nloops; i++) free(lf->loops[i].blocks);
+    free(lf->loops);
+    free(lf->mark);
+}
+
+static bool const_of(MirValue *v, int *out) {
+    v = mir_resolve(v);
+    if (v->kind == MIR_CONST) { *out = v->value; return true; }
+    if (v->kind == MIR_UNDEF) { *out = 0; return true; }
+    return false;
+}
+
+/* =========================
+   Closed-form loop evaluation
+   =========================
+   A single-block loop whose header phis all advance by a polynomial
+   recurrence is replaced by its last iteration: the preheader computes
+   the trip count and each variable's value at the start of the final
+   iteration, and the body then runs exactly once. Whatever the body
+   stores (including values that are not loop-carried) therefore matches
+   the original run, and every formula is evaluated with the VM's 32-bit
+   wrap-around.
+
+   A value in the loop is described as a + b*t + c*t*(t-1)/2, where t is
+   the iteration number. Coefficients are either constants or values
+   available in the preheader. */
+
+typedef struct {
+    MirValue *v;
+    int src;                /* variable to reload it from, or -1 */
+} Term;
+
+typedef struct {
+    Term a, b, c;
+    int self;               /* multiple of the phi being solved */
+} Form;
+
+typedef struct {
+    LoopForest *lf;
+    Loop *l;
+    const bool *stored;     /* by var: assigned inside the loop */
+    Form *phi_form;         /* by phi index in the header */
+    bool *solved;
+    MirValue *self;         /* phi whose recurrence is being solved */
+    int budget;             /* bounds work on shared subexpressions */
+    int line;
+} Closed;
+
+static Term term_const(Closed *cl, int k) {
+    Term t = { mir_const(cl->lf->fn, k, cl->line), -1 };
+    return t;
+}
+
+static bool term_is(Term t, int *k) {
+    return const_of(t.v, k);
+}
+
+static bool term_zero(Term t) {
+    int k;
+    return term_is(t, &k) && k == 0;
+}
+
+/* Emits op(x, y) into the preheader, folding constants on the way */
+static Term term_op(Closed *cl, IROp op, Term x, Term y) {
+    int kx, ky, out;
+    bool cx = term_is(x, &kx), cy = term_is(y, &ky);
+
+    if (cx && cy && mir_fold_binop(op, kx, ky, &out)) return term_const(cl, out);
+    if ((op == IR_ADD || op == IR_SUB) && cy && ky == 0) return x;
+    if (op == IR_ADD && cx && kx == 0) return y;
+    if (op == IR_MUL && ((cx && kx == 0) || (cy && ky == 0))) return term_const(cl, 0);
+    if (op == IR_MUL && cx && kx == 1) return y;
+    if (op == IR_MUL && cy && ky == 1) return x;
+
+    MirValue *v = mir_new_value(cl->lf->fn, MIR_BINOP, cl->line);
+    v->op = op;
+    mir_add_arg(v, x.v, x.src);
+    mir_add_arg(v, y.v, y.src);
+    mir_append_instr(cl->l->preheader, v);
+    Term t = { v, -1 };
+    return t;
+}
+
+static bool form_invariant(Form f) {
+    return f.self == 0 && term_zero(f.b) && term_zero(f.c);
+}
+
+static bool form_of(Closed *cl, MirValue *v, int src, Form *f) {
+    if (--cl->budget < 0) return false;
+    v = mir_resolve(v);
+    memset(f, 0, sizeof(*f));
+    f->b = f->c = term_const(cl, 0);
+
+    if (v->kind == MIR_CONST || v->kind == MIR_UNDEF || !in_loop(cl->lf, v->block)) {
+        if (src >= 0 && v->kind != MIR_CONST && v->kind != MIR_UNDEF && cl->stored[src])
+            return false;
+        f->a.v = v;
+        f->a.src = (v->kind == MIR_CONST || v->kind == MIR_UNDEF) ? -1 : src;
+        return true;
+    }
+
+    if (v->kind == MIR_PHI) {
+        if (v == cl->self) {
+            f->a = term_const(cl, 0);
+            f->self = 1;
+            return true;
+        }
+        for (int p = 0; p < cl->l->header->nphis; p++) {
+            if (cl->l->header->phis[p] != v) continue;
+            if (!cl->solved[p]) return false;
+            *f = cl->phi_form[p];
+            return true;
+        }
+        return false;
+    }
+
+    if (v->kind != MIR_BINOP) return false;
+
+    Form x, y;
+    if (!form_of(cl, v->args[0], v->arg_var[0], &x)) return false;
+    if (!form_of(cl, v->args[1], v->arg_var[1], &y)) return false;
+
+    if (form_invariant(x) && form_invariant(y)) {
+        f->a = term_op(cl, v->op, x.a, y.a);
+        return true;
+    }
+
+    switch (v->op) {
+        case IR_ADD:
+        case IR_SUB:
+            f->a = term_op(cl, v->op, x.a, y.a);
+            f->b = term_op(cl, v->op, x.b, y.b);
+            f->c = term_op(cl, v->op, x.c, y.c);
+            f->self = (v->op == IR_ADD) ? x.self + y.self : x.self - y.self;
+            return true;
+        case IR_MUL: {
+            if (!form_invariant(y)) {
+                Form tmp = x; x = y; y = tmp;
+            }
+            if (!form_invariant(y)) return false;
+            int k;
+            if (x.self != 0 && !term_is(y.a, &k)) return false;
+            f->a = term_op(cl, IR_MUL, x.a, y.a);
+            f->b = term_op(cl, IR_MUL, x.b, y.a);
+            f->c = term_op(cl, IR_MUL, x.c, y.a);
+            f->self = (x.self != 0) ? (int)((unsigned)x.self * (unsigned)k) : 0;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/* x_next = x + d(t) with d affine  =>  x(t) = x0 + d.a*t + d.b*t(t-1)/2 */
+static bool solve_phi(Closed *cl, int index, int pre) {
+    MirValue *phi = cl->l->header->phis[index];
+    int latch = 1 - pre;
+    Form d;
+
+    cl->self = phi;
+    cl->budget = 256;
+    bool ok = form_of(cl, phi->args[latch], phi->arg_var[latch], &d);
+    cl->self = NULL;
+    if (!ok || d.self != 1 || !term_zero(d.c)) return false;
+
+    Form *f = &cl->phi_form[index];
+    f->a.v = phi->args[pre];
+    f->a.src = phi->var;
+    f->b = d.a;
+    f->c = d.b;
+    f->self = 0;
+    cl->solved[index] = true;
+    return true;
+}
+
+/* Index of the last iteration, for a loop that keeps going while
+   lhs(t) op rhs holds and stops at the first t where it does not.
+   Only recurrences that provably stop before wrapping are accepted.
+   *small is set when the index is known to fit in [0, INT_MAX]. */
+static bool last_iteration(Closed *cl, IROp op, Form lhs, Form rhs, Term *out,
+                           long long *exact, bool *small) {
+    int step;
+    if (!form_invariant(rhs) || !term_zero(lhs.c) || lhs.self != 0) return false;
+    if (!term_is(lhs.b, &step) || step == 0) return false;
+
+    int a, n;
+    *exact = -1;
+    *small = false;
+    if (term_is(lhs.a, &a) && term_is(rhs.a, &n)) {
+        long long A = a, N = n, b = step, t;
+        int first;
+        mir_fold_binop(op, a, n, &first);
+        if (!first) {
+            t = 0;
+        } else if (op == IR_NE && (b == 1 || b == -1)) {
+            t = (b == 1) ? (uint32_t)n - (uint32_t)a : (uint32_t)a - (uint32_t)n;
+        } else if (op == IR_LT && b > 0) {
+            t = (N - A + b - 1) / b;
+        } else if (op == IR_LE && b > 0) {
+            t = (N - A) / b + 1;
+        } else if (op == IR_GT && b < 0) {
+            t = (A - N + (-b) - 1) / (-b);
+        } else if (op == IR_GE && b < 0) {
+            t = (A - N) / (-b) + 1;
+        } else {
+            return false;
+        }
+        if (op != IR_NE) {
+            long long last = A + b * t;
+            if (last > INT32_MAX || last < INT32_MIN) return false;
+        }
+        *exact = t;
+        *small = t <= INT32_MAX;
+        *out = term_const(cl, (int)(uint32_t)t);
+        return true;
+    }
+
+    // runtime bounds: unit steps only, and never an inclusive bound that
+    // could sit at INT_MAX / INT_MIN and never be passed
+    if (op == IR_NE && step == 1) {
+        *out = term_op(cl, IR_SUB, rhs.a, lhs.a);
+    } else if (op == IR_NE && step == -1) {
+        *out = term_op(cl, IR_SUB, lhs.a, rhs.a);
+    } else if (op == IR_LT && step == 1) {
+        Term dist = term_op(cl, IR_SUB, rhs.a, lhs.a);
+        *out = term_op(cl, IR_MUL, dist, term_op(cl, IR_LT, lhs.a, rhs.a));
+        *small = term_is(lhs.a, &a) && a >= 0;      // at most INT_MAX - a
+    } else if (op == IR_GT && step == -1) {
+        Term dist = term_op(cl, IR_SUB, lhs.a, rhs.a);
+        *out = term_op(cl, IR_MUL, dist, term_op(cl, IR_LT, rhs.a, lhs.a));
+        *small = term_is(lhs.a, &a) && a < 0;       // at most a - INT_MIN
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static IROp flip_cmp(IROp op) {
+    switch (op) {
+        case IR_LT: return IR_GT;
+        case IR_GT: return IR_LT;
+        case IR_LE: return IR_GE;
+        case IR_GE: return IR_LE;
+        default:    return op;
+    }
+}
+
+static bool close_loop(LoopForest *lf, Loop *l, bool *stored) {
+    MirFunc *fn = lf->fn;
+    MirBlock *b = l->header;
+    MirBlock *pre = l->preheader;
+    if (l->nblocks != 1 || !pre || l->latch != b || b->npreds != 2) return false;
+
+    MirValue *br = b->term;
+    if (!br || br->kind != MIR_BR || b->succ[0] != b || b->succ[1] == b) return false;
+
+    enter_loop(lf, l);
+    memset(stored, 0, sizeof(bool) * fn->nvars);
+    for (int k = 0; k < b->ninstrs; k++) {
+        MirValue *v = b->instrs[k];
+        if (v->kind == MIR_STORE) stored[v->var] = true;
+        else if (v->kind != MIR_BINOP || mir_may_trap(v)) return false;
+    }
+
+    Closed cl;
+    memset(&cl, 0, sizeof(cl));
+    cl.lf = lf;
+    cl.l = l;
+    cl.stored = stored;
+    cl.line = br->line;
+    cl.phi_form = (Form*)calloc(b->nphis + 1, sizeof(Form));
+    cl.solved = (bool*)calloc(b->nphis + 1, sizeof(bool));
+
+    int pre_index = (b->preds[0] == pre) ? 0 : 1;
+    int first_new = pre->ninstrs;
+    bool ok = true;
+
+    // recurrences may feed each other (s += i); solve until nothing moves
+    int nsolved = 0;
+    for (bool progress = true; progress && nsolved < b->nphis; ) {
+        progress = false;
+        for (int p = 0; p < b->nphis; p++) {
+            if (cl.solved[p] || !solve_phi(&cl, p, pre_index)) continue;
+            nsolved++;
+            progress = true;
+        }
+    }
+    if (nsolved < b->nphis) ok = false;
+
+    Form lhs, rhs;
+    Term last;
+    long long exact = -1;
+    bool small = false;
+    MirValue *cond = mir_resolve(br->args[0]);
+    if (ok) {
+        cl.budget = 256;
+        ok = cond->kind == MIR_BINOP && cond->block == b &&
+             form_of(&cl, cond->args[0], cond->arg_var[0], &lhs) &&
+             form_of(&cl, cond->args[1], cond->arg_var[1], &rhs);
+    }
+    if (ok) {
+        IROp op = cond->op;
+        if (form_invariant(lhs)) {
+            Form tmp = lhs; lhs = rhs; rhs = tmp;
+            op = flip_cmp(op);
+        }
+        ok = op >= IR_EQ && op <= IR_GE && op != IR_EQ &&
+             last_iteration(&cl, op, lhs, rhs, &last, &exact, &small);
+    }
+
+    // t(t-1)/2 needs the true t, not t mod 2^32
+    for (int p = 0; ok && p < b->nphis; p++)
+        if (!term_zero(cl.phi_form[p].c) && !small) ok = false;
+
+    if (!ok) {
+        for (int k = first_new; k < pre->ninstrs; k++) pre->instrs[k]->dead = true;
+        pre->ninstrs = first_new;
+        free(cl.phi_form);
+        free(cl.solved);
+        return false;
+    }
+
+    Term tri = term_const(&cl, 0);
+    if (exact >= 0) {
+        unsigned long long t = (unsigned long long)exact;
+        tri = term_const(&cl, (int)(uint32_t)(t * (t ? t - 1 : 0) / 2));
+    } else if (small) {
+        // h = t/2;  t(t-1)/2 = h * (2t - 1 - 2h) for either parity of t
+        Term h = term_op(&cl, IR_DIV, last, term_const(&cl, 2));
+        Term twice = term_op(&cl, IR_ADD, last, last);
+        Term odd = term_op(&cl, IR_SUB, twice, term_const(&cl, 1));
+        tri = term_op(&cl, IR_MUL, h, term_op(&cl, IR_SUB, odd, term_op(&cl, IR_ADD, h, h)));
+    }
+
+    // variables take their values for the final iteration (all computed
+    // before any store, since the formulas reload the initial values)...
+    MirValue **final = (MirValue**)malloc(sizeof(MirValue*) * (b->nphis + 1));
+    int *final_src = (int*)malloc(sizeof(int) * (b->nphis + 1));
+    for (int p = 0; p < b->nphis; p++) {
+        Form *f = &cl.phi_form[p];
+        Term v = term_op(&cl, IR_ADD, f->a, term_op(&cl, IR_MUL, f->b, last));
+        v = term_op(&cl, IR_ADD, v, term_op(&cl, IR_MUL, f->c, tri));
+        final[p] = v.v;
+        final_src[p] = v.src;
+    }
+    for (int p = 0; p < b->nphis; p++) {
+        MirValue *phi = b->phis[p];
+        MirValue *st = mir_new_value(fn, MIR_STORE, cl.line);
+        st->var = phi->var;
+        mir_add_arg(st, final[p], final_src[p]);
+        mir_append_instr(pre, st);
+        phi->replaced = final[p];
+        phi->dead = true;
+    }
+    free(final);
+    free(final_src);
+
+    // ...and the body runs once
+    int self_index = (b->preds[0] == b) ? 0 : 1;
+    mir_remove_pred(b, self_index);
+    br->kind = MIR_JMP;
+    br->nargs = 0;
+    b->succ[0] = b->succ[1];
+    b->nsucc = 1;
+
+    free(cl.phi_form);
+    free(cl.solved);
+    fn->stats.loops_closed++;
+    return true;
+}
+
+bool mir_closed_form(MirFunc *fn) {
+    if (!fn || fn->nblocks == 0) return false;
+
+    LoopForest lf;
+    find_loops(fn, &lf);
+    bool *stored = (bool*)malloc(sizeof(bool) * (fn->nvars + 1));
+    bool changed = false;
+
+    for (int i = 0; i < lf.nloops; i++) {
+        if (close_loop(&lf, &lf.loops[i], stored)) changed = true;
+    }
+
+    free(stored);
+    free_loops(&lf);
+    if (changed) mir_sweep(fn);
+    return changed;
+}
+
+/* =========================
+   Loop-invariant code motion
+   =========================
+   An expression is invariant when every operand is a constant or comes
+   from outside the loop. Lowering reloads an operand from the variable it
+   was read from, so that variable must also hold the same value in the
+   preheader: it may not be assigned anywhere in the loop. Divisions that
+   might trap stay where they are. */
+
+static bool operand_invariant(LoopForest *lf, MirValue *v, int a, const bool *stored) {
+    MirValue *arg = mir_resolve(v->args[a]);
+    if (arg->kind == MIR_CONST || arg->kind == MIR_UNDEF) return true;
+    if (in_loop(lf, arg->block)) return false;
+    int src = v->arg_var[a];
+    return src < 0 || !stored[src];
+}
+
+static bool is_invariant(LoopForest *lf, MirValue *v, const bool *stored) {
+    if (v->kind != MIR_BINOP || mir_may_trap(v)) return false;
+    for (int a = 0; a < v->nargs; a++)
+        if (!operand_invariant(lf, v, a, stored)) return false;
+    return true;
+}
+
+static void hoist_loop(LoopForest *lf, Loop *l, bool *stored) {
+    MirFunc *fn = lf->fn;
+    enter_loop(lf, l);
+
+    memset(stored, 0, sizeof(bool) * fn->nvars);
+    for (int i = 0; i < l->nblocks; i++) {
+        MirBlock *b = l->blocks[i];
+        for (int k = 0; k < b->ninstrs; k++)
+            if (b->instrs[k]->kind == MIR_STORE) stored[b->instrs[k]->var] = true;
+    }
+
+    // reverse postorder sees operands before their users
+    for (int i = 0; i < l->nblocks; i++) {
+        MirBlock *b = l->blocks[i];
+        int out = 0;
+        for (int k = 0; k < b->ninstrs; k++) {
+            MirValue *v = b->instrs[k];
+            if (!v->dead && is_invariant(lf, v, stored)) {
+                mir_append_instr(l->preheader, v);
+                fn->stats.loop_hoisted++;
+            } else {
+                b->instrs[out++] = v;
+            }
+        }
+        b->ninstrs = out;
+    }
+}
+
+void mir_licm(MirFunc *fn) {
+    if (!fn || fn->nblocks == 0) return;
+
+    LoopForest lf;
+    find_loops(fn, &lf);
+    bool *stored = (bool*)malloc(sizeof(bool) * (fn->nvars + 1));
+
+    for (int i = 0; i < lf.nloops; i++) {
+        if (lf.loops[i].preheader) hoist_loop(&lf, &lf.loops[i], stored);
+    }
+
+    free(stored);
+    free_loops(&lf);
+}
+
+/* =========================
+   Strength reduction
+   =========================
+   For a basic induction variable i = phi(i0, i + c), the product i * k
+   with constant k is carried in a fresh variable instead:
+
+       pre:    $s = i0 * k
+       loop:   ... uses of i * k read $s ...
+       latch:  $s = $s + c * k
+
+   The identity holds under 32-bit wrap-around as well. The latch update is
+   a single INC_VAR after peephole, so this only fires when c * k is a
+   constant. Uses in the latch terminator would observe the updated $s and
+   keep the multiplication. */
+
+/* i_next = i + c or i - c: returns the signed step through *step */
+static bool induction_step(MirValue *phi, MirValue *next, int *step) {
+    next = mir_resolve(next);
+    if (next->kind != MIR_BINOP) return false;
+    MirValue *a = mir_resolve(next->args[0]);
+    MirValue *b = mir_resolve(next->args[1]);
+    int c;
+
+    if (next->op == IR_ADD) {
+        if (a == phi && const_of(b, &c)) { *step = c; return true; }
+        if (b == phi && const_of(a, &c)) { *step = c; return true; }
+    } else if (next->op == IR_SUB) {
+        if (a == phi && const_of(b, &c)) { *step = (int)(0u - (unsigned)c); return true; }
+    }
+    return false;
+}
+
+/* w = phi * k: returns k */
+static bool scaled_iv(MirValue *w, MirValue *phi, int *k) {
+    if (w->kind != MIR_BINOP || w->op != IR_MUL) return false;
+    MirValue *a = mir_resolve(w->args[0]);
+    MirValue *b = mir_resolve(w->args[1]);
+    if (a == phi && const_of(b, k)) return true;
+    if (b == phi && const_of(a, k)) return true;
+    return false;
+}
+
+/* Points every in-loop use of w (outside the latch terminator) at j */
+static int rewrite_uses(Loop *l, MirValue *w, MirValue *j, int var) {
+    int n = 0;
+    for (int i = 0; i < l->nblocks; i++) {
+        MirBlock *b = l->blocks[i];
+        for (int k = 0; k <= b->ninstrs; k++) {
+            MirValue *v = (k < b->ninstrs) ? b->instrs[k] : b->term;
+            if (!v || v->dead || (v == b->term && b == l->latch)) continue;
+            for (int a = 0; a < v->nargs; a++) {
+                if (v->arg_var[a] >= 0 || mir_resolve(v->args[a]) != w) continue;
+                if (j) {
+                    v->args[a] = j;
+                    v->arg_var[a] = var;
+                }
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static void reduce(LoopForest *lf, Loop *l, MirValue *phi, MirValue *w, int k, int step) {
+    MirFunc *fn = lf->fn;
+    if (rewrite_uses(l, w, NULL, -1) == 0) return;
+
+    char name[32];
+    snprintf(name, sizeof(name), "$s%d", w->id);
+    int var = mir_var_index(fn, intern(name));
+
+    int p_index = (l->header->preds[0] == l->preheader) ? 0 : 1;
+    MirValue *i0 = mir_resolve(phi->args[p_index]);
+
+    // $s = i0 * k in the preheader
+    MirValue *init;
+    int c0, folded;
+    if (const_of(i0, &c0)) {
+        mir_fold_binop(IR_MUL, c0, k, &folded);
+        init = mir_const(fn, folded, w->line);
+    } else {
+        init = mir_new_value(fn, MIR_BINOP, w->line);
+        init->op = IR_MUL;
+        mir_add_arg(init, i0, phi->var);
+        mir_add_arg(init, mir_const(fn, k, w->line), -1);
+        mir_append_instr(l->preheader, init);
+    }
+    MirValue *st = mir_new_value(fn, MIR_STORE, w->line);
+    st->var = var;
+    mir_add_arg(st, init, -1);
+    mir_append_instr(l->preheader, st);
+
+    // j = phi($s from preheader, $s from latch)
+    MirValue *j = mir_new_phi(fn, l->header, var);
+
+    int inc;
+    mir_fold_binop(IR_MUL, step, k, &inc);
+    MirValue *next = mir_new_value(fn, MIR_BINOP, w->line);
+    next->op = IR_ADD;
+    mir_add_arg(next, j, var);
+    mir_add_arg(next, mir_const(fn, inc, w->line), -1);
+    mir_append_instr(l->latch, next);
+
+    st = mir_new_value(fn, MIR_STORE, w->line);
+    st->var = var;
+    mir_add_arg(st, next, -1);
+    mir_append_instr(l->latch, st);
+
+    for (int p = 0; p < l->header->npreds; p++)
+        mir_add_arg(j, p == p_index ? init : next, var);
+
+    rewrite_uses(l, w, j, var);
+    fn->stats.strength_reduced++;
+}
+
+static void reduce_loop(LoopForest *lf, Loop *l) {
+    MirBlock *h = l->header;
+    if (!l->preheader || !l->latch || h->npreds != 2) return;
+    enter_loop(lf, l);
+
+    int nphis = h->nphis;   // phis added below are not induction variables
+    for (int p = 0; p < nphis; p++) {
+        MirValue *phi = h->phis[p];
+        int latch_index = (h->preds[0] == l->latch) ? 0 : 1;
+        int step;
+        if (phi->dead || !induction_step(phi, phi->args[latch_index], &step)) continue;
+
+        for (int i = 0; i < l->nblocks; i++) {
+            MirBlock *b = l->blocks[i];
+            int ninstrs = b->ninstrs;
+            for (int k = 0; k < ninstrs; k++) {
+                MirValue *w = b->instrs[k];
+                int scale;
+                if (!w->dead && scaled_iv(w, phi, &scale))
+                    reduce(lf, l, phi, w, scale, step);
+            }
+        }
+    }
+}
+
+void mir_strength_reduce(MirFunc *fn) {
+    if (!fn || fn->nblocks == 0) return;
+
+    LoopForest lf;
+    find_loops(fn, &lf);
+    for (int i = 0; i < lf.nloops; i++) reduce_loop(&lf, &lf.loops[i]);
+    free_loops(&lf);
+}
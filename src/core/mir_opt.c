@@ -0,0 +1,650 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include "mir.h"
+#include "intern.h"
+
+static MirStats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Evaluates op with the VM's 32-bit wrap-around semantics.
+   Returns false when the operation would trap at runtime. */
+bool mir_fold_binop(IROp op, int a, int b, int *out) {
+    switch (op) {
+        case IR_ADD: *out = (int)((unsigned)a + (unsigned)b); return true;
+        case IR_SUB: *out = (int)((unsigned)a - (unsigned)b); return true;
+        case IR_MUL: *out = (int)((unsigned)a * (unsigned)b); return true;
+        case IR_DIV:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            *out = a / b;
+            return true;
+        case IR_EQ: *out = a == b; return true;
+        case IR_NE: *out = a != b; return true;
+        case IR_LT: *out = a <  b; return true;
+        case IR_GT: *out = a >  b; return true;
+        case IR_LE: *out = a <= b; return true;
+        case IR_GE: *out = a >= b; return true;
+        default: return false;
+    }
+}
+
+static bool const_of(MirValue *v, int *out) {
+    v = mir_resolve(v);
+    if (v->kind == MIR_CONST) { *out = v->value; return true; }
+    if (v->kind == MIR_UNDEF) { *out = 0; return true; }
+    return false;
+}
+
+static int succ_index(MirBlock *from, MirBlock *to) {
+    for (int k = 0; k < from->nsucc; k++)
+        if (from->succ[k] == to) return k;
+    return -1;
+}
+
+static int pred_index(MirBlock *b, MirBlock *pred) {
+    for (int p = 0; p < b->npreds; p++)
+        if (b->preds[p] == pred) return p;
+    return -1;
+}
+
+static void remove_edge(MirBlock *from, MirBlock *to) {
+    int p = pred_index(to, from);
+    if (p >= 0) mir_remove_pred(to, p);
+}
+
+/* =========================
+   Sparse conditional constant propagation
+   =========================
+   Wegman & Zadeck. Values start optimistic (TOP) and only move down the
+   lattice; blocks are only evaluated once an executable edge reaches them,
+   so code behind constant branches never pollutes the result. */
+
+typedef enum { LAT_TOP, LAT_CONST, LAT_BOTTOM } LatKind;
+
+typedef struct {
+    LatKind kind;
+    int value;
+} Lat;
+
+typedef struct {
+    MirFunc *fn;
+    Lat *lat;                   /* by value id */
+    bool *block_exec;           /* by block id */
+    bool *edge_exec;            /* by block id * 2 + successor slot */
+
+    int *user_start;            /* def-use chains, CSR by value id */
+    MirValue **users;
+
+    MirValue **ssa_work;
+    int nssa, ssa_cap;
+    MirBlock **cfg_work;
+    int ncfg, cfg_cap;
+} Sccp;
+
+#define PUSH(arr, n, cap, x) do {                                      \
+        if ((n) >= (cap)) {                                            \
+            (cap) = (cap) ? (cap) * 2 : 64;                            \
+            (arr) = realloc((arr), sizeof(*(arr)) * (size_t)(cap));    \
+        }                                                              \
+        (arr)[(n)++] = (x);                                            \
+    } while (0)
+
+static void for_each_value(MirBlock *b, void (*fn)(void *ctx, MirValue *v), void *ctx) {
+    for (int p = 0; p < b->nphis; p++) fn(ctx, b->phis[p]);
+    for (int k = 0; k < b->ninstrs; k++) fn(ctx, b->instrs[k]);
+    if (b->term) fn(ctx, b->term);
+}
+
+static void count_users(void *ctx, MirValue *v) {
+    Sccp *s = (Sccp*)ctx;
+    for (int a = 0; a < v->nargs; a++)
+        s->user_start[mir_resolve(v->args[a])->id + 1]++;
+}
+
+static void fill_users(void *ctx, MirValue *v) {
+    Sccp *s = (Sccp*)ctx;
+    for (int a = 0; a < v->nargs; a++) {
+        int id = mir_resolve(v->args[a])->id;
+        s->users[s->user_start[id]++] = v;
+    }
+}
+
+static void build_users(Sccp *s) {
+    MirFunc *fn = s->fn;
+    s->user_start = (int*)calloc(fn->nvalues + 1, sizeof(int));
+
+    for (int i = 0; i < fn->nblocks; i++)
+        if (!fn->blocks[i]->dead) for_each_value(fn->blocks[i], count_users, s);
+    for (int i = 0; i < fn->nvalues; i++)
+        s->user_start[i + 1] += s->user_start[i];
+
+    s->users = (MirValue**)malloc(sizeof(MirValue*) * (s->user_start[fn->nvalues] + 1));
+    for (int i = 0; i < fn->nblocks; i++)
+        if (!fn->blocks[i]->dead) for_each_value(fn->blocks[i], fill_users, s);
+
+    // fill_users advanced each start to the next slot; shift back
+    for (int i = fn->nvalues; i > 0; i--) s->user_start[i] = s->user_start[i - 1];
+    s->user_start[0] = 0;
+}
+
+static Lat lat_of(Sccp *s, MirValue *v) {
+    Lat l = { LAT_BOTTOM, 0 };
+    int c;
+    v = mir_resolve(v);
+    if (const_of(v, &c)) {
+        l.kind = LAT_CONST;
+        l.value = c;
+        return l;
+    }
+    return s->lat[v->id];
+}
+
+static void set_lat(Sccp *s, MirValue *v, Lat l) {
+    Lat *cur = &s->lat[v->id];
+    if (cur->kind == l.kind && (l.kind != LAT_CONST || cur->value == l.value)) return;
+    *cur = l;
+    PUSH(s->ssa_work, s->nssa, s->ssa_cap, v);
+}
+
+static void sccp_visit(Sccp *s, MirValue *v);
+
+static void mark_edge(Sccp *s, MirBlock *b, int k) {
+    if (s->edge_exec[b->id * 2 + k]) return;
+    s->edge_exec[b->id * 2 + k] = true;
+
+    MirBlock *t = b->succ[k];
+    if (!s->block_exec[t->id]) {
+        s->block_exec[t->id] = true;
+        PUSH(s->cfg_work, s->ncfg, s->cfg_cap, t);
+    } else {
+        // a new incoming edge can only change the phis
+        for (int p = 0; p < t->nphis; p++) sccp_visit(s, t->phis[p]);
+    }
+}
+
+static void sccp_visit(Sccp *s, MirValue *v) {
+    MirBlock *b = v->block;
+    Lat r = { LAT_TOP, 0 };
+
+    switch (v->kind) {
+        case MIR_PHI:
+            for (int i = 0; i < v->nargs; i++) {
+                MirBlock *pred = b->preds[i];
+                int k = succ_index(pred, b);
+                if (k < 0 || !s->edge_exec[pred->id * 2 + k]) continue;
+
+                Lat a = lat_of(s, v->args[i]);
+                if (a.kind == LAT_TOP) continue;
+                if (a.kind == LAT_BOTTOM ||
+                    (r.kind == LAT_CONST && r.value != a.value)) {
+                    r.kind = LAT_BOTTOM;
+                    break;
+                }
+                r = a;
+            }
+            set_lat(s, v, r);
+            break;
+
+        case MIR_BINOP: {
+            Lat a = lat_of(s, v->args[0]);
+            Lat c = lat_of(s, v->args[1]);
+            if (a.kind == LAT_BOTTOM || c.kind == LAT_BOTTOM) {
+                r.kind = LAT_BOTTOM;
+            } else if (a.kind == LAT_CONST && c.kind == LAT_CONST) {
+                if (mir_fold_binop(v->op, a.value, c.value, &r.value)) r.kind = LAT_CONST;
+                else r.kind = LAT_BOTTOM;     // traps at runtime
+            }
+            set_lat(s, v, r);
+            break;
+        }
+
+        case MIR_LOAD_ELEM:
+        case MIR_PARAM:
+        case MIR_CALL:
+            r.kind = LAT_BOTTOM;
+            set_lat(s, v, r);
+            break;
+
+        case MIR_BR: {
+            Lat c = lat_of(s, v->args[0]);
+            if (c.kind == LAT_CONST) {
+                mark_edge(s, b, c.value ? 0 : 1);
+            } else if (c.kind == LAT_BOTTOM) {
+                mark_edge(s, b, 0);
+                mark_edge(s, b, 1);
+            }
+            break;
+        }
+
+        case MIR_JMP:
+            mark_edge(s, b, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void mir_sccp(MirFunc *fn) {
+    if (fn->nblocks == 0) return;
+
+    Sccp s;
+    memset(&s, 0, sizeof(s));
+    s.fn = fn;
+    s.lat = (Lat*)calloc(fn->nvalues, sizeof(Lat));
+    s.block_exec = (bool*)calloc(fn->next_block_id, sizeof(bool));
+    s.edge_exec = (bool*)calloc(fn->next_block_id * 2, sizeof(bool));
+    build_users(&s);
+
+    MirBlock *entry = fn->blocks[0];
+    s.block_exec[entry->id] = true;
+    PUSH(s.cfg_work, s.ncfg, s.cfg_cap, entry);
+
+    while (s.ncfg > 0 || s.nssa > 0) {
+        while (s.ncfg > 0) {
+            MirBlock *b = s.cfg_work[--s.ncfg];
+            for (int p = 0; p < b->nphis; p++) sccp_visit(&s, b->phis[p]);
+            for (int k = 0; k < b->ninstrs; k++) sccp_visit(&s, b->instrs[k]);
+            if (b->term) sccp_visit(&s, b->term);
+        }
+        while (s.nssa > 0) {
+            MirValue *v = s.ssa_work[--s.nssa];
+            for (int u = s.user_start[v->id]; u < s.user_start[v->id + 1]; u++) {
+                MirValue *user = s.users[u];
+                if (s.block_exec[user->block->id]) sccp_visit(&s, user);
+            }
+        }
+    }
+
+    int nvalues = fn->nvalues;      // constants created below are not in s.lat
+
+    // Blocks never reached are dropped along with their outgoing edges
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead || s.block_exec[b->id]) continue;
+        b->dead = true;
+        fn->stats.blocks_removed++;
+    }
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (!b->dead) continue;
+        for (int k = 0; k < b->nsucc; k++)
+            if (!b->succ[k]->dead) remove_edge(b, b->succ[k]);
+    }
+
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+
+        for (int k = 0; k < b->nphis + b->ninstrs; k++) {
+            MirValue *v = (k < b->nphis) ? b->phis[k] : b->instrs[k - b->nphis];
+            if (v->dead || v->id >= nvalues || v->kind == MIR_STORE) continue;
+            if (s.lat[v->id].kind != LAT_CONST) continue;
+            v->replaced = mir_const(fn, s.lat[v->id].value, v->line);
+            v->dead = true;
+            fn->stats.consts_folded++;
+        }
+
+        MirValue *t = b->term;
+        if (t && t->kind == MIR_BR) {
+            Lat c = lat_of(&s, t->args[0]);
+            if (c.kind == LAT_CONST) {
+                int keep = c.value ? 0 : 1;
+                MirBlock *taken = b->succ[keep];
+                remove_edge(b, b->succ[1 - keep]);
+                t->kind = MIR_JMP;
+                t->nargs = 0;
+                b->succ[0] = taken;
+                b->nsucc = 1;
+                fn->stats.branches_folded++;
+            }
+        }
+    }
+
+    free(s.lat);
+    free(s.block_exec);
+    free(s.edge_exec);
+    free(s.user_start);
+    free(s.users);
+    free(s.ssa_work);
+    free(s.cfg_work);
+
+    mir_remove_trivial_phis(fn);
+    mir_sweep(fn);
+}
+
+/* =========================
+   Global value numbering
+   =========================
+   Walks the dominator tree with a scoped hash table: an expression that
+   is already available from a dominating block is replaced by it. */
+
+typedef struct GvnEntry {
+    IROp op;
+    uint64_t a, b;
+    MirValue *value;
+    struct GvnEntry *next;
+} GvnEntry;
+
+typedef struct {
+    GvnEntry **buckets;
+    unsigned mask;
+    unsigned *undo;             /* bucket of each live entry, innermost last */
+    int nundo, undo_cap;
+} GvnTable;
+
+static uint64_t operand_key(MirValue *v) {
+    int c;
+    v = mir_resolve(v);
+    if (const_of(v, &c)) return (1ULL << 40) | (uint32_t)c;
+    return (uint64_t)v->id;
+}
+
+static void expr_key(MirValue *v, IROp *op, uint64_t *a, uint64_t *b) {
+    *op = v->op;
+    *a = operand_key(v->args[0]);
+    *b = operand_key(v->args[1]);
+
+    // a > b is b < a, so both spellings share a number
+    if (*op == IR_GT || *op == IR_GE) {
+        uint64_t t = *a; *a = *b; *b = t;
+        *op = (*op == IR_GT) ? IR_LT : IR_LE;
+    }
+    bool commutative = (*op == IR_ADD || *op == IR_MUL || *op == IR_EQ || *op == IR_NE);
+    if (commutative && *a > *b) {
+        uint64_t t = *a; *a = *b; *b = t;
+    }
+}
+
+static unsigned expr_hash(IROp op, uint64_t a, uint64_t b) {
+    uint64_t h = (uint64_t)op * 0x9e3779b97f4a7c15ULL;
+    h ^= a + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= b + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return (unsigned)(h ^ (h >> 32));
+}
+
+static MirValue *gvn_lookup_or_insert(GvnTable *t, MirValue *v) {
+    IROp op;
+    uint64_t a, b;
+    expr_key(v, &op, &a, &b);
+    unsigned h = expr_hash(op, a, b) & t->mask;
+
+    for (GvnEntry *e = t->buckets[h]; e; e = e->next) {
+        if (e->op == op && e->a == a && e->b == b) return e->value;
+    }
+
+    GvnEntry *e = (GvnEntry*)malloc(sizeof(GvnEntry));
+    e->op = op;
+    e->a = a;
+    e->b = b;
+    e->value = v;
+    e->next = t->buckets[h];
+    t->buckets[h] = e;
+    PUSH(t->undo, t->nundo, t->undo_cap, h);
+    return v;
+}
+
+static void gvn_pop_scope(GvnTable *t, int mark) {
+    while (t->nundo > mark) {
+        unsigned h = t->undo[--t->nundo];
+        GvnEntry *e = t->buckets[h];
+        t->buckets[h] = e->next;
+        free(e);
+    }
+}
+
+static bool same_phi(MirValue *p, MirValue *q) {
+    if (p->nargs != q->nargs) return false;
+    for (int i = 0; i < p->nargs; i++)
+        if (operand_key(p->args[i]) != operand_key(q->args[i])) return false;
+    return true;
+}
+
+static void gvn_block(MirFunc *fn, GvnTable *t, MirBlock *b) {
+    for (int p = 0; p < b->nphis; p++) {
+        MirValue *phi = b->phis[p];
+        for (int q = 0; q < p && !phi->dead; q++) {
+            if (b->phis[q]->dead || !same_phi(phi, b->phis[q])) continue;
+            phi->replaced = b->phis[q];
+            phi->dead = true;
+            fn->stats.values_numbered++;
+        }
+    }
+
+    for (int k = 0; k < b->ninstrs; k++) {
+        MirValue *v = b->instrs[k];
+        if (v->dead || v->kind != MIR_BINOP) continue;
+        MirValue *leader = gvn_lookup_or_insert(t, v);
+        if (leader != v) {
+            v->replaced = leader;
+            v->dead = true;
+            fn->stats.values_numbered++;
+        }
+    }
+}
+
+void mir_gvn(MirFunc *fn) {
+    if (fn->nblocks == 0) return;
+    mir_compute_dominators(fn);
+
+    // dominator tree children, CSR by block id
+    int nids = fn->next_block_id;
+    int *child_start = (int*)calloc(nids + 1, sizeof(int));
+    MirBlock **children = (MirBlock**)malloc(sizeof(MirBlock*) * (fn->nblocks + 1));
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (!b->dead && b->idom && b->idom != b) child_start[b->idom->id + 1]++;
+    }
+    for (int i = 0; i < nids; i++) child_start[i + 1] += child_start[i];
+    int *fill = (int*)malloc(sizeof(int) * (nids + 1));
+    memcpy(fill, child_start, sizeof(int) * (nids + 1));
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (!b->dead && b->idom && b->idom != b) children[fill[b->idom->id]++] = b;
+    }
+    free(fill);
+
+    GvnTable t;
+    memset(&t, 0, sizeof(t));
+    unsigned cap = 64;
+    while (cap < (unsigned)fn->nvalues * 2) cap <<= 1;
+    t.buckets = (GvnEntry**)calloc(cap, sizeof(GvnEntry*));
+    t.mask = cap - 1;
+
+    // explicit stack: a negative entry closes the scope of block ~entry
+    typedef struct { MirBlock *block; int mark; } Frame;
+    Frame *stack = (Frame*)malloc(sizeof(Frame) * (fn->nblocks * 2 + 2));
+    int sp = 0;
+    stack[sp].block = fn->blocks[0];
+    stack[sp].mark = -1;
+    sp++;
+
+    while (sp > 0) {
+        Frame f = stack[--sp];
+        if (f.mark >= 0) {
+            gvn_pop_scope(&t, f.mark);
+            continue;
+        }
+        MirBlock *b = f.block;
+        stack[sp].block = b;
+        stack[sp].mark = t.nundo;
+        sp++;
+
+        gvn_block(fn, &t, b);
+        for (int c = child_start[b->id]; c < child_start[b->id + 1]; c++) {
+            stack[sp].block = children[c];
+            stack[sp].mark = -1;
+            sp++;
+        }
+    }
+
+    gvn_pop_scope(&t, 0);
+    free(stack);
+    free(t.buckets);
+    free(t.undo);
+    free(child_start);
+    free(children);
+
+    mir_remove_trivial_phis(fn);
+    mir_sweep(fn);
+}
+
+/* =========================
+   Dead code elimination
+   ========================= */
+
+/* A division by something that may be zero (or INT_MIN / -1) traps, and
+   so does any element access until range analysis proves its index. A
+   call may run out of frames. */
+bool mir_may_trap(MirValue *v) {
+    if (v->kind == MIR_LOAD_ELEM || v->kind == MIR_STORE_ELEM) return true;
+    if (v->kind == MIR_CALL) return true;
+    if (v->kind != MIR_BINOP || v->op != IR_DIV) return false;
+    int a, c, ignored;
+    if (!const_of(v->args[1], &c)) return true;
+    if (const_of(v->args[0], &a)) return !mir_fold_binop(IR_DIV, a, c, &ignored);
+    return c == 0 || c == -1;
+}
+
+// ...and has to stay for its trap
+static bool has_side_effect(MirValue *v) {
+    if (v->kind == MIR_STORE || v->kind == MIR_BR || v->kind == MIR_JMP) return true;
+    if (v->kind == MIR_RET) return true;
+    if (v->kind == MIR_NEW_ARRAY || v->kind == MIR_STORE_ELEM) return true;
+    return mir_may_trap(v);
+}
+
+/* Variables of an inlined body ("$i<k>.name") are invisible to the
+   debugger and only carry values between the body's blocks, so a store
+   to one that nothing reloads is dropped like a dead value. Constant
+   operands are rematerialized, not reloaded. */
+static bool drop_unread_stores(MirFunc *fn) {
+    bool *read = (bool*)calloc(fn->nvars ? fn->nvars : 1, sizeof(bool));
+    bool changed = false;
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int k = 0; k <= b->nphis + b->ninstrs; k++) {
+            MirValue *v = (k < b->nphis) ? b->phis[k]
+                        : (k < b->nphis + b->ninstrs) ? b->instrs[k - b->nphis] : b->term;
+            if (!v || v->dead) continue;
+            if (v->kind == MIR_PHI) read[v->var] = true;
+            for (int a = 0; a < v->nargs; a++) {
+                MirKind k = mir_resolve(v->args[a])->kind;
+                if (v->arg_var[a] >= 0 && k != MIR_CONST && k != MIR_UNDEF)
+                    read[v->arg_var[a]] = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int k = 0; k < b->ninstrs; k++) {
+            MirValue *v = b->instrs[k];
+            if (v->dead || v->kind != MIR_STORE || read[v->var]) continue;
+            if (strncmp(intern_name(fn->var_syms[v->var]), "$i", 2) != 0) continue;
+            v->dead = true;
+            fn->stats.dead_removed++;
+            changed = true;
+        }
+    }
+    free(read);
+    mir_sweep(fn);
+    return changed;
+}
+
+void mir_dce(MirFunc *fn) {
+    while (drop_unread_stores(fn)) {}
+
+    bool *live = (bool*)calloc(fn->nvalues, sizeof(bool));
+    MirValue **work = NULL;
+    int nwork = 0, work_cap = 0;
+
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int k = 0; k <= b->ninstrs; k++) {
+            MirValue *v = (k < b->ninstrs) ? b->instrs[k] : b->term;
+            if (!v || v->dead || !has_side_effect(v)) continue;
+            live[v->id] = true;
+            PUSH(work, nwork, work_cap, v);
+        }
+    }
+
+    while (nwork > 0) {
+        MirValue *v = work[--nwork];
+        for (int a = 0; a < v->nargs; a++) {
+            MirValue *arg = mir_resolve(v->args[a]);
+            if (arg->kind != MIR_PHI && arg->kind != MIR_BINOP &&
+                arg->kind != MIR_LOAD_ELEM && arg->kind != MIR_CALL) continue;
+            if (live[arg->id]) continue;
+            live[arg->id] = true;
+            PUSH(work, nwork, work_cap, arg);
+        }
+    }
+
+    for (int i = 0; i < fn->nblocks; i++) {
+        MirBlock *b = fn->blocks[i];
+        if (b->dead) continue;
+        for (int k = 0; k < b->nphis + b->ninstrs; k++) {
+            MirValue *v = (k < b->nphis) ? b->phis[k] : b->instrs[k - b->nphis];
+            if (v->dead || v->kind == MIR_STORE || v->kind == MIR_PARAM || live[v->id]) continue;
+            v->dead = true;
+            fn->stats.dead_removed++;
+        }
+    }
+
+    free(live);
+    free(work);
+    mir_sweep(fn);
+}
+
+void mir_optimize(MirFunc *fn) {
+    if (!fn) return;
+    mir_sccp(fn);
+    mir_gvn(fn);
+    if (mir_closed_form(fn)) mir_sccp(fn);
+    mir_licm(fn);
+    mir_strength_reduce(fn);
+    mir_dce(fn);
+
+    pthread_mutex_lock(&totals_lock);
+    totals.consts_folded    += fn->stats.consts_folded;
+    totals.branches_folded  += fn->stats.branches_folded;
+    totals.blocks_removed   += fn->stats.blocks_removed;
+    totals.values_numbered  += fn->stats.values_numbered;
+    totals.dead_removed     += fn->stats.dead_removed;
+    totals.loops_closed     += fn->stats.loops_closed;
+    totals.loop_hoisted     += fn->stats.loop_hoisted;
+    totals.strength_reduced += fn->stats.strength_reduced;
+    totals.calls_inlined    += fn->stats.calls_inlined;
+    pthread_mutex_unlock(&totals_lock);
+}
+
+void mir_print_stats() {
+    pthread_mutex_lock(&totals_lock);
+    MirStats s = totals;
+    pthread_mutex_unlock(&totals_lock);
+
+    printf("--- SSA Optimizer ---\n");
+    printf("%-16s %ld\n", "const-folded", s.consts_folded);
+    printf("%-16s %ld\n", "branch-folded", s.branches_folded);
+    printf("%-16s %ld\n", "block-removed", s.blocks_removed);
+    printf("%-16s %ld\n", "value-numbered", s.values_numbered);
+    printf("%-16s %ld\n", "dead-removed", s.dead_removed);
+    printf("%-16s %ld\n", "loop-closed", s.loops_closed);
+    printf("%-16s %ld\n", "loop-hoisted", s.loop_hoisted);
+    printf("%-16s %ld\n", "strength-reduced", s.strength_reduced);
+    printf("%-16s %ld\n", "call-inlined", s.calls_inlined);
+    printf("---------------------\n");
+}
+
+void mir_reset_stats() {
+    pthread_mutex_lock(&totals_lock);
+    memset(&totals, 0, sizeof(totals));
+    pthread_mutex_unlock(&totals_lock);
+}
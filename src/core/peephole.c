@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "peephole.h"
+
+/* =========================
+   Window helpers
+   ========================= */
+
+/* Removed instructions are turned into IR_NOP first and squeezed out at the
+   end, so jump targets stay valid while the rules run. Labels are no-ops
+   once the IR is linked, so matching looks straight through them. */
+
+typedef struct {
+    IR *ir;
+    bool *target;   /* instruction is the landing point of some jump or call */
+} Peep;
+
+static bool is_skipped(IROp op) {
+    return op == IR_NOP || op == IR_LABEL;
+}
+
+static bool is_jump(IROp op) {
+    return op == IR_JMP || op == IR_JZ || op == IR_JNZ;
+}
+
+/* First real instruction at or after i (ir->size if none) */
+static int land(IR *ir, int i) {
+    while (i < ir->size && is_skipped(ir->instructions[i].op)) i++;
+    return i;
+}
+
+/* First real instruction after i */
+static int next_of(IR *ir, int i) {
+    return land(ir, i + 1);
+}
+
+static IRInstr *at(IR *ir, int i) {
+    return (i < ir->size) ? &ir->instructions[i] : NULL;
+}
+
+static void mark_targets(Peep *pp) {
+    IR *ir = pp->ir;
+    memset(pp->target, 0, sizeof(bool) * (ir->size + 1));
+    for (int i = 0; i < ir->size; i++) {
+        if (is_jump(ir->instructions[i].op))
+            pp->target[land(ir, ir->instructions[i].value)] = true;
+    }
+    for (int f = 0; f < ir->nprocs; f++) {
+        if (ir->procs[f].entry >= 0) pp->target[land(ir, ir->procs[f].entry)] = true;
+    }
+}
+
+/* Delete instruction i; jumps that landed on it now land on its successor */
+static void kill(Peep *pp, int i) {
+    if (pp->target[i]) pp->target[next_of(pp->ir, i)] = true;
+    pp->ir->instructions[i].op = IR_NOP;
+}
+
+static void retarget(Peep *pp, int i, int dest) {
+    pp->ir->instructions[i].value = dest;
+    pp->target[land(pp->ir, dest)] = true;
+}
+
+/* =========================
+   Rules
+   ========================= */
+
+// Resolved labels carry no meaning at runtime
+static bool rule_label(Peep *pp, int i) {
+    if (pp->ir->instructions[i].op != IR_LABEL) return false;
+    kill(pp, i);
+    return true;
+}
+
+/* LOAD_VAR x; LOAD_CONST c; ADD|SUB; STORE_VAR x starting at i
+   (or LOAD_CONST c; LOAD_VAR x; ADD; STORE_VAR x) */
+static bool match_inc(Peep *pp, int i, int *delta) {
+    IR *ir = pp->ir;
+    int j1 = next_of(ir, i);
+    int j2 = next_of(ir, j1);
+    int j3 = next_of(ir, j2);
+    IRInstr *a = at(ir, i);
+    IRInstr *b = at(ir, j1);
+    IRInstr *op = at(ir, j2);
+    IRInstr *st = at(ir, j3);
+
+    if (!a || !b || !op || !st || st->op != IR_STORE_VAR) return false;
+    if (op->op != IR_ADD && op->op != IR_SUB) return false;
+    if (pp->target[j1] || pp->target[j2] || pp->target[j3]) return false;
+
+    IRInstr *ld = a, *k = b;
+    if (op->op == IR_ADD && a->op == IR_LOAD_CONST) { ld = b; k = a; }
+    if (ld->op != IR_LOAD_VAR || k->op != IR_LOAD_CONST) return false;
+    if (ld->sym != st->sym) return false;
+
+    *delta = (op->op == IR_ADD) ? k->value : (int)(0u - (unsigned)k->value);
+    return true;
+}
+
+// STORE_VAR x; LOAD_VAR x  =>  DUP; STORE_VAR x
+static bool rule_store_load(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *st = at(ir, i);
+    int j = next_of(ir, i);
+    IRInstr *ld = at(ir, j);
+    int delta;
+
+    if (st->op != IR_STORE_VAR || !ld || ld->op != IR_LOAD_VAR) return false;
+    if (st->sym != ld->sym || pp->target[j]) return false;
+    if (match_inc(pp, j, &delta)) return false;   // leave it to inc-var
+
+    IRInstr store = *st;
+    *st = make_instr(IR_DUP, 0, IR_NO_SYM, store.line);
+    *ld = store;
+    return true;
+}
+
+// LOAD_VAR x; LOAD_CONST c; ADD; STORE_VAR x  =>  INC_VAR x, c
+static bool rule_inc_var(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    int delta;
+    if (!match_inc(pp, i, &delta)) return false;
+
+    int j1 = next_of(ir, i);
+    int j2 = next_of(ir, j1);
+    int j3 = next_of(ir, j2);
+    IRInstr st = ir->instructions[j3];
+    ir->instructions[i] = make_instr(IR_INC_VAR, delta, st.sym, st.line);
+    kill(pp, j1);
+    kill(pp, j2);
+    kill(pp, j3);
+    return true;
+}
+
+// JMP to the instruction that follows anyway
+static bool rule_jmp_next(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *in = at(ir, i);
+    if (in->op != IR_JMP) return false;
+    if (land(ir, in->value) != next_of(ir, i)) return false;
+    kill(pp, i);
+    return true;
+}
+
+// LOAD_CONST 0; CMP_EQ|CMP_NE; JZ|JNZ L  =>  JNZ|JZ L
+static bool rule_cmp_zero(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *k = at(ir, i);
+    int j1 = next_of(ir, i);
+    int j2 = next_of(ir, j1);
+    IRInstr *cmp = at(ir, j1);
+    IRInstr *br = at(ir, j2);
+
+    if (k->op != IR_LOAD_CONST || k->value != 0) return false;
+    if (!cmp || (cmp->op != IR_EQ && cmp->op != IR_NE)) return false;
+    if (!br || (br->op != IR_JZ && br->op != IR_JNZ)) return false;
+    if (pp->target[j1] || pp->target[j2]) return false;
+
+    // (x == 0) is false exactly when x is non-zero
+    if (cmp->op == IR_EQ)
+        br->op = (br->op == IR_JZ) ? IR_JNZ : IR_JZ;
+    kill(pp, i);
+    kill(pp, j1);
+    return true;
+}
+
+// LOAD_CONST c; JZ|JNZ L  =>  JMP L or nothing
+static bool rule_const_branch(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *k = at(ir, i);
+    int j = next_of(ir, i);
+    IRInstr *br = at(ir, j);
+
+    if (k->op != IR_LOAD_CONST || !br) return false;
+    if ((br->op != IR_JZ && br->op != IR_JNZ) || pp->target[j]) return false;
+
+    bool taken = (br->op == IR_JZ) ? (k->value == 0) : (k->value != 0);
+    kill(pp, i);
+    if (taken) br->op = IR_JMP;
+    else kill(pp, j);
+    return true;
+}
+
+// LOAD_CONST 0; ADD|SUB  =>  nothing
+static bool rule_add_zero(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *k = at(ir, i);
+    int j = next_of(ir, i);
+    IRInstr *op = at(ir, j);
+
+    if (k->op != IR_LOAD_CONST || k->value != 0) return false;
+    if (!op || (op->op != IR_ADD && op->op != IR_SUB) || pp->target[j]) return false;
+    kill(pp, i);
+    kill(pp, j);
+    return true;
+}
+
+// LOAD_CONST 1; MUL|DIV  =>  nothing
+static bool rule_mul_one(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *k = at(ir, i);
+    int j = next_of(ir, i);
+    IRInstr *op = at(ir, j);
+
+    if (k->op != IR_LOAD_CONST || k->value != 1) return false;
+    if (!op || (op->op != IR_MUL && op->op != IR_DIV) || pp->target[j]) return false;
+    kill(pp, i);
+    kill(pp, j);
+    return true;
+}
+
+// Any jump whose destination is a JMP goes straight to the final target
+static bool rule_thread(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *in = at(ir, i);
+    if (!is_jump(in->op)) return false;
+
+    int dest = land(ir, in->value);
+    IRInstr *hop = at(ir, dest);
+    if (!hop || hop->op != IR_JMP) return false;
+
+    // a JMP onto itself is an infinite loop; leave it alone
+    if (land(ir, hop->value) == dest) return false;
+    retarget(pp, i, hop->value);
+    return true;
+}
+
+// JZ A; JMP B; A:  =>  JNZ B; A:
+static bool rule_branch_over_jmp(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    IRInstr *br = at(ir, i);
+    int j = next_of(ir, i);
+    IRInstr *jmp = at(ir, j);
+
+    if (br->op != IR_JZ && br->op != IR_JNZ) return false;
+    if (!jmp || jmp->op != IR_JMP || pp->target[j]) return false;
+    if (land(ir, br->value) != next_of(ir, j)) return false;
+
+    br->op = (br->op == IR_JZ) ? IR_JNZ : IR_JZ;
+    retarget(pp, i, jmp->value);
+    kill(pp, j);
+    return true;
+}
+
+// Code after an unconditional JMP that nothing jumps to
+static bool rule_unreachable(Peep *pp, int i) {
+    IR *ir = pp->ir;
+    if (ir->instructions[i].op != IR_JMP) return false;
+
+    int j = next_of(ir, i);
+    if (j >= ir->size || pp->target[j]) return false;
+    kill(pp, j);
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    bool (*apply)(Peep *pp, int i);
+    long hits;
+} PeepholeRule;
+
+static PeepholeRule rules[] = {
+    { "drop-label",      rule_label,           0 },
+    { "store-load",      rule_store_load,      0 },
+    { "inc-var",         rule_inc_var,         0 },
+    { "jmp-next",        rule_jmp_next,        0 },
+    { "cmp-zero-branch", rule_cmp_zero,        0 },
+    { "const-branch",    rule_const_branch,    0 },
+    { "add-zero",        rule_add_zero,        0 },
+    { "mul-one",         rule_mul_one,         0 },
+    { "jump-thread",     rule_thread,          0 },
+    { "branch-over-jmp", rule_branch_over_jmp, 0 },
+    { "unreachable",     rule_unreachable,     0 },
+};
+
+#define NUM_RULES ((int)(sizeof(rules) / sizeof(rules[0])))
+#define MAX_PASSES 16
+
+/* hits are counted per call and folded into rules[] under this lock */
+static pthread_mutex_t hits_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* =========================
+   Driver
+   ========================= */
+
+/* Squeeze out NOPs and relink jumps to the new instruction indices.
+   A removed instruction maps to the next surviving one. */
+static void compact(IR *ir) {
+    int *new_index = (int*)malloc(sizeof(int) * (ir->size + 1));
+    int out = 0;
+
+    for (int i = 0; i < ir->size; i++) {
+        new_index[i] = out;
+        if (!is_skipped(ir->instructions[i].op)) out++;
+    }
+    new_index[ir->size] = out;
+
+    out = 0;
+    for (int i = 0; i < ir->size; i++) {
+        IRInstr instr = ir->instructions[i];
+        if (is_skipped(instr.op)) continue;
+        if (is_jump(instr.op))
+            instr.value = new_index[instr.value];
+        ir->instructions[out++] = instr;
+    }
+    ir->size = out;
+
+    for (int f = 0; f < ir->nprocs; f++) {
+        if (ir->procs[f].entry >= 0) ir->procs[f].entry = new_index[ir->procs[f].entry];
+    }
+
+    free(new_index);
+}
+
+void ir_peephole(IR *ir) {
+    if (!ir || ir->size == 0) return;
+
+    Peep pp;
+    pp.ir = ir;
+    pp.target = (bool*)malloc(sizeof(bool) * (ir->size + 1));
+    long hits[NUM_RULES] = { 0 };
+
+    for (int pass = 0; pass < MAX_PASSES; pass++) {
+        bool changed = false;
+        mark_targets(&pp);
+
+        for (int i = 0; i < ir->size; i++) {
+            for (int r = 0; r < NUM_RULES; r++) {
+                if (ir->instructions[i].op == IR_NOP) break;
+                if (rules[r].apply(&pp, i)) {
+                    hits[r]++;
+                    changed = true;
+                }
+            }
+        }
+        if (!changed) break;
+    }
+
+    free(pp.target);
+    compact(ir);
+
+    pthread_mutex_lock(&hits_lock);
+    for (int r = 0; r < NUM_RULES; r++) rules[r].hits += hits[r];
+    pthread_mutex_unlock(&hits_lock);
+}
+
+void peephole_print_stats() {
+    pthread_mutex_lock(&hits_lock);
+    printf("--- Peephole Rule Hits ---\n");
+    for (int r = 0; r < NUM_RULES; r++) {
+        printf("%-16s %ld\n", rules[r].name, rules[r].hits);
+    }
+    printf("--------------------------\n");
+    pthread_mutex_unlock(&hits_lock);
+}
+
+void peephole_reset_stats() {
+    pthread_mutex_lock(&hits_lock);
+    for (int r = 0; r < NUM_RULES; r++) rules[r].hits = 0;
+    pthread_mutex_unlock(&hits_lock);
+}
@@ -0,0 +1,22 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "ir.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Rewrites linked IR in place (run after ir_resolve_labels).
+   Jump targets are remapped when instructions are removed. */
+void ir_peephole(IR *ir);
+
+/* Per-rule hit counters, accumulated across all compiles */
+void peephole_print_stats();
+void peephole_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
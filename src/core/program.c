@@ -12,7 +12,6 @@ Program *program_create(int pid, const char *source_path)
 
     p->source_path = strdup(source_path);
 
-    p->ast = NULL;
     p->ir = NULL;
     p->vm = NULL;
 
@@ -23,17 +22,11 @@ void program_destroy(Program *p)
 {
     if (!p) return;
 
-    if (p->ast)
-        ast_free(p->ast);
-
     if (p->ir)
         ir_free(p->ir);
 
-    // Cleanup VM
-    if (p->vm) {
-        vm_destroy(p->vm); 
-        free(p->vm);
-    }
+    // Cleanup VM: back to the pool for the next program
+    vm_release(p->vm);
 
     if (p->source_path)
         free(p->source_path);
@@ -24,7 +24,6 @@ typedef struct Program {
     ProgramState state;
     char *source_path;
 
-    ASTNode *ast;
     IR *ir;
 
     struct VM *vm;
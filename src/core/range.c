@@ -0,0 +1,936 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include "range.h"
+
+/* =========================
+   Intervals
+   =========================
+   Arithmetic wraps in the VM, so a result that might leave int is
+   unknown (TOP) rather than clamped. */
+
+typedef struct {
+    int lo, hi;
+} Range;
+
+static const Range TOP = { INT_MIN, INT_MAX };
+
+static Range range_of(long long lo, long long hi) {
+    if (lo < INT_MIN || hi > INT_MAX) return TOP;
+    Range r = { (int)lo, (int)hi };
+    return r;
+}
+
+static Range join(Range a, Range b) {
+    if (b.lo < a.lo) a.lo = b.lo;
+    if (b.hi > a.hi) a.hi = b.hi;
+    return a;
+}
+
+static bool has_zero(Range r) {
+    return r.lo <= 0 && r.hi >= 0;
+}
+
+static bool is_top(Range r) {
+    return r.lo == INT_MIN && r.hi == INT_MAX;
+}
+
+/* Narrows x to [lo, hi]; false if nothing is left */
+static bool clamp(Range *x, long long lo, long long hi) {
+    if (lo < x->lo) lo = x->lo;
+    if (hi > x->hi) hi = x->hi;
+    if (lo > hi) return false;
+    x->lo = (int)lo;
+    x->hi = (int)hi;
+    return true;
+}
+
+/* Removes c from x where an interval can express that (at an end) */
+static bool exclude(Range *x, int c) {
+    if (x->lo == c && x->hi == c) return false;
+    if (x->lo == c) x->lo++;
+    else if (x->hi == c) x->hi--;
+    return true;
+}
+
+static Range corners(long long a, long long b, long long c, long long d) {
+    long long lo = a, hi = a;
+    if (b < lo) lo = b;
+    if (b > hi) hi = b;
+    if (c < lo) lo = c;
+    if (c > hi) hi = c;
+    if (d < lo) lo = d;
+    if (d > hi) hi = d;
+    return range_of(lo, hi);
+}
+
+/* 1 or 0 when a op b is decided by the ranges alone, -1 otherwise */
+static int compare(IROp op, Range a, Range b) {
+    switch (op) {
+        case IR_LT: return a.hi < b.lo ? 1 : a.lo >= b.hi ? 0 : -1;
+        case IR_LE: return a.hi <= b.lo ? 1 : a.lo > b.hi ? 0 : -1;
+        case IR_GT: return a.lo > b.hi ? 1 : a.hi <= b.lo ? 0 : -1;
+        case IR_GE: return a.lo >= b.hi ? 1 : a.hi < b.lo ? 0 : -1;
+        case IR_EQ:
+            if (a.hi < b.lo || b.hi < a.lo) return 0;
+            return (a.lo == a.hi && b.lo == b.hi) ? 1 : -1;
+        case IR_NE:
+            if (a.hi < b.lo || b.hi < a.lo) return 1;
+            return (a.lo == a.hi && b.lo == b.hi) ? 0 : -1;
+        default: return -1;
+    }
+}
+
+static Range arith(IROp op, Range a, Range b) {
+    switch (op) {
+        case IR_ADD: return range_of((long long)a.lo + b.lo, (long long)a.hi + b.hi);
+        case IR_SUB: return range_of((long long)a.lo - b.hi, (long long)a.hi - b.lo);
+        case IR_MUL:
+            return corners((long long)a.lo * b.lo, (long long)a.lo * b.hi,
+                           (long long)a.hi * b.lo, (long long)a.hi * b.hi);
+        case IR_DIV:
+        case IR_DIV_NZ:
+            // a / b is monotone in each operand while b keeps one sign
+            if (has_zero(b)) return TOP;
+            return corners((long long)a.lo / b.lo, (long long)a.lo / b.hi,
+                           (long long)a.hi / b.lo, (long long)a.hi / b.hi);
+        default: {
+            int t = compare(op, a, b);
+            Range r = { t < 0 ? 0 : t, t < 0 ? 1 : t };
+            return r;
+        }
+    }
+}
+
+static IROp negate(IROp op) {
+    switch (op) {
+        case IR_EQ: return IR_NE;
+        case IR_NE: return IR_EQ;
+        case IR_LT: return IR_GE;
+        case IR_GE: return IR_LT;
+        case IR_GT: return IR_LE;
+        case IR_LE: return IR_GT;
+        default: return op;
+    }
+}
+
+/* Narrows l and r to the values for which l op r holds; false if none */
+static bool assume(IROp op, Range *l, Range *r) {
+    Range a = *l, b = *r;
+    switch (op) {
+        case IR_LT: return clamp(l, LLONG_MIN, (long long)b.hi - 1) && clamp(r, (long long)a.lo + 1, LLONG_MAX);
+        case IR_LE: return clamp(l, LLONG_MIN, b.hi) && clamp(r, a.lo, LLONG_MAX);
+        case IR_GT: return clamp(l, (long long)b.lo + 1, LLONG_MAX) && clamp(r, LLONG_MIN, (long long)a.hi - 1);
+        case IR_GE: return clamp(l, b.lo, LLONG_MAX) && clamp(r, LLONG_MIN, a.hi);
+        case IR_EQ: return clamp(l, b.lo, b.hi) && clamp(r, a.lo, a.hi);
+        case IR_NE:
+            if (b.lo == b.hi && !exclude(l, b.lo)) return false;
+            if (a.lo == a.hi && !exclude(r, a.lo)) return false;
+            return true;
+        default: return true;
+    }
+}
+
+/* =========================
+   Analysis state
+   ========================= */
+
+/* Keeping every variable at every block entry costs blocks x slots;
+   past this many cells variables are left unknown and only the stack
+   and constants are tracked. */
+#define RANGE_MAX_CELLS (1 << 20)
+
+/* Loop heads join plainly this many times before widening kicks in */
+#define WIDEN_DELAY 2
+
+/* Operand stack entry. slot and cmp remember where the value came from,
+   so a branch on it can narrow the variables involved. */
+typedef struct {
+    Range r;
+    int slot;           /* loaded from this variable and unchanged since, else -1 */
+    IROp cmp;           /* comparison that produced it, IR_NOP if none */
+    int lslot, rslot;   /* the comparison's operand slots, -1 if not variables */
+    Range lr, rr;       /* the comparison's operand ranges */
+} Val;
+
+typedef struct {
+    int start, end;     /* pc range [start, end) */
+    bool loop_head;     /* target of a backward jump */
+    bool reached;
+    int root;           /* main program or procedure it belongs to */
+    int changes;
+    int height;
+    Range *stack;       /* entry stack, height entries */
+    Range *vars;        /* entry variables, NULL when not tracked */
+} Block;
+
+/* The main program (root 0) and each procedure called run from their
+   own entry with an empty stack of their own. A call holds the caller's
+   stack below the callee's, so the program's deepest stack stacks each
+   callee's depth on the caller's height at the call. */
+typedef struct {
+    int entry;
+    int nparams, nlocals;
+    int height;         /* deepest stack of its own */
+    int depth;          /* with callees, see total_depth */
+} Root;
+
+typedef struct {
+    int root;
+    int base;           /* caller's height once the arguments are popped */
+    int callee;
+} CallSite;
+
+/* Array lengths are tracked next to the variables: slot s's length
+   lives in cell len_at[s]. lo is a guaranteed minimum, and lo == 0
+   means the slot may not hold an array at all. */
+typedef struct {
+    IR *ir;
+    Block *blocks;
+    int nblocks;
+    int *block_at;      /* by pc: block that starts there, else -1 */
+
+    int nvars;          /* tracked cells: ir->nsyms plus one per array slot, or 0 */
+    Range *cells;
+    int *len_at;        /* by slot: length cell, -1 if never NEW_ARRAY'd */
+
+    int *thresholds;    /* sorted widening points */
+    int nthresholds;
+
+    /* working state while running one block */
+    Val *stack;
+    int sp, stack_cap;
+    Range *vars;
+
+    bool *queued;
+    bool collect;       /* final pass: record results instead of propagating */
+    bool failed;        /* heights disagree or a pop underflows */
+
+    Root *roots;
+    int nroots, roots_cap;
+    int *root_at;       /* by pc: root entered there, else -1 */
+    int root;           /* of the block being run */
+    CallSite *sites;    /* collected */
+    int nsites, sites_cap;
+    const char *unsafe; /* code steps outside its frame (see ir_range_verify) */
+
+    /* results */
+    bool *proven;       /* by pc: divisor never 0, index always in bounds */
+    int max_stack;
+    long counters;      /* INC_VARs whose variable is bounded */
+} Analysis;
+
+static const Range NO_ARRAY = { 0, 0 };
+
+static bool is_jump(IROp op) {
+    return op == IR_JMP || op == IR_JZ || op == IR_JNZ;
+}
+
+static bool is_frame_op(IROp op) {
+    return op == IR_CALL || op == IR_RET || op == IR_LOAD_LOCAL || op == IR_STORE_LOCAL;
+}
+
+/* Operands that name a program variable; procedures keep to their frame */
+static bool is_global_op(IROp op) {
+    return op == IR_LOAD_VAR || op == IR_STORE_VAR || op == IR_INC_VAR ||
+           op == IR_NEW_ARRAY || op == IR_LOAD_ELEM || op == IR_STORE_ELEM ||
+           op == IR_LOAD_ELEM_IB || op == IR_STORE_ELEM_IB;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static bool is_compare(IROp op) {
+    return op >= IR_EQ && op <= IR_GE;
+}
+
+/* A constant compared against offers c-1, c and c+1, which covers the
+   bounds of the usual i < n, i <= n and i != n loop tests. Only loops
+   widen, so straight-line code collects nothing. */
+static void collect_thresholds(Analysis *an, bool loops) {
+    IR *ir = an->ir;
+    an->thresholds = NULL;
+    an->nthresholds = 0;
+    if (!loops) return;
+
+    int n = 0, cap = 0;
+    for (int pc = 0; pc < ir->size; pc++) {
+        if (ir->ops[pc] != IR_LOAD_CONST) continue;
+        bool compared = (pc + 1 < ir->size && is_compare((IROp)ir->ops[pc + 1])) ||
+                        (pc + 2 < ir->size && is_compare((IROp)ir->ops[pc + 2]));
+        if (!compared) continue;
+
+        if (n + 3 > cap) {
+            cap = cap ? cap * 2 : 64;
+            an->thresholds = (int*)realloc(an->thresholds, sizeof(int) * cap);
+        }
+        int c = ir->args[pc];
+        if (c > INT_MIN) an->thresholds[n++] = c - 1;
+        an->thresholds[n++] = c;
+        if (c < INT_MAX) an->thresholds[n++] = c + 1;
+    }
+    if (n) qsort(an->thresholds, n, sizeof(int), cmp_int);
+
+    int out = 0;
+    for (int k = 0; k < n; k++)
+        if (!out || an->thresholds[out - 1] != an->thresholds[k])
+            an->thresholds[out++] = an->thresholds[k];
+    an->nthresholds = out;
+}
+
+/* Smallest threshold >= x, INT_MAX if none */
+static int threshold_above(Analysis *an, int x) {
+    int lo = 0, hi = an->nthresholds;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (an->thresholds[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < an->nthresholds ? an->thresholds[lo] : INT_MAX;
+}
+
+/* Largest threshold <= x, INT_MIN if none */
+static int threshold_below(Analysis *an, int x) {
+    int lo = 0, hi = an->nthresholds;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (an->thresholds[mid] <= x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? an->thresholds[lo - 1] : INT_MIN;
+}
+
+/* Returns whether the code has a backward jump */
+static bool build_blocks(Analysis *an) {
+    IR *ir = an->ir;
+    int n = ir->size;
+    bool *leader = (bool*)calloc(n + 1, sizeof(bool));
+    bool *back_target = (bool*)calloc(n + 1, sizeof(bool));
+    bool loops = false;
+
+    leader[0] = true;
+    for (int pc = 0; pc < n; pc++) {
+        IROp op = (IROp)ir->ops[pc];
+        if (op == IR_CALL) leader[ir->pool[ir->args[pc]]] = true;
+        if (op == IR_RET) leader[pc + 1] = true;
+        if (!is_jump(op)) continue;
+        int t = ir->args[pc];
+        leader[t] = true;
+        leader[pc + 1] = true;
+        if (t <= pc) back_target[t] = loops = true;
+    }
+
+    an->block_at = (int*)malloc(sizeof(int) * (n + 1));
+    an->blocks = NULL;
+    an->nblocks = 0;
+    for (int pc = 0; pc < n; pc++)
+        if (leader[pc]) an->nblocks++;
+    an->blocks = (Block*)calloc(an->nblocks ? an->nblocks : 1, sizeof(Block));
+
+    int b = -1;
+    for (int pc = 0; pc <= n; pc++) {
+        an->block_at[pc] = -1;
+        if (pc == n || !leader[pc]) continue;
+        if (b >= 0) an->blocks[b].end = pc;
+        an->block_at[pc] = ++b;
+        an->blocks[b].start = pc;
+        an->blocks[b].loop_head = back_target[pc];
+    }
+    if (b >= 0) an->blocks[b].end = n;
+
+    free(leader);
+    free(back_target);
+    return loops;
+}
+
+static void analysis_init(Analysis *an, IR *ir) {
+    memset(an, 0, sizeof(*an));
+    an->ir = ir;
+    collect_thresholds(an, build_blocks(an));
+
+    int ncells = ir->nsyms;
+    an->len_at = (int*)malloc(sizeof(int) * (ir->nsyms ? ir->nsyms : 1));
+    memset(an->len_at, -1, sizeof(int) * ir->nsyms);
+    for (int pc = 0; pc < ir->size; pc++) {
+        if (ir->ops[pc] != IR_NEW_ARRAY) continue;
+        int slot = ir->pool[ir->args[pc]];
+        if (an->len_at[slot] < 0) an->len_at[slot] = ncells++;
+    }
+
+    long long cells = (long long)an->nblocks * ncells;
+    an->nvars = (cells <= RANGE_MAX_CELLS) ? ncells : 0;
+    if (an->nvars) {
+        an->cells = (Range*)malloc(sizeof(Range) * cells);
+        for (int b = 0; b < an->nblocks; b++)
+            an->blocks[b].vars = an->cells + (size_t)b * an->nvars;
+    }
+    an->vars = (Range*)malloc(sizeof(Range) * (an->nvars ? an->nvars : 1));
+    an->queued = (bool*)calloc(an->nblocks ? an->nblocks : 1, sizeof(bool));
+    an->proven = (bool*)calloc(ir->size ? ir->size : 1, sizeof(bool));
+    an->root_at = (int*)malloc(sizeof(int) * (ir->size ? ir->size : 1));
+    memset(an->root_at, -1, sizeof(int) * ir->size);
+}
+
+static void analysis_free(Analysis *an) {
+    for (int b = 0; b < an->nblocks; b++) free(an->blocks[b].stack);
+    free(an->blocks);
+    free(an->block_at);
+    free(an->cells);
+    free(an->len_at);
+    free(an->thresholds);
+    free(an->stack);
+    free(an->vars);
+    free(an->queued);
+    free(an->proven);
+    free(an->roots);
+    free(an->root_at);
+    free(an->sites);
+}
+
+/* =========================
+   Transfer
+   ========================= */
+
+static Val *push(Analysis *an, Range r) {
+    if (an->sp >= an->stack_cap) {
+        an->stack_cap = an->stack_cap ? an->stack_cap * 2 : 16;
+        an->stack = (Val*)realloc(an->stack, sizeof(Val) * an->stack_cap);
+    }
+    Val *v = &an->stack[an->sp++];
+    v->r = r;
+    v->slot = -1;
+    v->cmp = IR_NOP;
+    v->lslot = v->rslot = -1;
+    return v;
+}
+
+static bool pop(Analysis *an, Val *out) {
+    if (an->sp == 0) {
+        an->failed = true;
+        return false;
+    }
+    *out = an->stack[--an->sp];
+    return true;
+}
+
+/* A store ends what the stack knows about the variable's old value */
+static void forget(Analysis *an, int slot) {
+    if (an->len_at[slot] >= 0) an->vars[an->len_at[slot]] = NO_ARRAY;
+    for (int i = 0; i < an->sp; i++) {
+        Val *v = &an->stack[i];
+        if (v->slot == slot) v->slot = -1;
+        if (v->lslot == slot) v->lslot = -1;
+        if (v->rslot == slot) v->rslot = -1;
+    }
+}
+
+static bool merge(Analysis *an, Range *old, Range r, bool widen) {
+    Range j = join(*old, r);
+    if (j.lo == old->lo && j.hi == old->hi) return false;
+    if (widen) {
+        if (j.lo < old->lo) j.lo = threshold_below(an, j.lo);
+        if (j.hi > old->hi) j.hi = threshold_above(an, j.hi);
+    }
+    *old = j;
+    return true;
+}
+
+static void mark_unsafe(Analysis *an, const char *why) {
+    if (!an->unsafe) an->unsafe = why;
+}
+
+/* Joins the working state into the entry of the block at pc */
+static void flow(Analysis *an, int pc) {
+    if (an->collect || pc >= an->ir->size) return;
+
+    int b = an->block_at[pc];
+    Block *bl = &an->blocks[b];
+    if (bl->reached && bl->root != an->root) {
+        mark_unsafe(an, "code shared between procedures");
+        return;
+    }
+    if (!bl->reached) {
+        bl->reached = true;
+        bl->root = an->root;
+        bl->height = an->sp;
+        bl->stack = (Range*)malloc(sizeof(Range) * (an->sp ? an->sp : 1));
+        for (int i = 0; i < an->sp; i++) bl->stack[i] = an->stack[i].r;
+        if (an->nvars) memcpy(bl->vars, an->vars, sizeof(Range) * an->nvars);
+        an->queued[b] = true;
+        return;
+    }
+    if (bl->height != an->sp) {
+        an->failed = true;
+        return;
+    }
+
+    bool widen = bl->loop_head && bl->changes >= WIDEN_DELAY;
+    bool changed = false;
+    for (int i = 0; i < an->sp; i++)
+        changed |= merge(an, &bl->stack[i], an->stack[i].r, widen);
+    for (int k = 0; k < an->nvars; k++)
+        changed |= merge(an, &bl->vars[k], an->vars[k], widen);
+    if (changed) {
+        bl->changes++;
+        an->queued[b] = true;
+    }
+}
+
+/* Is index always inside the array in slot? */
+static bool in_bounds(Analysis *an, int slot, Range index) {
+    if (!an->nvars || an->len_at[slot] < 0) return false;
+    Range len = an->vars[an->len_at[slot]];
+    return index.lo >= 0 && index.hi < len.lo;
+}
+
+/* Narrows one variable for the duration of an edge */
+static bool narrow_var(Analysis *an, int slot, Range r, Range *saved) {
+    *saved = an->vars[slot];
+    if (!clamp(&an->vars[slot], r.lo, r.hi)) {
+        an->vars[slot] = *saved;
+        return false;
+    }
+    return true;
+}
+
+/* Edge of a conditional branch on test: zero says which way it went */
+static void branch(Analysis *an, int pc, const Val *test, bool zero) {
+    if (zero && !has_zero(test->r)) return;
+    if (!zero && test->r.lo == 0 && test->r.hi == 0) return;
+
+    int ls = -1, rs = -1;
+    Range lsaved, rsaved;
+
+    if (test->cmp != IR_NOP) {
+        Range l = test->lr, r = test->rr;
+        if (!assume(zero ? negate(test->cmp) : test->cmp, &l, &r)) return;
+        if (an->nvars && test->lslot >= 0) {
+            if (!narrow_var(an, test->lslot, l, &lsaved)) return;
+            ls = test->lslot;
+        }
+        if (an->nvars && test->rslot >= 0) {
+            if (!narrow_var(an, test->rslot, r, &rsaved)) {
+                if (ls >= 0) an->vars[ls] = lsaved;
+                return;
+            }
+            rs = test->rslot;
+        }
+    } else if (an->nvars && test->slot >= 0) {
+        Range x = an->vars[test->slot];
+        if (zero ? !clamp(&x, 0, 0) : !exclude(&x, 0)) return;
+        narrow_var(an, test->slot, x, &lsaved);
+        ls = test->slot;
+    }
+
+    flow(an, pc);
+
+    if (rs >= 0) an->vars[rs] = rsaved;
+    if (ls >= 0) an->vars[ls] = lsaved;
+}
+
+/* Makes the block at pc the entry of a root: nothing on the stack, and
+   nothing known about variables (a resumed VM may hold anything) */
+static void reach_entry(Analysis *an, int pc, int root) {
+    int b = an->block_at[pc];
+    Block *bl = &an->blocks[b];
+    if (bl->reached) {
+        mark_unsafe(an, "code shared between procedures");
+        return;
+    }
+    bl->reached = true;
+    bl->root = root;
+    bl->stack = (Range*)malloc(sizeof(Range));
+    for (int k = 0; k < an->nvars; k++) bl->vars[k] = TOP;
+    for (int s = 0; s < an->ir->nsyms && an->nvars; s++)
+        if (an->len_at[s] >= 0) bl->vars[an->len_at[s]] = NO_ARRAY;
+    an->queued[b] = true;
+}
+
+static int add_root(Analysis *an, int entry, int nparams, int nlocals) {
+    if (an->nroots >= an->roots_cap) {
+        an->roots_cap = an->roots_cap ? an->roots_cap * 2 : 8;
+        an->roots = (Root*)realloc(an->roots, sizeof(Root) * an->roots_cap);
+    }
+    Root *r = &an->roots[an->nroots];
+    r->entry = entry;
+    r->nparams = nparams;
+    r->nlocals = nlocals;
+    r->height = 0;
+    r->depth = -1;
+    an->root_at[entry] = an->nroots;
+    return an->nroots++;
+}
+
+/* Root of the procedure a CALL names, analyzed from its entry on first
+   sight; -1 if the call is malformed */
+static int enter(Analysis *an, const int *f) {
+    int r = an->root_at[f[0]];
+    if (r == 0) {
+        mark_unsafe(an, "call into the main program");
+        return -1;
+    }
+    if (r > 0) {
+        if (an->roots[r].nparams != f[1] || an->roots[r].nlocals != f[2]) {
+            mark_unsafe(an, "inconsistent procedure frames");
+            return -1;
+        }
+        return r;
+    }
+    if (an->collect) return -1;
+    r = add_root(an, f[0], f[1], f[2]);
+    reach_entry(an, f[0], r);
+    return r;
+}
+
+static void check_local(Analysis *an, int slot) {
+    if (an->root == 0) mark_unsafe(an, "frame slot used outside a procedure");
+    else if (slot < 0 || slot >= an->roots[an->root].nlocals) mark_unsafe(an, "frame slot out of range");
+}
+
+static void run_block(Analysis *an, int b) {
+    IR *ir = an->ir;
+    Block *bl = &an->blocks[b];
+
+    an->sp = 0;
+    an->root = bl->root;
+    for (int i = 0; i < bl->height; i++) push(an, bl->stack[i]);
+    if (an->nvars) memcpy(an->vars, bl->vars, sizeof(Range) * an->nvars);
+
+    for (int pc = bl->start; pc < bl->end; pc++) {
+        IROp op = (IROp)ir->ops[pc];
+        int arg = ir->args[pc];
+        Val a, c;
+
+        if (an->root != 0 && is_global_op(op))
+            mark_unsafe(an, "variable used inside a procedure");
+
+        switch (op) {
+            case IR_LOAD_CONST:
+                push(an, range_of(arg, arg));
+                break;
+
+            case IR_LOAD_VAR: {
+                if (!an->nvars) {
+                    push(an, TOP);
+                    break;
+                }
+                Val *v = push(an, an->vars[arg]);
+                v->slot = arg;
+                break;
+            }
+
+            case IR_STORE_VAR:
+                if (!pop(an, &a)) return;
+                if (an->nvars) {
+                    forget(an, arg);
+                    an->vars[arg] = a.r;
+                }
+                break;
+
+            case IR_INC_VAR: {
+                if (!an->nvars) break;
+                int slot = ir->pool[arg];
+                Range x = an->vars[slot];
+                if (an->collect && !is_top(x)) an->counters++;
+                forget(an, slot);
+                an->vars[slot] = arith(IR_ADD, x, range_of(ir->pool[arg + 1], ir->pool[arg + 1]));
+                break;
+            }
+
+            case IR_NEW_ARRAY: {
+                if (!an->nvars) break;
+                int slot = ir->pool[arg];
+                forget(an, slot);
+                an->vars[slot] = range_of(0, 0);    // an array reads as 0
+                an->vars[an->len_at[slot]] = range_of(ir->pool[arg + 1], ir->pool[arg + 1]);
+                break;
+            }
+
+            case IR_LOAD_ELEM:
+            case IR_LOAD_ELEM_IB:
+                if (!pop(an, &c)) return;
+                if (an->collect) an->proven[pc] = in_bounds(an, arg, c.r);
+                push(an, TOP);
+                break;
+
+            case IR_STORE_ELEM:
+            case IR_STORE_ELEM_IB:
+                if (!pop(an, &a) || !pop(an, &c)) return;
+                if (an->collect) an->proven[pc] = in_bounds(an, arg, c.r);
+                break;
+
+            case IR_DUP:
+                if (an->sp == 0) {
+                    an->failed = true;
+                    return;
+                }
+                push(an, TOP);
+                an->stack[an->sp - 1] = an->stack[an->sp - 2];
+                break;
+
+            case IR_ADD: case IR_SUB: case IR_MUL:
+            case IR_DIV: case IR_DIV_NZ:
+            case IR_EQ: case IR_NE: case IR_LT: case IR_GT: case IR_LE: case IR_GE: {
+                if (!pop(an, &c) || !pop(an, &a)) return;
+                if (an->collect && (op == IR_DIV || op == IR_DIV_NZ))
+                    an->proven[pc] = !has_zero(c.r);
+
+                Val *v = push(an, arith(op, a.r, c.r));
+                if (is_compare(op)) {
+                    v->cmp = op;
+                    v->lslot = a.slot;
+                    v->rslot = c.slot;
+                    v->lr = a.r;
+                    v->rr = c.r;
+                }
+                break;
+            }
+
+            case IR_CALL: {
+                const int *f = &ir->pool[arg];
+                for (int i = 0; i < f[1]; i++)
+                    if (!pop(an, &a)) return;
+                int callee = enter(an, f);
+                if (an->collect && callee > 0) {
+                    if (an->nsites >= an->sites_cap) {
+                        an->sites_cap = an->sites_cap ? an->sites_cap * 2 : 16;
+                        an->sites = (CallSite*)realloc(an->sites, sizeof(CallSite) * an->sites_cap);
+                    }
+                    CallSite *site = &an->sites[an->nsites++];
+                    site->root = an->root;
+                    site->base = an->sp;
+                    site->callee = callee;
+                }
+                push(an, TOP);
+                break;
+            }
+
+            case IR_RET:
+                if (an->root == 0) mark_unsafe(an, "return outside a procedure");
+                if (!pop(an, &a)) return;
+                if (an->sp != 0) an->failed = true;
+                return;
+
+            case IR_LOAD_LOCAL:
+                check_local(an, arg);
+                push(an, TOP);
+                break;
+
+            case IR_STORE_LOCAL:
+                check_local(an, arg);
+                if (!pop(an, &a)) return;
+                break;
+
+            case IR_JMP:
+                flow(an, arg);
+                return;
+
+            case IR_JZ:
+            case IR_JNZ:
+                if (!pop(an, &a)) return;
+                branch(an, arg, &a, op == IR_JZ);
+                branch(an, pc + 1, &a, op != IR_JZ);
+                return;
+
+            default:
+                break;
+        }
+        if (an->collect && an->sp > an->roots[an->root].height)
+            an->roots[an->root].height = an->sp;
+    }
+    flow(an, bl->end);
+}
+
+static int by_root(const void *a, const void *b) {
+    return ((const CallSite*)a)->root - ((const CallSite*)b)->root;
+}
+
+/* Deepest stack over the whole program, -1 when calls recurse and the
+   depth has no static bound. Callees are finished before their callers
+   by an explicit depth-first walk over the call sites. */
+static int total_depth(Analysis *an) {
+    if (an->nsites > 0)
+        qsort(an->sites, an->nsites, sizeof(CallSite), by_root);
+    int *first = (int*)malloc(sizeof(int) * (an->nroots + 1));
+    for (int r = 0, s = 0; r <= an->nroots; r++) {
+        while (s < an->nsites && an->sites[s].root < r) s++;
+        first[r] = s;
+    }
+
+    int *work = (int*)malloc(sizeof(int) * an->nroots);
+    int *next = (int*)malloc(sizeof(int) * an->nroots);
+    bool *open = (bool*)calloc(an->nroots, sizeof(bool));
+    int n = 0, result = 0;
+    work[n++] = 0;
+    next[0] = first[0];
+    open[0] = true;
+    an->roots[0].depth = an->roots[0].height;
+
+    while (n > 0 && result >= 0) {
+        int r = work[n - 1];
+        if (next[r] == first[r + 1]) {
+            open[r] = false;
+            n--;
+            continue;
+        }
+        CallSite *site = &an->sites[next[r]];
+        Root *callee = &an->roots[site->callee];
+        if (open[site->callee]) {
+            result = -1;
+        } else if (callee->depth < 0) {
+            // not walked yet: come back to this site once it is
+            callee->depth = callee->height;
+            open[site->callee] = true;
+            next[site->callee] = first[site->callee];
+            work[n++] = site->callee;
+        } else {
+            if (site->base + callee->depth > an->roots[r].depth)
+                an->roots[r].depth = site->base + callee->depth;
+            next[r]++;
+        }
+    }
+    if (result >= 0) result = an->roots[0].depth;
+
+    free(first);
+    free(work);
+    free(next);
+    free(open);
+    return result;
+}
+
+static void analyze(Analysis *an) {
+    if (an->nblocks == 0) return;
+
+    add_root(an, 0, 0, 0);
+    reach_entry(an, 0, 0);
+
+    // rounds in pc order: loops settle inner first, one round per change
+    bool again = true;
+    while (again && !an->failed) {
+        again = false;
+        for (int b = 0; b < an->nblocks && !an->failed; b++) {
+            if (!an->queued[b]) continue;
+            an->queued[b] = false;
+            run_block(an, b);
+            again = true;
+        }
+    }
+    if (an->failed) return;
+
+    an->collect = true;
+    for (int b = 0; b < an->nblocks && !an->failed; b++) {
+        Block *bl = &an->blocks[b];
+        if (!bl->reached) continue;
+        if (bl->height > an->roots[bl->root].height) an->roots[bl->root].height = bl->height;
+        run_block(an, b);
+    }
+    if (!an->failed) an->max_stack = total_depth(an);
+}
+
+/* =========================
+   Driver
+   ========================= */
+
+typedef struct {
+    long programs;
+    long stack_bounded;
+    long divs_proven;
+    long divs_checked;
+    long elems_proven;
+    long elems_checked;
+    long counters_bounded;
+} RangeStats;
+
+static RangeStats totals;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void ir_range(IR *ir) {
+    if (!ir || !ir->ops) return;
+
+    Analysis an;
+    analysis_init(&an, ir);
+    analyze(&an);
+
+    // generated code keeps to its frames; if not, prove nothing
+    bool failed = an.failed || an.unsafe;
+    RangeStats s = { 1, 0, 0, 0, 0, 0, an.counters };
+    ir->max_stack = failed ? -1 : an.max_stack;
+    if (ir->max_stack >= 0) s.stack_bounded++;
+
+    for (int pc = 0; pc < ir->size; pc++) {
+        IROp op = (IROp)ir->ops[pc];
+        bool proven = !failed && an.proven[pc];
+        if (op == IR_DIV) {
+            if (proven) {
+                ir->ops[pc] = IR_DIV_NZ;
+                s.divs_proven++;
+            } else {
+                s.divs_checked++;
+            }
+        } else if (op == IR_LOAD_ELEM || op == IR_STORE_ELEM) {
+            if (proven) {
+                ir->ops[pc] = (op == IR_LOAD_ELEM) ? IR_LOAD_ELEM_IB : IR_STORE_ELEM_IB;
+                s.elems_proven++;
+            } else {
+                s.elems_checked++;
+            }
+        }
+    }
+    analysis_free(&an);
+
+    pthread_mutex_lock(&stats_lock);
+    totals.programs += s.programs;
+    totals.stack_bounded += s.stack_bounded;
+    totals.divs_proven += s.divs_proven;
+    totals.divs_checked += s.divs_checked;
+    totals.elems_proven += s.elems_proven;
+    totals.elems_checked += s.elems_checked;
+    totals.counters_bounded += s.counters_bounded;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+const char *ir_range_verify(IR *ir) {
+    Analysis an;
+    analysis_init(&an, ir);
+    analyze(&an);
+
+    const char *why = an.unsafe;
+    ir->max_stack = an.failed ? -1 : an.max_stack;
+    for (int pc = 0; pc < ir->size && !why; pc++) {
+        IROp op = (IROp)ir->ops[pc];
+        bool proven = !an.failed && an.proven[pc];
+        if (an.failed && is_frame_op(op))
+            why = "unverified procedure code";
+        else if (op == IR_DIV_NZ && !proven)
+            why = "unproven check-free division";
+        else if ((op == IR_LOAD_ELEM_IB || op == IR_STORE_ELEM_IB) && !proven)
+            why = "unproven check-free element access";
+    }
+    analysis_free(&an);
+    return why;
+}
+
+void range_print_stats() {
+    pthread_mutex_lock(&stats_lock);
+    printf("--- Range Analysis ---\n");
+    printf("%-16s %ld\n", "programs", totals.programs);
+    printf("%-16s %ld\n", "stack-bounded", totals.stack_bounded);
+    printf("%-16s %ld\n", "div-unchecked", totals.divs_proven);
+    printf("%-16s %ld\n", "div-checked", totals.divs_checked);
+    printf("%-16s %ld\n", "elem-unchecked", totals.elems_proven);
+    printf("%-16s %ld\n", "elem-checked", totals.elems_checked);
+    printf("%-16s %ld\n", "counter-bounded", totals.counters_bounded);
+    printf("----------------------\n");
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void range_reset_stats() {
+    pthread_mutex_lock(&stats_lock);
+    memset(&totals, 0, sizeof(totals));
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,47 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include "ir.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* =========================
+   Value-range analysis
+   =========================
+   Interval abstract interpretation of linked IR (after ir_pack). Each
+   basic block entry records a range per variable slot and per operand
+   stack entry. Branches on a comparison narrow the variables it read,
+   and loop heads are widened to the program's own constants, so a
+   counter tested against a bound keeps that bound. The VM uses the
+   results to skip runtime checks:
+     - a DIV whose divisor range excludes 0 becomes DIV_NZ,
+     - an element access whose index range fits the shortest array the
+       variable can hold becomes LOAD_ELEM_IB / STORE_ELEM_IB,
+     - ir->max_stack is the deepest operand stack on any path, calls
+       included, or -1 when heights disagree at a merge, a pop could
+       underflow or calls recurse.
+   Procedures are analyzed from their entry, reached through CALL, with
+   an empty stack of their own; RET must leave exactly the result. */
+
+/* Compile path: rewrites provable divisions and element accesses and
+   sets max_stack */
+void ir_range(IR *ir);
+
+/* Mapped code is used as is: sets max_stack and returns why the code
+   is unsafe if some DIV_NZ or _IB access cannot be proven, or code
+   steps outside its frame (a frame slot past the procedure's frame,
+   a procedure touching program variables, code shared between the
+   main program and a procedure), NULL otherwise */
+const char *ir_range_verify(IR *ir);
+
+/* Totals across all compiles */
+void range_print_stats();
+void range_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
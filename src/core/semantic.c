@@ -1,90 +1,288 @@
 #include "ast.h"
+#include "ir.h"
+#include "intern.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct Symbol {
-    char *name;
-    struct Symbol *next;
-} Symbol;
+/* =========================
+   Scoped symbol table
+   =========================
+   Indexed directly by symbol id. Each name has one entry for the whole
+   program; leaving a scope just marks the names it declared as out of
+   scope again. Blocks and for loops open scopes. A name may not be
+   redeclared while it is visible, because the VM keeps one slot per
+   variable name and an inner declaration would silently alias the
+   outer one. The table belongs to one semantic_analysis call, so
+   programs can be checked concurrently.
 
-static Symbol *symtab = NULL;
+   Functions are defined at the top level and may be called from
+   anywhere, before or after their definition. A body gets a table of
+   its own, so it sees only its parameters and its own declarations,
+   none of the program's variables. Arrays cannot be declared inside a
+   function. */
 
-/* Reset table per program */
-void semantic_reset() {
-    while (symtab) {
-        Symbol *tmp = symtab;
-        symtab = symtab->next;
-        free(tmp->name);
-        free(tmp);
+enum { SYM_NONE, SYM_SCALAR, SYM_ARRAY };
+
+typedef struct {
+    unsigned char *live;    /* by symbol id: SYM_* of the visible declaration */
+    int cap;
+
+    int *decls;             /* symbols in declaration order */
+    int ndecls, decls_cap;
+    int *scope_start;       /* ndecls when each open scope began */
+    int depth, scope_cap;
+} SymTab;
+
+typedef struct {
+    int *arity;             /* by symbol id: parameter count, -1 if not a function */
+    int cap;
+    SymTab *body;           /* one table reused by every function body */
+    FILE *diag;             /* where errors are reported */
+} FuncTab;
+
+/* Pending traversal steps. A NULL node closes the innermost scope, so
+   nesting depth costs heap, not C stack. */
+typedef struct {
+    ASTNode **items;
+    int n, cap;
+} Work;
+
+static void symtab_init(SymTab *st) {
+    memset(st, 0, sizeof(*st));
+
+    /* every name in the program was interned by the lexer already */
+    st->cap = intern_count();
+    st->live = (unsigned char*)calloc(st->cap ? st->cap : 1, 1);
+}
+
+static void symtab_free(SymTab *st) {
+    free(st->live);
+    free(st->decls);
+    free(st->scope_start);
+}
+
+static int symbol_exists(SymTab *st, int sym) {
+    return sym >= 0 && sym < st->cap && st->live[sym];
+}
+
+static void symbol_add(SymTab *st, int sym, int kind) {
+    st->live[sym] = (unsigned char)kind;
+
+    if (st->ndecls >= st->decls_cap) {
+        st->decls_cap = st->decls_cap ? st->decls_cap * 2 : 64;
+        st->decls = realloc(st->decls, sizeof(int) * st->decls_cap);
     }
-    symtab = NULL; // Ensure it's explicitly null
+    st->decls[st->ndecls++] = sym;
 }
 
-static int symbol_exists(const char *name) {
-    for (Symbol *s = symtab; s; s = s->next) {
-        if (strcmp(s->name, name) == 0)
-            return 1;
+static void scope_push(SymTab *st) {
+    if (st->depth >= st->scope_cap) {
+        st->scope_cap = st->scope_cap ? st->scope_cap * 2 : 16;
+        st->scope_start = realloc(st->scope_start, sizeof(int) * st->scope_cap);
     }
-    return 0;
+    st->scope_start[st->depth++] = st->ndecls;
 }
 
-static void symbol_add(const char *name) {
-    Symbol *s = malloc(sizeof(Symbol));
-    s->name = strdup(name);
-    s->next = symtab;
-    symtab = s;
+static void scope_pop(SymTab *st) {
+    int start = st->scope_start[--st->depth];
+    while (st->ndecls > start)
+        st->live[st->decls[--st->ndecls]] = 0;
 }
 
-/* Your internal recursive check */
-int semantic_check(ASTNode *node) {
-    if (!node) return 0;
+static void work_push(Work *w, ASTNode *node) {
+    if (w->n >= w->cap) {
+        w->cap = w->cap ? w->cap * 2 : 256;
+        w->items = realloc(w->items, sizeof(ASTNode*) * w->cap);
+    }
+    w->items[w->n++] = node;
+}
 
-    switch (node->type) {
-        case AST_VAR_DECL:
-            if (symbol_exists(node->name)) {
-                printf("Semantic Error: Variable '%s' already declared.\n", node->name);
-                return 1;
-            }
-            symbol_add(node->name);
-            break;
-
-        case AST_ASSIGN:
-            if (node->left && node->left->type == AST_IDENT) {
-                if (!symbol_exists(node->left->name)) {
-                    printf("Semantic Error: Variable '%s' not declared.\n", node->left->name);
-                    return 1;
+/* Pushes what follows node in source order: its children, then the rest
+   of its statement list. Popping them visits the tree in the same
+   preorder as a recursive walk. */
+static void work_push_children(Work *w, ASTNode *node, int scoped) {
+    if (node->next) work_push(w, node->next);
+    if (scoped) work_push(w, NULL);
+    if (node->third) work_push(w, node->third);
+    if (node->right) work_push(w, node->right);
+    if (node->left) work_push(w, node->left);
+}
+
+static int function_arity(const FuncTab *ft, int sym) {
+    return (sym >= 0 && sym < ft->cap) ? ft->arity[sym] : -1;
+}
+
+static int semantic_check(SymTab *st, const FuncTab *ft, ASTNode *root, int func);
+
+/* Parameters are the body's first declarations. Closing every scope
+   afterwards clears just the names the function declared, leaving the
+   shared table empty for the next one. */
+static int check_function(const FuncTab *ft, ASTNode *def) {
+    SymTab *st = ft->body;
+    scope_push(st);
+
+    int err = 0;
+    for (ASTNode *p = def->left; p && !err; p = p->next) {
+        if (symbol_exists(st, p->sym)) {
+            fprintf(ft->diag, "Semantic Error: Variable '%s' already declared.\n", intern_name(p->sym));
+            err = 1;
+        } else {
+            symbol_add(st, p->sym, SYM_SCALAR);
+        }
+    }
+    if (!err) err = semantic_check(st, ft, def->right, def->sym);
+
+    while (st->depth > 0) scope_pop(st);
+    return err;
+}
+
+/* Reports the first error in source order. func is the symbol of the
+   function whose body this is, -1 for the main program. */
+static int semantic_check(SymTab *st, const FuncTab *ft, ASTNode *root, int func) {
+    Work w = { NULL, 0, 0 };
+    int err = 0;
+    work_push(&w, root);
+
+    while (w.n > 0 && !err) {
+        ASTNode *node = w.items[--w.n];
+        if (!node) {
+            scope_pop(st);
+            continue;
+        }
+
+        switch (node->type) {
+            case AST_BLOCK:
+            case AST_FOR:
+                scope_push(st);
+                work_push_children(&w, node, 1);
+                continue;
+
+            case AST_FUNC:
+                if (func >= 0 || st->depth != 1) {
+                    fprintf(ft->diag, "Semantic Error: Function '%s' must be defined at the top level.\n",
+                            intern_name(node->sym));
+                    err = 1;
+                    break;
                 }
-            }
-            break;
+                err = check_function(ft, node);
+                if (node->next) work_push(&w, node->next);
+                continue;
 
-        case AST_IDENT:
-            if (!symbol_exists(node->name)) {
-                printf("Semantic Error: Variable '%s' not declared.\n", node->name);
-                return 1;
+            case AST_CALL: {
+                int arity = function_arity(ft, node->sym);
+                if (arity < 0) {
+                    fprintf(ft->diag, "Semantic Error: Function '%s' not defined.\n", intern_name(node->sym));
+                    err = 1;
+                } else if (arity != node->value) {
+                    fprintf(ft->diag, "Semantic Error: Function '%s' takes %d arguments, %d given.\n",
+                            intern_name(node->sym), arity, node->value);
+                    err = 1;
+                }
+                break;
             }
-            break;
 
-        default:
-            break;
-    }
+            case AST_RETURN:
+                if (func < 0) {
+                    fprintf(ft->diag, "Semantic Error: 'return' outside a function.\n");
+                    err = 1;
+                }
+                break;
 
-    if (semantic_check(node->left))  return 1;
-    if (semantic_check(node->right)) return 1;
-    if (semantic_check(node->third)) return 1;
-    if (semantic_check(node->next))  return 1;
+            case AST_VAR_DECL:
+            case AST_ARRAY_DECL:
+                if (node->type == AST_ARRAY_DECL && func >= 0) {
+                    fprintf(ft->diag, "Semantic Error: Arrays cannot be declared inside function '%s'.\n",
+                            intern_name(func));
+                    err = 1;
+                    break;
+                }
+                if (symbol_exists(st, node->sym)) {
+                    fprintf(ft->diag, "Semantic Error: Variable '%s' already declared.\n", intern_name(node->sym));
+                    err = 1;
+                    break;
+                }
+                if (node->type == AST_ARRAY_DECL &&
+                    (node->value < 1 || node->value > IR_MAX_ARRAY)) {
+                    fprintf(ft->diag, "Semantic Error: Array '%s' must have 1 to %d elements.\n",
+                            intern_name(node->sym), IR_MAX_ARRAY);
+                    err = 1;
+                    break;
+                }
+                symbol_add(st, node->sym, node->type == AST_ARRAY_DECL ? SYM_ARRAY : SYM_SCALAR);
+                break;
 
-    return 0;
+            case AST_ASSIGN:
+                if (node->left && node->left->type == AST_IDENT) {
+                    if (!symbol_exists(st, node->left->sym)) {
+                        fprintf(ft->diag, "Semantic Error: Variable '%s' not declared.\n", intern_name(node->left->sym));
+                        err = 1;
+                    }
+                }
+                break;
+
+            case AST_IDENT:
+                if (!symbol_exists(st, node->sym)) {
+                    fprintf(ft->diag, "Semantic Error: Variable '%s' not declared.\n", intern_name(node->sym));
+                    err = 1;
+                } else if (st->live[node->sym] == SYM_ARRAY) {
+                    fprintf(ft->diag, "Semantic Error: Array '%s' used without an index.\n", intern_name(node->sym));
+                    err = 1;
+                }
+                break;
+
+            case AST_INDEX:
+                if (!symbol_exists(st, node->sym)) {
+                    fprintf(ft->diag, "Semantic Error: Variable '%s' not declared.\n", intern_name(node->sym));
+                    err = 1;
+                } else if (st->live[node->sym] != SYM_ARRAY) {
+                    fprintf(ft->diag, "Semantic Error: Variable '%s' is not an array.\n", intern_name(node->sym));
+                    err = 1;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        work_push_children(&w, node, 0);
+    }
+
+    free(w.items);
+    return err;
 }
 
 /* ✅ THIS IS THE FUNCTION THE COMPILER IS LOOKING FOR */
-int semantic_analysis(ASTNode *root) {
+int semantic_analysis(ASTNode *root, FILE *diag) {
     if (!root) return 0;
-    
-    // 1. Clear old symbols from previous runs
-    semantic_reset();
-    
-    if (semantic_check(root)) return 1;
-
-    return 0;
-}
\ No newline at end of file
+
+    // 1. Fresh symbol table for this program
+    SymTab st;
+    symtab_init(&st);
+
+    // 2. Top-level functions, so calls may come before definitions
+    SymTab body;
+    symtab_init(&body);
+    FuncTab ft;
+    ft.body = &body;
+    ft.diag = diag;
+    ft.cap = st.cap;
+    ft.arity = (int*)malloc(sizeof(int) * (ft.cap ? ft.cap : 1));
+    for (int i = 0; i < ft.cap; i++) ft.arity[i] = -1;
+
+    int err = 0;
+    for (ASTNode *s = root->type == AST_BLOCK ? root->left : NULL; s && !err; s = s->next) {
+        if (s->type != AST_FUNC) continue;
+        if (ft.arity[s->sym] >= 0) {
+            fprintf(diag, "Semantic Error: Function '%s' already defined.\n", intern_name(s->sym));
+            err = 1;
+        }
+        ft.arity[s->sym] = s->value;
+    }
+
+    if (!err) err = semantic_check(&st, &ft, root, -1);
+    free(ft.arity);
+    symtab_free(&body);
+    symtab_free(&st);
+    return err ? 1 : 0;
+}
@@ -1,12 +1,11 @@
 #ifndef SEMANTIC_H
 #define SEMANTIC_H
 
+#include <stdio.h>
 #include "ast.h"
 
-/* Reset symbol table per compile */
-void semantic_reset();
-
-/* Main semantic pass */
-int semantic_check(ASTNode *root);
+/* Main semantic pass; 0 on success, otherwise the first error is
+   reported on diag. Keeps no state between calls. */
+int semantic_analysis(ASTNode *root, FILE *diag);
 
 #endif
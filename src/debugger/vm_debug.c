@@ -6,31 +6,65 @@
 
 #define STACK_SIZE 1024
 #define MAX_STEPS 500000
+#define MAX_SPARE 4096          /* freed scalars a VM keeps for reuse */
+#define POOL_MAX 16             /* idle VMs kept at most */
+#define POOL_WINDOW 64          /* acquires between resizes of the pool */
+#define MAX_BREAK_PC ((int)sizeof(((VM*)0)->breakpoints))
 
-#define MAX_VARS 256
+/* Variables are indexed by the program's slot numbers (IR.syms maps a
+   slot back to its name), so loads and stores are a single array
+   access. Each VM owns its table, sized by vm_init, so a paused VM
+   resumes with exactly the state it stopped in; the range analysis
+   relies on that for check-free element accesses. */
 
-typedef struct {
-    char name[32];
-    Object *value;
-} Var;
-
-static Var vars[MAX_VARS];
-static int var_count = 0;
+static void tier_free(struct Tier *t);
 
 
 /* =========================
    Heap / GC
    ========================= */
 
+static void runtime_error(const char *what) {
+    printf("Runtime Error: %s\n", what);
+    exit(1);
+}
+
 static Object* heap_alloc(VM *vm, int value) {
-    Object *o = malloc(sizeof(Object));
+    Object *o = vm->spare;
+    if (o) {
+        vm->spare = o->next;
+        vm->nspare--;
+    } else {
+        o = malloc(sizeof(Object));
+    }
     o->value = value;
     o->marked = false;
+    o->length = 0;
     o->next = vm->heap;
     vm->heap = o;
     return o;
 }
 
+static Object* heap_alloc_array(VM *vm, int length) {
+    Object *o = calloc(1, sizeof(Object) + sizeof(int) * (size_t)length);
+    if (!o) runtime_error("out of memory");
+    o->length = length;
+    o->next = vm->heap;
+    vm->heap = o;
+    return o;
+}
+
+/* Scalars all have the same size: keep some instead of freeing them */
+static void heap_free(VM *vm, Object *o) {
+    if (o->length == 0 && vm->nspare < MAX_SPARE) {
+        o->next = vm->spare;
+        vm->spare = o;
+        vm->nspare++;
+    } else {
+        free(o);
+    }
+}
+
 static void mark(Object *o) {
     if (!o || o->marked) return;
     o->marked = true;
@@ -41,19 +75,22 @@ void gc_collect(VM *vm) {
     for (int i = 0; i < vm->sp; i++)
         mark(vm->stack[i]);
 
-    for (int i = 0; i < var_count; i++) {
-        if (vars[i].value) {
-             mark(vars[i].value);
+    for (int i = 0; i < vm->ir->nsyms; i++) {
+        if (vm->vars[i]) {
+             mark(vm->vars[i]);
         }
     }
 
+    for (int i = 0; i < vm->lp; i++)
+        mark(vm->locals[i]);
+
     // sweep
     Object **p = &vm->heap;
     while (*p) {
         if (!(*p)->marked) {
             Object *dead = *p;
             *p = dead->next;
-            free(dead);
+            heap_free(vm, dead);
         } else {
             (*p)->marked = false;
             p = &(*p)->next;
@@ -73,26 +110,19 @@ void vm_destroy(VM *vm) {
         curr = next;
     }
     vm->heap = NULL;
-    vm->sp = 0;
-}
-
-static Object* get_var(const char *name) {
-    for (int i = 0; i < var_count; i++)
-        if (strcmp(vars[i].name, name) == 0)
-            return vars[i].value;
-    return NULL;
-}
-
-static void set_var(const char *name, Object *value) {
-    for (int i = 0; i < var_count; i++) {
-        if (strcmp(vars[i].name, name) == 0) {
-            vars[i].value = value;
-            return;
-        }
+    for (Object *o = vm->spare, *next; o; o = next) {
+        next = o->next;
+        free(o);
     }
-    strcpy(vars[var_count].name, name);
-    vars[var_count].value = value;
-    var_count++;
+    vm->spare = NULL;
+    vm->nspare = 0;
+    vm->sp = 0;
+    vm->fp = vm->bp = vm->lp = 0;
+    free(vm->vars);
+    vm->vars = NULL;
+    vm->vars_cap = 0;
+    tier_free(vm->tier);
+    vm->tier = NULL;
 }
 
 
@@ -101,7 +131,7 @@ void vm_report_leaks(VM *vm) {
     int bytes = 0;
     for (Object *o = vm->heap; o; o = o->next) {
         count++;
-        bytes += sizeof(Object);
+        bytes += sizeof(Object) + sizeof(int) * o->length;
     }
     printf("\n--- Leak Report ---\n");
     printf("Leaked objects: %d\n", count);
@@ -113,14 +143,24 @@ void vm_report_leaks(VM *vm) {
    Stack helpers
    ========================= */
 
-static void push(VM *vm, Object *o) {
+/* checked is a constant at every call site: step() is inlined into a
+   checked and a check-free copy, and the second only runs code whose
+   stack depth the range analysis bounded (see ir->max_stack). */
+
+static inline void push(VM *vm, Object *o, const bool checked) {
+    if (checked && vm->sp >= STACK_SIZE) runtime_error("stack overflow");
     vm->stack[vm->sp++] = o;
 }
 
-static Object* pop(VM *vm) {
+static inline Object* pop(VM *vm, const bool checked) {
+    if (checked && vm->sp <= 0) runtime_error("stack underflow");
     return vm->stack[--vm->sp];
 }
 
+static bool stack_proven(VM *vm) {
+    return vm->ir->max_stack >= 0 && vm->ir->max_stack <= STACK_SIZE;
+}
+
 /* =========================
    State printing
    ========================= */
@@ -131,16 +171,396 @@ void vm_print_state(VM *vm) {
     for (int i = 0; i < vm->sp; i++) {
         printf("  [%d] %d\n", i, vm->stack[i]->value);
     }
+    if (vm->fp > 0) {
+        printf("Call depth = %d, frame:\n", vm->fp);
+        for (int i = vm->bp; i < vm->lp; i++)
+            printf("  #%d %d\n", i - vm->bp, vm->locals[i] ? vm->locals[i]->value : 0);
+    }
+}
+
+/* =========================
+   Tier 1: hot loops
+   =========================
+   The interpreter below boxes every value and checks breakpoints and
+   the step budget on each instruction. Backward jumps are counted per
+   loop head; once a head has been reached HOT_LOOP times, the loop
+   (head up to its last backward jump) is translated into a specialized
+   form where values are plain ints, jumps are pre-resolved and common
+   sequences are fused into one instruction. The running VM switches to
+   it at the loop head by unboxing the loop's variables and the operand
+   stack (on-stack replacement), and switches back, boxing whatever
+   changed, when control leaves the loop. Steps are still counted per
+   source instruction, so the watchdog stops at the same point. */
+
+#define HOT_LOOP 50
+#define HEAT_COLD 0xffff        /* loop head that cannot be translated */
+
+enum {
+    T_CONST, T_LOAD, T_STORE, T_INC, T_DUP, T_BINOP,
+    T_LOAD_ELEM, T_STORE_ELEM,
+    T_JMP, T_JZ, T_JNZ, T_NOP, T_EXIT,
+    T_BR_VC,    /* LOAD_VAR a; LOAD_CONST b; CMP; JZ|JNZ c */
+    T_BR_VV,    /* LOAD_VAR a; LOAD_VAR b;   CMP; JZ|JNZ c */
+    T_SET_VC,   /* LOAD_VAR a; LOAD_CONST b; ADD|SUB|MUL; STORE_VAR c */
+    T_SET_VV    /* LOAD_VAR a; LOAD_VAR b;   ADD|SUB|MUL; STORE_VAR c */
+};
+
+typedef struct {
+    unsigned char op;
+    unsigned char sub;      /* IROp of a binop or fused op; 1 if an element access is checked */
+    unsigned char weight;   /* source instructions covered */
+    int a, b, c;            /* c: jump target (code index) or stored slot */
+    int pc;                 /* first source instruction */
+} TInstr;
+
+typedef struct {
+    int head, end;          /* source pcs [head, end] */
+    TInstr *code;
+    int *scalars;           /* slots the loop reads or writes as ints */
+    int nscalars;
+} Region;
+
+struct Tier {
+    unsigned short *heat;   /* by pc: backward jumps taken to it */
+    Region *regions;
+    int nregions, regions_cap;
+
+    /* unboxed state while a region runs */
+    int *vals;              /* by slot */
+    unsigned char *dirty;   /* by slot: stored since entry */
+    int stack[STACK_SIZE];
+};
+
+static bool is_jump(IROp op) {
+    return op == IR_JMP || op == IR_JZ || op == IR_JNZ;
+}
+
+static IROp negate_cmp(IROp op) {
+    switch (op) {
+        case IR_EQ: return IR_NE;
+        case IR_NE: return IR_EQ;
+        case IR_LT: return IR_GE;
+        case IR_GE: return IR_LT;
+        case IR_GT: return IR_LE;
+        default:    return IR_GT;   // IR_LE
+    }
+}
+
+static inline int t_binop(int op, int x, int y) {
+    switch (op) {
+        case IR_ADD: return (int)((unsigned)x + (unsigned)y);
+        case IR_SUB: return (int)((unsigned)x - (unsigned)y);
+        case IR_MUL: return (int)((unsigned)x * (unsigned)y);
+        case IR_DIV:
+            if (y == 0) runtime_error("division by zero");
+            return x / y;
+        case IR_DIV_NZ: return x / y;
+        case IR_EQ: return x == y;
+        case IR_NE: return x != y;
+        case IR_LT: return x < y;
+        case IR_GT: return x > y;
+        case IR_LE: return x <= y;
+        default:    return x >= y;  // IR_GE
+    }
+}
+
+static void tier_free(struct Tier *t) {
+    if (!t) return;
+    for (int i = 0; i < t->nregions; i++) {
+        free(t->regions[i].code);
+        free(t->regions[i].scalars);
+    }
+    free(t->regions);
+    free(t->heat);
+    free(t->vals);
+    free(t->dirty);
+    free(t);
+}
+
+/* LOAD_VAR; LOAD_CONST|LOAD_VAR; op; JZ|JNZ|STORE_VAR at pc, with no
+   jump landing inside. Fills *ti and returns true on a match. */
+static bool fuse(IR *ir, int pc, int end, const bool *target, int head, TInstr *ti) {
+    if (pc + 3 > end) return false;
+    const unsigned char *op = ir->ops + pc;
+    const int *arg = ir->args + pc;
+    if (op[0] != IR_LOAD_VAR || (op[1] != IR_LOAD_CONST && op[1] != IR_LOAD_VAR)) return false;
+    for (int k = 1; k <= 3; k++)
+        if (target[pc + k - head]) return false;
+
+    bool var = op[1] == IR_LOAD_VAR;
+    if (op[2] >= IR_EQ && op[2] <= IR_GE && (op[3] == IR_JZ || op[3] == IR_JNZ)) {
+        ti->op = var ? T_BR_VV : T_BR_VC;
+        ti->sub = (op[3] == IR_JNZ) ? op[2] : negate_cmp((IROp)op[2]);
+    } else if ((op[2] == IR_ADD || op[2] == IR_SUB || op[2] == IR_MUL) && op[3] == IR_STORE_VAR) {
+        ti->op = var ? T_SET_VV : T_SET_VC;
+        ti->sub = op[2];
+    } else {
+        return false;
+    }
+    ti->a = arg[0];
+    ti->b = arg[1];
+    ti->c = arg[3];
+    ti->weight = 4;
+    return true;
+}
+
+/* Translates the loop at head, or returns NULL if it allocates arrays or
+   uses a slot both as an int and as an array */
+static Region *region_build(struct Tier *t, IR *ir, int head) {
+    int end = -1;
+    for (int pc = head; pc < ir->size; pc++)
+        if (is_jump((IROp)ir->ops[pc]) && ir->args[pc] == head) end = pc;
+    if (end < 0) return NULL;
+
+    int n = end - head + 1;
+    bool *target = calloc(n, sizeof(bool));
+    unsigned char *use = calloc(ir->nsyms ? ir->nsyms : 1, 1);   // 1 int, 2 array
+    bool ok = true;
+    for (int pc = head; pc <= end && ok; pc++) {
+        IROp op = (IROp)ir->ops[pc];
+        int arg = ir->args[pc], slot = -1, kind = 1;
+        if (is_jump(op) && arg >= head && arg <= end) target[arg - head] = true;
+        if (op == IR_NEW_ARRAY || op == IR_CALL || op == IR_RET ||
+            op == IR_LOAD_LOCAL || op == IR_STORE_LOCAL) ok = false;
+        else if (op == IR_LOAD_VAR || op == IR_STORE_VAR) slot = arg;
+        else if (op == IR_INC_VAR) slot = ir->pool[arg];
+        else if (op >= IR_LOAD_ELEM && op <= IR_STORE_ELEM_IB) { slot = arg; kind = 2; }
+        if (slot >= 0) {
+            if (use[slot] && use[slot] != kind) ok = false;
+            use[slot] = (unsigned char)kind;
+        }
+    }
+    if (!ok) {
+        free(target);
+        free(use);
+        return NULL;
+    }
+
+    if (t->nregions >= t->regions_cap) {
+        t->regions_cap = t->regions_cap ? t->regions_cap * 2 : 8;
+        t->regions = realloc(t->regions, sizeof(Region) * t->regions_cap);
+    }
+    Region *r = &t->regions[t->nregions++];
+    r->head = head;
+    r->end = end;
+    r->nscalars = 0;
+    r->scalars = malloc(sizeof(int) * (ir->nsyms ? ir->nsyms : 1));
+    for (int s = 0; s < ir->nsyms; s++)
+        if (use[s] == 1) r->scalars[r->nscalars++] = s;
+
+    // one instruction per source instruction at most, plus exits
+    int cap = 2 * n + 1, count = 0;
+    r->code = malloc(sizeof(TInstr) * cap);
+    int *index = malloc(sizeof(int) * n);       // by pc - head: code index
+    for (int pc = head; pc <= end; ) {
+        TInstr ti;
+        memset(&ti, 0, sizeof(ti));
+        ti.pc = pc;
+        ti.weight = 1;
+        index[pc - head] = count;
+
+        if (!fuse(ir, pc, end, target, head, &ti)) {
+            IROp op = (IROp)ir->ops[pc];
+            int arg = ir->args[pc];
+            ti.a = arg;
+            switch (op) {
+                case IR_LOAD_CONST:  ti.op = T_CONST; break;
+                case IR_LOAD_VAR:    ti.op = T_LOAD; break;
+                case IR_STORE_VAR:   ti.op = T_STORE; break;
+                case IR_INC_VAR:     ti.op = T_INC; ti.a = ir->pool[arg]; ti.b = ir->pool[arg + 1]; break;
+                case IR_DUP:         ti.op = T_DUP; break;
+                case IR_LOAD_ELEM:   ti.op = T_LOAD_ELEM; ti.sub = 1; break;
+                case IR_STORE_ELEM:  ti.op = T_STORE_ELEM; ti.sub = 1; break;
+                case IR_LOAD_ELEM_IB:  ti.op = T_LOAD_ELEM; break;
+                case IR_STORE_ELEM_IB: ti.op = T_STORE_ELEM; break;
+                case IR_JMP:         ti.op = T_JMP; ti.c = arg; break;
+                case IR_JZ:          ti.op = T_JZ; ti.c = arg; break;
+                case IR_JNZ:         ti.op = T_JNZ; ti.c = arg; break;
+                case IR_LABEL:
+                case IR_NOP:         ti.op = T_NOP; break;
+                default:             ti.op = T_BINOP; ti.sub = op; break;
+            }
+        }
+        r->code[count++] = ti;
+        pc += ti.weight;
+    }
+
+    // falling off the end leaves the loop
+    TInstr out = { T_EXIT, 0, 0, end + 1, 0, 0, end + 1 };
+    r->code[count++] = out;
+
+    // jumps out of the loop go through an exit of their own
+    int body = count;
+    for (int i = 0; i < body; i++) {
+        TInstr *ti = &r->code[i];
+        bool jumps = ti->op == T_JMP || ti->op == T_JZ || ti->op == T_JNZ ||
+                     ti->op == T_BR_VC || ti->op == T_BR_VV;
+        if (!jumps) continue;
+        if (ti->c >= head && ti->c <= end) {
+            ti->c = index[ti->c - head];
+            continue;
+        }
+        int dest = ti->c, k = body;
+        while (k < count && r->code[k].a != dest) k++;
+        if (k == count) {
+            TInstr x = { T_EXIT, 0, 0, dest, 0, 0, dest };
+            r->code[count++] = x;
+        }
+        ti->c = k;
+    }
+
+    free(index);
+    free(target);
+    free(use);
+    return r;
+}
+
+/* Runs r from its head until control leaves it or the step budget is
+   nearly spent, then hands the VM back at that pc */
+static void region_run(VM *vm, struct Tier *t, Region *r) {
+    for (int pc = r->head; pc <= r->end && pc < MAX_BREAK_PC; pc++)
+        if (vm->breakpoints[pc]) return;
+
+    // an array where the loop expects an int stays with the boxed tier
+    for (int k = 0; k < r->nscalars; k++) {
+        Object *o = vm->vars[r->scalars[k]];
+        if (o && o->length) return;
+    }
+    for (int i = 0; i < vm->sp; i++)
+        if (vm->stack[i]->length) return;
+
+    int *vals = t->vals, *st = t->stack;
+    unsigned char *dirty = t->dirty;
+    Object **vars = vm->vars;
+    for (int k = 0; k < r->nscalars; k++) {
+        int s = r->scalars[k];
+        vals[s] = vars[s] ? vars[s]->value : 0;
+        dirty[s] = 0;
+    }
+    int sp = vm->sp;
+    for (int i = 0; i < sp; i++) st[i] = vm->stack[i]->value;
+
+    const TInstr *code = r->code;
+    int steps = vm->steps, ip = 0, exit_pc;
+    for (;;) {
+        const TInstr *ti = &code[ip];
+        if (steps + ti->weight > MAX_STEPS) {
+            exit_pc = ti->pc;
+            break;
+        }
+        steps += ti->weight;
+        ip++;
+
+        switch (ti->op) {
+            case T_CONST: st[sp++] = ti->a; break;
+            case T_LOAD:  st[sp++] = vals[ti->a]; break;
+            case T_STORE:
+                vals[ti->a] = st[--sp];
+                dirty[ti->a] = 1;
+                break;
+            case T_INC:
+                vals[ti->a] = (int)((unsigned)vals[ti->a] + (unsigned)ti->b);
+                dirty[ti->a] = 1;
+                break;
+            case T_DUP:
+                st[sp] = st[sp - 1];
+                sp++;
+                break;
+            case T_BINOP: {
+                int y = st[--sp];
+                st[sp - 1] = t_binop(ti->sub, st[sp - 1], y);
+                break;
+            }
+            case T_LOAD_ELEM: {
+                Object *a = vars[ti->a];
+                int i = st[sp - 1];
+                if (ti->sub && (!a || (unsigned)i >= (unsigned)a->length))
+                    runtime_error("array index out of bounds");
+                st[sp - 1] = a->elems[i];
+                break;
+            }
+            case T_STORE_ELEM: {
+                Object *a = vars[ti->a];
+                int v = st[--sp];
+                int i = st[--sp];
+                if (ti->sub && (!a || (unsigned)i >= (unsigned)a->length))
+                    runtime_error("array index out of bounds");
+                a->elems[i] = v;
+                break;
+            }
+            case T_JMP: ip = ti->c; break;
+            case T_JZ:  if (st[--sp] == 0) ip = ti->c; break;
+            case T_JNZ: if (st[--sp] != 0) ip = ti->c; break;
+            case T_BR_VC:
+                if (t_binop(ti->sub, vals[ti->a], ti->b)) ip = ti->c;
+                break;
+            case T_BR_VV:
+                if (t_binop(ti->sub, vals[ti->a], vals[ti->b])) ip = ti->c;
+                break;
+            case T_SET_VC:
+                vals[ti->c] = t_binop(ti->sub, vals[ti->a], ti->b);
+                dirty[ti->c] = 1;
+                break;
+            case T_SET_VV:
+                vals[ti->c] = t_binop(ti->sub, vals[ti->a], vals[ti->b]);
+                dirty[ti->c] = 1;
+                break;
+            case T_NOP: break;
+            case T_EXIT:
+                exit_pc = ti->a;
+                goto done;
+        }
+    }
+
+done:
+    for (int k = 0; k < r->nscalars; k++) {
+        int s = r->scalars[k];
+        if (dirty[s]) vars[s] = heap_alloc(vm, vals[s]);
+    }
+    for (int i = 0; i < sp; i++) vm->stack[i] = heap_alloc(vm, st[i]);
+    vm->sp = sp;
+    vm->steps = steps;
+    vm->pc = exit_pc;
+}
+
+/* A backward jump to head was just taken */
+static void tier_backedge(VM *vm, int head) {
+    struct Tier *t = vm->tier;
+    IR *ir = vm->ir;
+    if (!t) {
+        t = vm->tier = calloc(1, sizeof(struct Tier));
+        t->heat = calloc(ir->size, sizeof(unsigned short));
+        t->vals = malloc(sizeof(int) * (ir->nsyms ? ir->nsyms : 1));
+        t->dirty = malloc(ir->nsyms ? ir->nsyms : 1);
+    }
+
+    unsigned short *heat = &t->heat[head];
+    if (*heat == HEAT_COLD) return;
+    if (*heat < HOT_LOOP) {
+        (*heat)++;
+        return;
+    }
+
+    Region *r = NULL;
+    for (int i = 0; i < t->nregions && !r; i++)
+        if (t->regions[i].head == head) r = &t->regions[i];
+    if (!r) r = region_build(t, ir, head);
+    if (!r) {
+        *heat = HEAT_COLD;
+        return;
+    }
+    region_run(vm, t, r);
 }
 
 /* =========================
    Single step
    ========================= */
 
-bool vm_step(VM *vm) {
+/* tiered: backward jumps count towards tier 1; only the full run uses it */
+static inline __attribute__((always_inline)) bool step(VM *vm, const bool checked, const bool tiered) {
     if (vm->pc >= vm->ir->size) return false;
 
-    if (vm->breakpoints[vm->pc]) {
+    if (vm->pc < MAX_BREAK_PC && vm->breakpoints[vm->pc]) {
         printf("Breakpoint hit at IR[%d]\n", vm->pc);
         return false;
     }
@@ -150,107 +570,217 @@ bool vm_step(VM *vm) {
         return false;
     }
 
-    IRInstr instr = vm->ir->instructions[vm->pc++];
+    IR *ir = vm->ir;
+    int pc = vm->pc;
+    IROp op = (IROp)ir->ops[pc];
+    int arg = ir->args[pc];
+    vm->pc++;
 
-    switch (instr.op) {
+    switch (op) {
 
         case IR_LOAD_CONST:
-            push(vm, heap_alloc(vm, instr.value));
+            push(vm, heap_alloc(vm, arg), checked);
             break;
 
         case IR_ADD: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value + b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value + b->value), checked);
             break;
         }
 
         case IR_SUB: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value - b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value - b->value), checked);
             break;
         }
 
         case IR_MUL: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value * b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value * b->value), checked);
             break;
         }
 
         case IR_DIV: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            if (b->value == 0) {
-                printf("Runtime Error: division by zero\n");
-                exit(1);
-            }
-            push(vm, heap_alloc(vm, a->value / b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            if (b->value == 0) runtime_error("division by zero");
+            push(vm, heap_alloc(vm, a->value / b->value), checked);
+            break;
+        }
+
+        case IR_DIV_NZ: {
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value / b->value), checked);
             break;
         }
 
         case IR_EQ: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value == b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value == b->value), checked);
             break;
         }
         case IR_NE: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value != b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value != b->value), checked);
             break;
         }
         case IR_LT: {
-            Object *b = pop(vm); // Second operand is at top of stack
-            Object *a = pop(vm); // First operand is below it
-            push(vm, heap_alloc(vm, a->value < b->value));
+            Object *b = pop(vm, checked); // Second operand is at top of stack
+            Object *a = pop(vm, checked); // First operand is below it
+            push(vm, heap_alloc(vm, a->value < b->value), checked);
             break;
         }
         case IR_GT: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value > b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value > b->value), checked);
             break;
         }
         case IR_LE: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value <= b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value <= b->value), checked);
             break;
         }
         case IR_GE: {
-            Object *b = pop(vm);
-            Object *a = pop(vm);
-            push(vm, heap_alloc(vm, a->value >= b->value));
+            Object *b = pop(vm, checked);
+            Object *a = pop(vm, checked);
+            push(vm, heap_alloc(vm, a->value >= b->value), checked);
             break;
         }
 
         case IR_JMP:
-            vm->pc = instr.value;
+            vm->pc = arg;
+            if (tiered && arg <= pc) tier_backedge(vm, arg);
             break;
 
         case IR_JZ: {
-            Object *v = pop(vm);
-            if (v->value == 0)
-                vm->pc = instr.value;
+            Object *v = pop(vm, checked);
+            if (v->value == 0) {
+                vm->pc = arg;
+                if (tiered && arg <= pc) tier_backedge(vm, arg);
+            }
             break;
         }
 
-        case IR_LOAD_VAR:
-            Object *v = get_var(instr.name);
+        case IR_JNZ: {
+            Object *v = pop(vm, checked);
+            if (v->value != 0) {
+                vm->pc = arg;
+                if (tiered && arg <= pc) tier_backedge(vm, arg);
+            }
+            break;
+        }
+
+        case IR_DUP: {
+            Object *top = pop(vm, checked);
+            push(vm, top, checked);
+            push(vm, top, checked);
+            break;
+        }
+
+        case IR_INC_VAR: {
+            int slot = ir->pool[arg];
+            Object *v = vm->vars[slot];
+            unsigned old = v ? (unsigned)v->value : 0;
+            vm->vars[slot] = heap_alloc(vm, (int)(old + (unsigned)ir->pool[arg + 1]));
+            break;
+        }
+
+        case IR_LOAD_VAR: {
+            Object *v = vm->vars[arg];
             if (!v) v = heap_alloc(vm, 0);
-            push(vm, v);
+            push(vm, v, checked);
             break;
+        }
 
         case IR_STORE_VAR: {
-            Object *v = pop(vm);
-            set_var(instr.name, v);
+            Object *v = pop(vm, checked);
+            vm->vars[arg] = v;
+            break;
+        }
+
+        case IR_NEW_ARRAY:
+            vm->vars[ir->pool[arg]] = heap_alloc_array(vm, ir->pool[arg + 1]);
+            break;
+
+        case IR_LOAD_ELEM: {
+            Object *i = pop(vm, checked);
+            Object *a = vm->vars[arg];
+            if (!a || (unsigned)i->value >= (unsigned)a->length)
+                runtime_error("array index out of bounds");
+            push(vm, heap_alloc(vm, a->elems[i->value]), checked);
+            break;
+        }
+
+        case IR_LOAD_ELEM_IB: {
+            Object *i = pop(vm, checked);
+            push(vm, heap_alloc(vm, vm->vars[arg]->elems[i->value]), checked);
             break;
         }
 
+        case IR_STORE_ELEM: {
+            Object *v = pop(vm, checked);
+            Object *i = pop(vm, checked);
+            Object *a = vm->vars[arg];
+            if (!a || (unsigned)i->value >= (unsigned)a->length)
+                runtime_error("array index out of bounds");
+            a->elems[i->value] = v->value;
+            break;
+        }
+
+        case IR_STORE_ELEM_IB: {
+            Object *v = pop(vm, checked);
+            Object *i = pop(vm, checked);
+            vm->vars[arg]->elems[i->value] = v->value;
+            break;
+        }
+
+        case IR_CALL: {
+            const int *f = &ir->pool[arg];      // entry, parameters, frame slots
+            if (vm->fp >= MAX_FRAMES || vm->lp + f[2] > MAX_LOCALS)
+                runtime_error("call stack overflow");
+            Frame *fr = &vm->frames[vm->fp++];
+            fr->ret = vm->pc;
+            fr->bp = vm->bp;
+            vm->bp = vm->lp;
+            vm->lp += f[2];
+            for (int i = f[1] - 1; i >= 0; i--)
+                vm->locals[vm->bp + i] = pop(vm, checked);
+            for (int i = f[1]; i < f[2]; i++)
+                vm->locals[vm->bp + i] = NULL;
+            vm->pc = f[0];
+            break;
+        }
+
+        case IR_RET: {
+            if (checked && vm->fp == 0) runtime_error("return outside a procedure");
+            Frame *fr = &vm->frames[--vm->fp];
+            vm->lp = vm->bp;
+            vm->bp = fr->bp;
+            vm->pc = fr->ret;
+            break;
+        }
+
+        case IR_LOAD_LOCAL: {
+            Object *v = vm->locals[vm->bp + arg];
+            if (!v) v = heap_alloc(vm, 0);
+            push(vm, v, checked);
+            break;
+        }
+
+        case IR_STORE_LOCAL:
+            vm->locals[vm->bp + arg] = pop(vm, checked);
+            break;
+
         case IR_LABEL:
+        case IR_NOP:
             break;
 
         default:
@@ -261,12 +791,21 @@ bool vm_step(VM *vm) {
     return true;
 }
 
+bool vm_step(VM *vm) {
+    return stack_proven(vm) ? step(vm, false, false) : step(vm, true, false);
+}
+
 /* =========================
    Full run
    ========================= */
 
 void vm_executor(VM *vm) {
-    while (vm_step(vm)) {}
+    // tier 1 drops the stack checks, so it needs a proven stack depth
+    if (stack_proven(vm)) {
+        while (step(vm, false, true)) {}
+    } else {
+        while (step(vm, true, false)) {}
+    }
     gc_collect(vm);
     vm_report_leaks(vm);
 }
@@ -319,14 +858,12 @@ void vm_debug(VM *vm) {
         else if (!strncmp(cmd, "break ", 6)) {
             int target_line = atoi(cmd + 6);
             int found = 0;
-            // Scan IR for the first instruction matching the line
-            for(int i=0; i<vm->ir->size; i++) {
-                if(vm->ir->instructions[i].line == target_line) {
-                    vm->breakpoints[i] = true;
-                    printf("Breakpoint set at line %d (IP=%d)\n", target_line, i);
-                    found = 1;
-                    break; // Only set on the first instruction of that line
-                }
+            // Breaks on the first instruction of that line
+            int i = ir_first_pc_of_line(vm->ir, target_line);
+            if (i >= 0 && i < MAX_BREAK_PC) {
+                vm->breakpoints[i] = true;
+                printf("Breakpoint set at line %d (IP=%d)\n", target_line, i);
+                found = 1;
             }
             if (!found) printf("No instruction found for line %d\n", target_line);
         }
@@ -358,5 +895,115 @@ void vm_debug(VM *vm) {
 void vm_init(VM *vm, IR *ir) {
     memset(vm, 0, sizeof(VM));
     vm->ir = ir;
-    var_count = 0;
+    vm->vars_cap = ir->nsyms ? ir->nsyms : 1;
+    vm->vars = calloc(vm->vars_cap, sizeof(Object*));
+}
+
+/* =========================
+   VM pool
+   =========================
+   Only the shell's main thread runs VMs, so the pool needs no lock. */
+
+static struct {
+    VM *idle[POOL_MAX];
+    int nidle;
+    int target;                 /* idle VMs to keep */
+    int in_use, window_peak;
+    int window_acquires;
+
+    long acquired, reused, returned, dropped;
+} pool;
+
+/* Ready vm, which ran some earlier program, for ir: only the state a run
+   reads is reset. The operand stack and frame slots are written before
+   they are read, and the spare objects stay. */
+static void vm_reuse(VM *vm, IR *ir) {
+    int n = ir->nsyms ? ir->nsyms : 1;
+    if (n > vm->vars_cap) {
+        free(vm->vars);
+        vm->vars = malloc(sizeof(Object*) * (size_t)n);
+        vm->vars_cap = n;
+    }
+    memset(vm->vars, 0, sizeof(Object*) * (size_t)n);
+    memset(vm->breakpoints, 0, sizeof(vm->breakpoints));
+    vm->ir = ir;
+    vm->pc = 0;
+    vm->steps = 0;
+}
+
+VM *vm_acquire(IR *ir) {
+    pool.acquired++;
+    pool.in_use++;
+    if (pool.in_use > pool.window_peak) pool.window_peak = pool.in_use;
+    if (pool.window_peak > pool.target)
+        pool.target = pool.window_peak < POOL_MAX ? pool.window_peak : POOL_MAX;
+
+    // Shrink to what the last window needed at once
+    if (++pool.window_acquires == POOL_WINDOW) {
+        pool.target = pool.window_peak < POOL_MAX ? pool.window_peak : POOL_MAX;
+        pool.window_peak = pool.in_use;
+        pool.window_acquires = 0;
+        while (pool.nidle > pool.target) {
+            VM *vm = pool.idle[--pool.nidle];
+            vm_destroy(vm);
+            free(vm);
+        }
+    }
+
+    if (pool.nidle > 0) {
+        VM *vm = pool.idle[--pool.nidle];
+        vm_reuse(vm, ir);
+        pool.reused++;
+        return vm;
+    }
+
+    VM *vm = malloc(sizeof(VM));
+    vm_init(vm, ir);
+    return vm;
+}
+
+void vm_release(VM *vm) {
+    if (!vm) return;
+    pool.in_use--;
+
+    if (pool.nidle >= pool.target) {
+        pool.dropped++;
+        vm_destroy(vm);
+        free(vm);
+        return;
+    }
+
+    // Keep the vars table and recycle the heap's scalars as spares
+    Object *curr = vm->heap;
+    while (curr) {
+        Object *next = curr->next;
+        heap_free(vm, curr);
+        curr = next;
+    }
+    vm->heap = NULL;
+    vm->sp = 0;
+    vm->fp = vm->bp = vm->lp = 0;
+    tier_free(vm->tier);
+    vm->tier = NULL;
+    vm->ir = NULL;
+
+    pool.idle[pool.nidle++] = vm;
+    pool.returned++;
+}
+
+void vm_pool_print_stats() {
+    printf("--- VM Pool ---\n");
+    printf("%-16s %ld\n", "acquired", pool.acquired);
+    printf("%-16s %ld\n", "reused", pool.reused);
+    if (pool.acquired)
+        printf("%-16s %ld%%\n", "reuse-rate", pool.reused * 100 / pool.acquired);
+    printf("%-16s %ld\n", "returned", pool.returned);
+    printf("%-16s %ld\n", "dropped", pool.dropped);
+    printf("%-16s %d\n", "in-use", pool.in_use);
+    printf("%-16s %d / %d\n", "idle", pool.nidle, pool.target);
+    printf("---------------\n");
+}
+
+void vm_pool_reset_stats() {
+    pool.acquired = pool.reused = pool.returned = pool.dropped = 0;
 }
@@ -4,12 +4,27 @@
 #include <stdbool.h>
 #include "../core/ir.h"
 
+/* An array is a single object: its elements are plain ints stored
+   inline, so the GC marks and frees the whole buffer at once */
 typedef struct Object {
     int value;
     bool marked;
     struct Object *next;
+    int length;             /* array elements, 0 for a scalar */
+    int elems[];
 } Object;
 
+#define MAX_FRAMES 1024
+#define MAX_LOCALS 16384
+
+/* A procedure call: where to return, and the caller's frame base.
+   Frames and their slots are stacks inside the VM, so a call allocates
+   nothing. */
+typedef struct {
+    int ret;
+    int bp;
+} Frame;
+
 typedef struct VM{
     IR *ir;
     int pc;
@@ -18,9 +33,20 @@ typedef struct VM{
     int sp;
 
     Object *heap;
+    Object *spare;          /* freed scalars, reused before malloc */
+    int nspare;
+    Object **vars;          /* by slot: ir->nsyms entries */
+    int vars_cap;
+
+    Frame frames[MAX_FRAMES];
+    int fp;
+    Object *locals[MAX_LOCALS];     /* frame slots of every active call */
+    int bp, lp;                     /* current frame's first slot, first free slot */
 
     bool breakpoints[10000];
     int steps;
+
+    struct Tier *tier;      /* hot-loop counters and translated loops */
 } VM;
 
 void vm_init(VM *vm, IR *ir);
@@ -32,4 +58,15 @@ void vm_report_leaks(VM *vm);
 void gc_collect(VM *vm);
 void vm_destroy(VM *vm); // New function to clean up VM memory
 
+/* VM pool: a VM is big (its operand stack, frames and locals are inline
+   arrays), so the shell recycles them instead of a malloc/free per
+   program. vm_acquire hands out a VM initialized for ir, reusing an idle
+   one whose pages and spare objects are already warm; vm_release drops
+   the program's state and keeps the VM for the next acquire. The pool
+   keeps as many idle VMs as were recently in use at once. */
+VM *vm_acquire(IR *ir);
+void vm_release(VM *vm);
+void vm_pool_print_stats();
+void vm_pool_reset_stats();
+
 #endif
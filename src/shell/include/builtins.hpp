@@ -13,3 +13,16 @@ bool is_builtin(const Command &cmd);
 bool run_builtin(const Command &cmd);
 
 bool handle_program_commands(std::vector<std::string>& args);
+
+// Program commands that can run as a stage of a pipeline or with a
+// redirection (see execute_command): all of them but `debug`, which
+// needs the terminal.
+bool is_program_stage(const std::vector<std::string>& argv);
+
+// Exit status of the last builtin or program command: 0 on success,
+// 1 when it failed (bad usage, unknown PID, failed compile, halted run).
+int builtin_status();
+
+// PID named by the last submit or single-program command, or -1 if there
+// was none since the previous call.
+int take_program_pid();
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vector>
+
+#include "../../core/program.h"
+
+// Compiles the given programs on a pool of worker threads, one per core,
+// then prints per-program timings and failures plus total wall time
+// against total CPU time. Each program must appear at most once.
+void compile_batch(const std::vector<Program *> &programs);
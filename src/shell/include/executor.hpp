@@ -14,6 +14,16 @@ void initialize_executor();
 // Process background job status changes.
 void reap_background_jobs();
 
+// Blocks until fd (the shell's input) is readable. Job status changes
+// that arrive meanwhile are handled at once; returns false after one of
+// them printed a notification, so the caller can redraw its prompt and
+// wait again.
+bool wait_for_input(int fd);
+
+// Exit status of the last foreground pipeline: its final command's exit
+// code, or 128 + the signal number that killed it.
+int last_exit_status();
+
 // Job-control helpers for builtins.
 void print_jobs();
 bool foreground_job(int job_id);
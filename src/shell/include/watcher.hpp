@@ -0,0 +1,26 @@
+#pragma once
+
+#include <map>
+
+#include "../../core/program.h"
+
+// Starts watching p's source file. Whenever the file is written or
+// replaced, a background thread recompiles it and parks the new IR until
+// the shell installs it between commands. Returns false if the file's
+// directory cannot be watched.
+bool watch_program(Program *p);
+
+// Stops watching and drops any IR that was not installed yet.
+void unwatch_program(int pid);
+
+// Swaps every parked IR into its program. Called by the shell between
+// commands, so a program never changes while it runs; the program's VM is
+// discarded and the next run starts from the new code.
+void watch_install_pending(std::map<int, Program *> &programs);
+
+// Prints what the watcher did since the last call, compile errors
+// included. Called by the shell before each command line, while stdout
+// is still its own rather than a command's pipe or file.
+void watch_print_reports();
+
+void print_watches();
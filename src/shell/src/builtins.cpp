@@ -1,6 +1,7 @@
 #include "../include/builtins.hpp"
 #include <iostream>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <cstdlib>
 #include <cctype>
 #include <algorithm>
@@ -11,10 +12,17 @@ extern "C" {
 #include "../../core/program.h"
 #include "../../core/compiler.h"
 #include "../../core/ir.h"
+#include "../../core/peephole.h"
+#include "../../core/range.h"
+#include "../../core/mir.h"
+#include "../../core/ir_cache.h"
+#include "../../core/ir_io.h"
 #include "../../debugger/vm_debug.h"
 }
 
 #include "../include/executor.hpp"
+#include "../include/compile_pool.hpp"
+#include "../include/watcher.hpp"
 
 using namespace std;
 
@@ -31,26 +39,21 @@ bool is_builtin(const Command &cmd) {
             name == "jobs" ||
             name == "fg" ||
             name == "bg" ||
-            name == "export" ||
-
-            // ✅ Program builtins
-            name == "submit" ||
-            name == "list" ||
-            name == "run" ||
-            name == "kill" ||
-
-            // ✅ Add Memory Management Commands
-            name == "memstat" ||
-            name == "gc" ||
-            name == "leaks" ||
-
-            // ✅ Phase2 new commands
-            name == "compile" ||
-            name == "ir");
+            name == "export");
+
+    // Program commands (submit, run, ir, ...) never get here: the shell
+    // hands them to handle_program_commands, or to execute_command as
+    // in-process stages when piped or redirected (is_program_stage)
 }
 
 namespace {
 
+// Exit status of the last builtin or program command
+int last_status = 0;
+
+// PID the last program command named, -1 once taken
+int last_pid = -1;
+
 int parse_job_id(const vector<string> &argv, const string &cmd_name) {
     int job_id = latest_job_id();
 
@@ -96,15 +99,27 @@ bool is_valid_var_name(const std::string &name) {
 
 } // namespace
 
+// Digits only, and few enough that stoi cannot overflow
 bool is_number(const string& s) {
-    if (s.empty()) return false;
+    if (s.empty() || s.size() > 9) return false;
     for (char c : s) {
         if (!isdigit(c)) return false;
     }
     return true;
 }
 
+int builtin_status() {
+    return last_status;
+}
+
+int take_program_pid() {
+    int pid = last_pid;
+    last_pid = -1;
+    return pid;
+}
+
 bool run_builtin(const Command &cmd) {
+    last_status = 0;
     if (cmd.commands.empty() || cmd.commands.front().argv.empty()) {
         return true;
     }
@@ -141,11 +156,13 @@ bool run_builtin(const Command &cmd) {
             if (!is_valid_var_name(var)) {
                 cerr << "export: `" << var
                      << "': not a valid identifier\n";
+                last_status = 1;
                 continue;
             }
 
             if (setenv(var.c_str(), value.c_str(), 1) != 0) {
                 perror("export");
+                last_status = 1;
             }
         }
 
@@ -166,16 +183,20 @@ bool run_builtin(const Command &cmd) {
     // ---------------- FG ----------------
     if (name == "fg") {
         int job_id = parse_job_id(simple.argv, "fg");
-        if (job_id < 0) return true;
-        if (!foreground_job(job_id)) cerr << "fg: no such job\n";
+        if (job_id < 0 || !foreground_job(job_id)) {
+            if (job_id >= 0) cerr << "fg: no such job\n";
+            last_status = 1;
+        }
         return true;
     }
 
     // ---------------- BG ----------------
     if (name == "bg") {
         int job_id = parse_job_id(simple.argv, "bg");
-        if (job_id < 0) return true;
-        if (!background_job(job_id)) cerr << "bg: no such job\n";
+        if (job_id < 0 || !background_job(job_id)) {
+            if (job_id >= 0) cerr << "bg: no such job\n";
+            last_status = 1;
+        }
         return true;
     }
 
@@ -187,16 +208,21 @@ bool run_builtin(const Command &cmd) {
             path = getenv("HOME");
             if (!path) {
                 cerr << "cd: HOME not set\n";
+                last_status = 1;
                 return true;
             }
         } else if (simple.argv.size() == 2) {
             path = simple.argv[1].c_str();
         } else {
             cerr << "cd: too many arguments\n";
+            last_status = 1;
             return true;
         }
 
-        if (chdir(path) != 0) perror("cd");
+        if (chdir(path) != 0) {
+            perror("cd");
+            last_status = 1;
+        }
         return true;
     }
 
@@ -210,18 +236,56 @@ bool run_builtin(const Command &cmd) {
 extern std::map<int, Program*> program_table;
 extern int next_pid;
 
+// PID of a live program running path's .edmc file in place, or -1
+static int program_mapping(const string &path) {
+    struct stat target;
+    if (stat(path.c_str(), &target) != 0) return -1;
+    for (auto& [pid, p] : program_table) {
+        struct stat st;
+        if (p->ir && p->ir->map && stat(p->source_path, &st) == 0 &&
+            st.st_dev == target.st_dev && st.st_ino == target.st_ino)
+            return pid;
+    }
+    return -1;
+}
+
+bool is_program_stage(const std::vector<std::string>& argv) {
+    if (argv.empty()) return false;
+    const string &name = argv[0];
+    return (name == "submit" || name == "list" || name == "compile" ||
+            name == "ir" || name == "watch" || name == "unwatch" ||
+            name == "emit" || name == "optstats" || name == "cache" ||
+            name == "run" || name == "memstat" || name == "leaks" ||
+            name == "gc" || name == "kill");
+}
+
 bool handle_program_commands(std::vector<std::string>& args) {
+    last_status = 0;
+
+    // Recompiled sources take effect between commands, never mid-run
+    watch_install_pending(program_table);
 
     // ---------------- SUBMIT ----------------
     if (args[0] == "submit") {
         if (args.size() < 2) {
             cout << "Usage: submit <file>\n";
+            last_status = 1;
             return true;
         }
 
-        Program* p = program_create(next_pid++, args[1].c_str());
+        Program* p = program_create(next_pid, args[1].c_str());
+
+        // Bytecode is already linked: load it now so a bad file is refused
+        if (compiler_is_bytecode(p->source_path) && !compile_program(p)) {
+            program_destroy(p);
+            last_status = 1;
+            return true;
+        }
+
+        next_pid++;
         program_table[p->pid] = p;
 
+        last_pid = p->pid;
         cout << "PID = " << p->pid << "\n";
         return true;
     }
@@ -237,14 +301,56 @@ bool handle_program_commands(std::vector<std::string>& args) {
     // ---------------- COMPILE ----------------
     if (args[0] == "compile") {
         if (args.size() < 2) {
-            cout << "Usage: compile <pid>\n";
+            cout << "Usage: compile <pid> | compile <pid...> | compile all\n";
+            last_status = 1;
+            return true;
+        }
+
+        // Batch: every SUBMITTED program, or a list of pids, on a thread pool
+        if (args[1] == "all" || args.size() > 2) {
+            vector<Program*> batch;
+            if (args[1] == "all") {
+                for (auto& [pid, p] : program_table) {
+                    if (p->state == PROGRAM_SUBMITTED && p->ir == nullptr)
+                        batch.push_back(p);
+                }
+            } else {
+                for (size_t i = 1; i < args.size(); i++) {
+                    if (!is_number(args[i])) {
+                        cout << "PID must be a number: " << args[i] << "\n";
+                        last_status = 1;
+                        continue;
+                    }
+                    int pid = stoi(args[i]);
+                    auto it = program_table.find(pid);
+                    if (it == program_table.end()) {
+                        cout << "No such program with PID " << pid << "\n";
+                        last_status = 1;
+                    } else if (it->second->ir != nullptr) {
+                        cout << "PID " << pid << " is already compiled\n";
+                    } else if (find(batch.begin(), batch.end(), it->second) == batch.end()) {
+                        batch.push_back(it->second);
+                    }
+                }
+            }
+            compile_batch(batch);
+            for (Program *p : batch) {
+                if (p->ir == nullptr) last_status = 1;
+            }
             return true;
         }
 
+        if (!is_number(args[1])) {
+            cout << "PID must be a number: " << args[1] << "\n";
+            last_status = 1;
+            return true;
+        }
         int pid = stoi(args[1]);
+        last_pid = pid;
 
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program with PID " << pid << "\n";
+            last_status = 1;
             return true;
         }
 
@@ -254,6 +360,7 @@ bool handle_program_commands(std::vector<std::string>& args) {
 
         if (!compile_program(p)) {
             cout << "Compilation failed.\n";
+            last_status = 1;
             return true;
         }
 
@@ -263,13 +370,16 @@ bool handle_program_commands(std::vector<std::string>& args) {
 
     // ---------------- IR ----------------
     if (args[0] == "ir") {
-        if (args.size() < 2) {
+        if (args.size() < 2 || !is_number(args[1])) {
             cout << "Usage: ir <pid>" << endl;
+            last_status = 1;
             return true;
         }
         int pid = stoi(args[1]);
+        last_pid = pid;
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program with PID " << pid << endl;
+            last_status = 1;
             return true;
         }
 
@@ -278,6 +388,7 @@ bool handle_program_commands(std::vector<std::string>& args) {
         /* ✅ FIX 2: Correct pointer check for IR */
         if (p->ir == nullptr) {
             cout << "Program not compiled yet. Run: compile " << pid << endl;
+            last_status = 1;
         } else {
             cout << "IR for Program " << pid << ":" << endl;
             ir_dump(p->ir); 
@@ -285,12 +396,141 @@ bool handle_program_commands(std::vector<std::string>& args) {
         return true;
     }
 
+    // ---------------- WATCH ----------------
+    if (args[0] == "watch" || args[0] == "unwatch") {
+        if (args.size() == 1 && args[0] == "watch") {
+            print_watches();
+            return true;
+        }
+        if (args.size() != 2 || !is_number(args[1])) {
+            cout << "Usage: " << args[0] << " <pid>\n";
+            last_status = 1;
+            return true;
+        }
+        int pid = stoi(args[1]);
+        last_pid = pid;
+        if (program_table.find(pid) == program_table.end()) {
+            cout << "No such program with PID " << pid << "\n";
+            last_status = 1;
+            return true;
+        }
+
+        if (args[0] == "unwatch") {
+            unwatch_program(pid);
+            cout << "Stopped watching PID " << pid << "\n";
+        } else if (watch_program(program_table[pid])) {
+            cout << "Watching " << program_table[pid]->source_path << " for PID " << pid << "\n";
+        } else {
+            last_status = 1;
+        }
+        return true;
+    }
+
+    // ---------------- EMIT ----------------
+    if (args[0] == "emit") {
+        if (args.size() != 3 || !is_number(args[1])) {
+            cout << "Usage: emit <pid> <file.edmc>\n";
+            last_status = 1;
+            return true;
+        }
+        int pid = stoi(args[1]);
+        last_pid = pid;
+        if (program_table.find(pid) == program_table.end()) {
+            cout << "No such program with PID " << pid << "\n";
+            last_status = 1;
+            return true;
+        }
+
+        Program* p = program_table[pid];
+        if (p->ir == nullptr) {
+            cout << "Program not compiled yet. Run: compile " << pid << "\n";
+            last_status = 1;
+            return true;
+        }
+        int user = program_mapping(args[2]);
+        if (user >= 0) {
+            cout << args[2] << " is in use by PID " << user << "\n";
+            last_status = 1;
+            return true;
+        }
+        if (!ir_save(p->ir, args[2].c_str())) {
+            perror(args[2].c_str());
+            last_status = 1;
+            return true;
+        }
+        cout << "Wrote " << p->ir->size << " instructions to " << args[2] << "\n";
+        return true;
+    }
+
+    // ---------------- OPTSTATS ----------------
+    if (args[0] == "optstats") {
+        if (args.size() > 1 && args[1] == "reset") {
+            mir_reset_stats();
+            peephole_reset_stats();
+            range_reset_stats();
+            vm_pool_reset_stats();
+            cout << "Optimizer statistics cleared.\n";
+            return true;
+        }
+        mir_print_stats();
+        peephole_print_stats();
+        range_print_stats();
+        vm_pool_print_stats();
+        return true;
+    }
+
+    // ---------------- CACHE ----------------
+    if (args[0] == "cache") {
+        if (args.size() > 1 && args[1] == "reset") {
+            ir_cache_reset_stats();
+            cout << "Cache statistics cleared.\n";
+            return true;
+        }
+        if (args.size() > 1 && args[1] == "evict") {
+            long max_kb = 0;
+            if (args.size() > 2) {
+                if (!is_number(args[2])) {
+                    cout << "Usage: cache evict [max-KB]\n";
+                    last_status = 1;
+                    return true;
+                }
+                max_kb = stol(args[2]);
+            }
+            int removed = ir_cache_evict(max_kb * 1024);
+            cout << "Evicted " << removed << " cache entr" << (removed == 1 ? "y" : "ies") << "\n";
+            return true;
+        }
+        if (args.size() > 1) {
+            cout << "Usage: cache | cache evict [max-KB] | cache reset\n";
+            last_status = 1;
+            return true;
+        }
+
+        IRCacheStats s = ir_cache_stats();
+        int entries;
+        long bytes;
+        ir_cache_usage(&entries, &bytes);
+        long lookups = s.hits + s.misses;
+
+        cout << "Compile cache: " << ir_cache_dir() << "\n";
+        cout << "  entries:  " << entries << " (" << (bytes + 1023) / 1024 << " KB)\n";
+        cout << "  hits:     " << s.hits << "\n";
+        cout << "  misses:   " << s.misses << "\n";
+        if (lookups)
+            cout << "  hit rate: " << (s.hits * 100 / lookups) << "%\n";
+        cout << "  stores:   " << s.stores << "\n";
+        cout << "  errors:   " << s.errors << "\n";
+        return true;
+    }
+
 // ---------------- RUN ----------------
     if (args[0] == "run") {
-        if (args.size() < 2) { cout << "Usage: run <pid>\n"; return true; }
+        if (args.size() < 2 || !is_number(args[1])) { cout << "Usage: run <pid>\n"; last_status = 1; return true; }
         int pid = stoi(args[1]);
+        last_pid = pid;
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program with PID " << pid << "\n";
+            last_status = 1;
             return true;
         }
 
@@ -298,13 +538,12 @@ bool handle_program_commands(std::vector<std::string>& args) {
 
         // Compile if needed
         if (p->ir == nullptr) {
-            if (!compile_program(p)) { cout << "Compilation failed.\n"; return true; }
+            if (!compile_program(p)) { cout << "Compilation failed.\n"; last_status = 1; return true; }
         }
 
         // ✅ Initialize Persistent VM if needed
         if (p->vm == nullptr) {
-            p->vm = (VM*)malloc(sizeof(VM));
-            vm_init(p->vm, p->ir);
+            p->vm = vm_acquire(p->ir);
         } else {
             // Optional: Reset VM if re-running
             // vm_init(p->vm, p->ir); 
@@ -318,21 +557,25 @@ bool handle_program_commands(std::vector<std::string>& args) {
         
         // Mark as terminated or paused depending on implementation
         p->state = PROGRAM_TERMINATED; 
+        if (p->vm->pc < p->ir->size) last_status = 1;  // halted before the end
         return true;
     }
 
     // ---------------- MEMSTAT / LEAKS ----------------
     if (args[0] == "memstat" || args[0] == "leaks") {
-        if (args.size() < 2) { cout << "Usage: " << args[0] << " <pid>\n"; return true; }
+        if (args.size() < 2 || !is_number(args[1])) { cout << "Usage: " << args[0] << " <pid>\n"; last_status = 1; return true; }
         int pid = stoi(args[1]);
+        last_pid = pid;
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program.\n";
+            last_status = 1;
             return true;
         }
         
         Program* p = program_table[pid];
         if (p->vm == nullptr) {
             cout << "Program has not been run yet (no memory state).\n";
+            last_status = 1;
         } else {
             vm_report_leaks(p->vm);
         }
@@ -341,16 +584,19 @@ bool handle_program_commands(std::vector<std::string>& args) {
 
     // ---------------- GC ----------------
     if (args[0] == "gc") {
-        if (args.size() < 2) { cout << "Usage: gc <pid>\n"; return true; }
+        if (args.size() < 2 || !is_number(args[1])) { cout << "Usage: gc <pid>\n"; last_status = 1; return true; }
         int pid = stoi(args[1]);
+        last_pid = pid;
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program.\n";
+            last_status = 1;
             return true;
         }
 
         Program* p = program_table[pid];
         if (p->vm == nullptr) {
             cout << "Program has not been run yet.\n";
+            last_status = 1;
         } else {
             cout << "Running Garbage Collector on PID " << pid << "...\n";
             gc_collect(p->vm);
@@ -363,23 +609,28 @@ bool handle_program_commands(std::vector<std::string>& args) {
     if (args[0] == "kill") {
         if (args.size() < 2) {
             cout << "Usage: kill <pid>\n";
+            last_status = 1;
             return true;
         }
 
         if (!is_number(args[1])) {
             cout << "PID must be a number\n";
+            last_status = 1;
             return true;
         }
 
 
         int pid = stoi(args[1]);
+        last_pid = pid;
 
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program with PID " << pid << "\n";
+            last_status = 1;
             return true;
         }
 
         // ✅ Fix: Use the correct function name defined in program.h/c
+        unwatch_program(pid);
         program_destroy(program_table[pid]); 
         program_table.erase(pid);
 
@@ -389,14 +640,17 @@ bool handle_program_commands(std::vector<std::string>& args) {
 
 // ---------------- DEBUG ----------------
     if (args[0] == "debug") {
-        if (args.size() < 2) {
+        if (args.size() < 2 || !is_number(args[1])) {
             cout << "Usage: debug <pid>\n";
+            last_status = 1;
             return true;
         }
 
         int pid = stoi(args[1]);
+        last_pid = pid;
         if (program_table.find(pid) == program_table.end()) {
             cout << "No such program with PID " << pid << "\n";
+            last_status = 1;
             return true;
         }
 
@@ -404,17 +658,14 @@ bool handle_program_commands(std::vector<std::string>& args) {
 
         // 1. Compile if needed
         if (p->ir == nullptr) {
-            if (!compile_program(p)) return true;
+            if (!compile_program(p)) { last_status = 1; return true; }
         }
             
         // 2. Prepare VM (Create if null, OR RESET if existing)
-        if (p->vm == nullptr) {
-            p->vm = (VM*)malloc(sizeof(VM));
-        }
-        
         // ✅ CRITICAL FIX: Always reset the VM when starting a debug session
         // This ensures PC starts at 0 and Stack is clear.
-        vm_init(p->vm, p->ir); 
+        vm_release(p->vm);  // drop the previous session's heap and variables
+        p->vm = vm_acquire(p->ir);
 
         // 3. State Transition: RUNNING -> PAUSED
         p->state = PROGRAM_PAUSED;
@@ -0,0 +1,81 @@
+#include "../include/compile_pool.hpp"
+
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+extern "C" {
+#include "../../core/compiler.h"
+}
+
+namespace {
+
+struct CompileResult {
+    bool ok = false;
+    double wall_ms = 0;
+    double cpu_ms = 0;
+};
+
+double thread_cpu_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+} // namespace
+
+void compile_batch(const std::vector<Program *> &programs) {
+    size_t n = programs.size();
+    if (n == 0) {
+        std::printf("Nothing to compile.\n");
+        return;
+    }
+
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    if (workers > n) workers = static_cast<unsigned>(n);
+
+    // Workers pull the next program off a shared counter, so long compiles
+    // don't hold up a statically assigned share of the batch.
+    std::vector<CompileResult> results(n);
+    std::atomic<size_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+
+    auto work = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < n;) {
+            auto t0 = std::chrono::steady_clock::now();
+            double c0 = thread_cpu_ms();
+            results[i].ok = compile_program(programs[i]) != 0;
+            results[i].cpu_ms = thread_cpu_ms() - c0;
+            results[i].wall_ms = ms_since(t0);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned w = 0; w < workers; w++) pool.emplace_back(work);
+    for (auto &t : pool) t.join();
+    double wall_ms = ms_since(start);
+
+    // Report after the pool has drained so rows don't interleave with
+    // compiler diagnostics.
+    int ok = 0;
+    double cpu_ms = 0;
+    std::printf("%-6s %-8s %10s %10s  %s\n", "PID", "STATUS", "WALL(ms)", "CPU(ms)", "SOURCE");
+    for (size_t i = 0; i < n; i++) {
+        const CompileResult &r = results[i];
+        ok += r.ok;
+        cpu_ms += r.cpu_ms;
+        std::printf("%-6d %-8s %10.2f %10.2f  %s\n", programs[i]->pid,
+                    r.ok ? "READY" : "FAILED", r.wall_ms, r.cpu_ms,
+                    programs[i]->source_path);
+    }
+    std::printf("Compiled %d/%zu programs on %u threads: wall %.2f ms, cpu %.2f ms (%.2fx)\n",
+                ok, n, workers, wall_ms, cpu_ms, wall_ms > 0 ? cpu_ms / wall_ms : 0.0);
+}
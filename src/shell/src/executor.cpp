@@ -1,16 +1,24 @@
 #include "../include/executor.hpp"
+#include "../include/builtins.hpp"
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <termios.h>
+#include <pthread.h>
 #include <errno.h>
 #include <cstring> // for std::strcmp
+#include <cstdio>
 #include <algorithm>
 #include <iostream>
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace {
@@ -19,16 +27,30 @@ struct Job {
     int id = 0;
     pid_t pgid = 0;
     std::vector<pid_t> pids;
+    pid_t last = 0;             // final pipeline stage: its status is the job's
     std::string command;
     enum class State { Running, Stopped } state = State::Running;
     bool background = false;
 };
 
-std::vector<Job> jobs;
+// Jobs by id (ordered, for `jobs` and the latest job), and the job of
+// every live child pid, so a status change finds its job in O(1) however
+// many jobs run
+std::map<int, Job> jobs;
+std::unordered_map<pid_t, int> job_of_pid;
 int next_job_id = 1;
 pid_t shell_pgid = 0;
 int shell_terminal = -1;
 bool shell_interactive = false;
+int last_status = 0;        // of the last foreground job, as a shell reports it
+
+// SIGCHLD is blocked and read from signal_fd; child_events (epoll) waits
+// on it together with the shell's input. -1 if either could not be set
+// up: children are then reaped by polling, as after every command.
+int signal_fd = -1;
+int child_events = -1;
+bool at_prompt = false;     // a notification must first end the prompt line
+bool notified = false;      // one was printed since wait_for_input looked
 
 std::vector<char *> build_argv(const SimpleCommand &cmd) {
     std::vector<char *> argv;
@@ -75,6 +97,11 @@ bool setup_redirections(const SimpleCommand &cmd) {
 }
 
 void prepare_child_signals() {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &chld, nullptr);
+
     signal(SIGINT, SIG_DFL);
     signal(SIGTSTP, SIG_DFL);
     signal(SIGTTOU, SIG_DFL);
@@ -129,6 +156,72 @@ void run_child(const SimpleCommand &cmd,
     _exit(127);
 }
 
+// Starts one pipeline stage without copying the shell: posix_spawn runs
+// the pipe plumbing, redirections, process group and signal reset as
+// spawn attributes, so its cost does not grow with the programs the shell
+// holds. Returns false when the stage needs a forked child instead: a
+// builtin that must behave like a process, or any error, which the forked
+// child then reports the way it always did.
+bool spawn_stage(const SimpleCommand &cmd,
+                 pid_t pgid,
+                 int inherit_stdin_fd,
+                 int inherit_stdout_fd,
+                 int close_fd,
+                 pid_t &pid) {
+    if (cmd.argv.empty() || cmd.argv[0] == "cd" || cmd.argv[0] == "exit") {
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    if (close_fd >= 0) {
+        posix_spawn_file_actions_addclose(&actions, close_fd);
+    }
+    if (inherit_stdin_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, inherit_stdin_fd, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, inherit_stdin_fd);
+    }
+    if (inherit_stdout_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, inherit_stdout_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, inherit_stdout_fd);
+    }
+    if (!cmd.input_redirection.empty()) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+                                         cmd.input_redirection.c_str(),
+                                         O_RDONLY, 0);
+    }
+    if (!cmd.output_redirection.empty()) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                         cmd.output_redirection.c_str(),
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+
+    // Same as prepare_child_signals, with nothing blocked
+    sigset_t defaults, mask;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTOU);
+    sigaddset(&defaults, SIGTTIN);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                    POSIX_SPAWN_SETSIGDEF |
+                                    POSIX_SPAWN_SETSIGMASK);
+
+    auto argv = build_argv(cmd);
+    int err = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err == 0;
+}
+
 void terminate_group(pid_t pgid) {
     if (pgid <= 0) {
         return;
@@ -140,28 +233,20 @@ void terminate_group(pid_t pgid) {
 }
 
 Job *find_job_by_id(int id) {
-    for (auto &job : jobs) {
-        if (job.id == id) {
-            return &job;
-        }
-    }
-    return nullptr;
+    auto it = jobs.find(id);
+    return it == jobs.end() ? nullptr : &it->second;
 }
 
 Job *find_job_by_pid(pid_t pid) {
-    for (auto &job : jobs) {
-        if (std::find(job.pids.begin(), job.pids.end(), pid) != job.pids.end()) {
-            return &job;
-        }
-    }
-    return nullptr;
+    auto it = job_of_pid.find(pid);
+    return it == job_of_pid.end() ? nullptr : find_job_by_id(it->second);
 }
 
 void remove_job(Job &job) {
-    jobs.erase(std::remove_if(jobs.begin(),
-                              jobs.end(),
-                              [&](const Job &j) { return j.id == job.id; }),
-               jobs.end());
+    for (pid_t pid : job.pids) {
+        job_of_pid.erase(pid);
+    }
+    jobs.erase(job.id);
 }
 
 std::string describe_command(const Command &cmd) {
@@ -192,11 +277,20 @@ void handle_child_status(pid_t pid, int status) {
     } else if (WIFCONTINUED(status)) {
         job->state = Job::State::Running;
     } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        if (pid == job->last && !job->background) {
+            last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
         auto &pids = job->pids;
         pids.erase(std::remove(pids.begin(), pids.end(), pid), pids.end());
+        job_of_pid.erase(pid);
         if (pids.empty()) {
             if (job->background) {
+                if (at_prompt) {
+                    std::cout << "\n";
+                    at_prompt = false;
+                }
                 std::cout << "[" << job->id << "] Done " << job->command << "\n";
+                notified = true;
             }
             remove_job(*job);
         }
@@ -209,6 +303,35 @@ void give_terminal_to(pid_t pgid) {
     }
 }
 
+// Handles every child status change that is ready, for any job
+void reap_children() {
+    if (signal_fd >= 0) {
+        // SIGCHLDs coalesce: the read only clears them, waitpid finds the children
+        signalfd_siginfo info[16];
+        while (read(signal_fd, info, sizeof(info)) > 0) {
+        }
+    }
+    int status = 0;
+    while (true) {
+        pid_t pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED);
+        if (pid <= 0) {
+            break;
+        }
+        handle_child_status(pid, status);
+    }
+}
+
+// Sleeps until some child changes state (or the shell's input, when it
+// is registered, becomes readable). Returns false if it cannot wait.
+bool wait_for_event(epoll_event &event) {
+    while (epoll_wait(child_events, &event, 1, -1) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void wait_for_job(int job_id) {
     Job *job = find_job_by_id(job_id);
     if (!job) {
@@ -216,17 +339,21 @@ void wait_for_job(int job_id) {
     }
 
     while (true) {
-        int status = 0;
-        pid_t pid = waitpid(-job->pgid, &status, WUNTRACED);
-        if (pid < 0) {
-            if (errno == EINTR) {
-                continue;
+        if (child_events >= 0) {
+            // Background jobs that finish meanwhile are handled as they go
+            reap_children();
+        } else {
+            int status = 0;
+            pid_t pid = waitpid(-job->pgid, &status, WUNTRACED);
+            if (pid < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
             }
-            break;
+            handle_child_status(pid, status);
         }
 
-        handle_child_status(pid, status);
-
         Job *current = find_job_by_id(job_id);
         if (!current) {
             break;
@@ -235,14 +362,119 @@ void wait_for_job(int job_id) {
             std::cout << "\n[" << current->id << "] Stopped " << current->command << "\n";
             break;
         }
+
+        epoll_event event;
+        if (child_events >= 0 && !wait_for_event(event)) {
+            break;
+        }
     }
 }
 
+// While a program stage writes into a pipe, SIGCHLD is let through to
+// the shell's thread. If a process of the job reading the pipe stopped
+// (^Z in less, say), the rest of the stage's output goes to /dev/null:
+// the write it is blocked in restarts (SA_RESTART) on the same fd and
+// completes there, instead of waiting for a reader that will not read.
+// WNOWAIT leaves the status itself to reap_children.
+pid_t reader_pgid = 0;
+int null_fd = -1;
+
+void on_reader_change(int) {
+    int saved_errno = errno;
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_PGID, reader_pgid, &info, WSTOPPED | WNOHANG | WNOWAIT) == 0 &&
+        info.si_pid != 0) {
+        dup2(null_fd, STDOUT_FILENO);
+    }
+    errno = saved_errno;
+}
+
+// A program command in a pipeline: it runs inside the shell after the
+// processes are started, writing to out_fd (-1: the shell's stdout)
+struct InProcessStage {
+    size_t index = 0;
+    int out_fd = -1;
+};
+
 struct SpawnResult {
     pid_t pgid = 0;
     std::vector<pid_t> pids;
+    std::vector<InProcessStage> in_process;
 };
 
+// Runs a program command with stdout pointed at its pipe or redirection
+// file. Output streams through stdio's buffer as it is produced, and a
+// reader that went away only makes the writes fail (EPIPE), so a
+// pipeline can never take the shell down, and one that stopped only
+// discards the rest (see on_reader_change). They read nothing, and the
+// shell refuses input redirection or & on them before getting here.
+// readers is the process group of the pipeline's other stages, 0 if
+// there are none. Returns the command's status.
+int run_in_process(const SimpleCommand &cmd, int out_fd, pid_t readers) {
+    int file_fd = -1;
+    if (!cmd.output_redirection.empty()) {
+        file_fd = open(cmd.output_redirection.c_str(),
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0666);
+        if (file_fd < 0) {
+            perror(cmd.output_redirection.c_str());
+            return 1;
+        }
+        out_fd = file_fd;
+    }
+
+    std::cout.flush();
+    fflush(stdout);
+
+    int saved_stdout = -1;
+    if (out_fd >= 0) {
+        saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(out_fd, STDOUT_FILENO);
+    }
+    struct sigaction ignore_pipe {}, old_pipe {};
+    ignore_pipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+
+    const bool watch_readers = file_fd < 0 && out_fd >= 0 && readers > 0;
+    sigset_t chld, old_mask;
+    struct sigaction on_change {}, old_chld {};
+    if (watch_readers && null_fd < 0) {
+        null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
+    if (watch_readers && null_fd >= 0) {
+        reader_pgid = readers;
+        on_change.sa_handler = on_reader_change;
+        on_change.sa_flags = SA_RESTART;
+        sigaction(SIGCHLD, &on_change, &old_chld);
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        pthread_sigmask(SIG_UNBLOCK, &chld, &old_mask);
+    }
+
+    std::vector<std::string> argv = cmd.argv;
+    handle_program_commands(argv);
+    int status = builtin_status();
+
+    std::cout.flush();
+    fflush(stdout);
+    if (watch_readers && null_fd >= 0) {
+        pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+        sigaction(SIGCHLD, &old_chld, nullptr);
+    }
+    std::cout.clear();
+    clearerr(stdout);
+    sigaction(SIGPIPE, &old_pipe, nullptr);
+    if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+    if (file_fd >= 0) {
+        close(file_fd);
+    }
+    return status;
+}
+
 bool spawn_pipeline(const std::vector<SimpleCommand> &commands, SpawnResult &result) {
     result = SpawnResult{};
     int prev_read_fd = -1;
@@ -251,16 +483,39 @@ bool spawn_pipeline(const std::vector<SimpleCommand> &commands, SpawnResult &res
     for (size_t i = 0; i < commands.size(); ++i) {
         int pipefd[2] = {-1, -1};
         const bool need_pipe = (i + 1 < commands.size());
-        if (need_pipe && pipe(pipefd) < 0) {
+        // close-on-exec: a stage only keeps the ends dup'ed onto 0 and 1,
+        // never the write end an in-process stage holds open meanwhile
+        if (need_pipe && pipe2(pipefd, O_CLOEXEC) < 0) {
             perror("pipe");
             if (prev_read_fd >= 0) {
                 close(prev_read_fd);
             }
+            for (const auto &stage : result.in_process) {
+                if (stage.out_fd >= 0) close(stage.out_fd);
+            }
             terminate_group(pgid);
             return false;
         }
 
-        pid_t pid = fork();
+        if (is_program_stage(commands[i].argv)) {
+            if (prev_read_fd >= 0) {
+                close(prev_read_fd);
+            }
+            result.in_process.push_back({i, need_pipe ? pipefd[1] : -1});
+            prev_read_fd = pipefd[0];
+            continue;
+        }
+
+        pid_t pid = -1;
+        const bool spawned = spawn_stage(commands[i],
+                                         pgid,
+                                         prev_read_fd,
+                                         need_pipe ? pipefd[1] : -1,
+                                         need_pipe ? pipefd[0] : -1,
+                                         pid);
+        if (!spawned) {
+            pid = fork();
+        }
         if (pid < 0) {
             perror("fork");
             if (pipefd[0] >= 0) {
@@ -272,11 +527,14 @@ bool spawn_pipeline(const std::vector<SimpleCommand> &commands, SpawnResult &res
             if (prev_read_fd >= 0) {
                 close(prev_read_fd);
             }
+            for (const auto &stage : result.in_process) {
+                if (stage.out_fd >= 0) close(stage.out_fd);
+            }
             terminate_group(pgid);
             return false;
         }
 
-        if (pid == 0) {
+        if (!spawned && pid == 0) {
             pid_t child_pgid = (pgid == 0) ? getpid() : pgid;
             setpgid(0, child_pgid);
             prepare_child_signals();
@@ -323,10 +581,14 @@ int register_job(pid_t pgid,
     job.id = next_job_id++;
     job.pgid = pgid;
     job.pids = pids;
+    job.last = pids.back();
     job.command = command;
     job.state = Job::State::Running;
     job.background = background;
-    jobs.push_back(job);
+    for (pid_t pid : pids) {
+        job_of_pid[pid] = job.id;
+    }
+    jobs[job.id] = job;
     return job.id;
 }
 
@@ -359,6 +621,34 @@ void initialize_executor() {
     shell_interactive = isatty(shell_terminal);
     shell_pgid = getpid();
 
+    // Before any thread starts, so every thread has SIGCHLD blocked and
+    // only the signalfd sees it; children get it unblocked again
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &chld, nullptr) == 0) {
+        signal_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+    if (signal_fd >= 0) {
+        child_events = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = signal_fd;
+        if (child_events >= 0 &&
+            epoll_ctl(child_events, EPOLL_CTL_ADD, signal_fd, &event) < 0) {
+            close(child_events);
+            child_events = -1;
+        }
+    }
+    if (child_events < 0) {
+        // Without the event loop SIGCHLD must not stay blocked
+        if (signal_fd >= 0) {
+            close(signal_fd);
+            signal_fd = -1;
+        }
+        sigprocmask(SIG_UNBLOCK, &chld, nullptr);
+    }
+
     if (!shell_interactive) {
         return;
     }
@@ -388,6 +678,28 @@ bool execute_command(const Command &cmd) {
 
     SpawnResult result;
     if (!spawn_pipeline(cmd.commands, result)) {
+        last_status = 1;
+        return true;
+    }
+
+    // Every process is running and owns the terminal, so the program
+    // commands' output drains into its readers as it is written, and a
+    // reader like less can use the terminal meanwhile
+    if (result.pgid != 0 && !result.in_process.empty()) {
+        give_terminal_to(result.pgid);
+    }
+    int stage_status = 0;
+    for (const auto &stage : result.in_process) {
+        stage_status = run_in_process(cmd.commands[stage.index], stage.out_fd, result.pgid);
+        if (stage.out_fd >= 0) {
+            close(stage.out_fd);
+        }
+    }
+    const bool last_in_process = !result.in_process.empty() &&
+                                 result.in_process.back().index + 1 == cmd.commands.size();
+
+    if (result.pids.empty()) {
+        last_status = stage_status;
         return true;
     }
 
@@ -396,26 +708,52 @@ bool execute_command(const Command &cmd) {
 
     if (cmd.background) {
         std::cout << "[" << job_id << "] " << result.pgid << " " << label << "\n";
+        last_status = 0;
         return true;
     }
 
     put_job_in_foreground_internal(job_id, false);
+    if (last_in_process) {
+        last_status = stage_status;
+    }
     return true;
 }
 
 void reap_background_jobs() {
-    int status = 0;
-    while (true) {
-        pid_t pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED);
-        if (pid <= 0) {
-            break;
+    reap_children();
+}
+
+bool wait_for_input(int fd) {
+    if (child_events < 0) {
+        return true;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(child_events, EPOLL_CTL_ADD, fd, &event) < 0) {
+        return true;    // not pollable (a regular file): always readable
+    }
+
+    notified = false;
+    bool readable = false;
+    while (!readable && !notified) {
+        if (!wait_for_event(event)) {
+            readable = true;    // let the caller's read report the problem
+        } else if (event.data.fd == fd) {
+            readable = true;
+        } else {
+            at_prompt = true;
+            reap_children();
+            at_prompt = false;
         }
-        handle_child_status(pid, status);
     }
+    epoll_ctl(child_events, EPOLL_CTL_DEL, fd, nullptr);
+    return readable;
 }
 
 void print_jobs() {
-    for (const auto &job : jobs) {
+    for (const auto &[id, job] : jobs) {
         std::cout << "[" << job.id << "] "
                   << (job.state == Job::State::Running ? "Running" : "Stopped")
                   << " " << job.command << "\n";
@@ -446,9 +784,13 @@ bool background_job(int job_id) {
     return true;
 }
 
+int last_exit_status() {
+    return last_status;
+}
+
 int latest_job_id() {
     if (jobs.empty()) {
         return -1;
     }
-    return jobs.back().id;
+    return jobs.rbegin()->first;
 }
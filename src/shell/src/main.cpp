@@ -7,11 +7,15 @@
 #include <unistd.h>
 #include <limits.h> // for PATH_MAX
 #include <map>
+#include <cctype>
+#include <cstdio>
 #include "../include/command.hpp"
 #include "../include/parser.hpp"
 #include "../include/builtins.hpp"
 #include "../include/executor.hpp"
+#include "../include/watcher.hpp"
 #include "../../core/program.h"
+#include "../../core/compiler.h"
 using namespace std;    
 
 static vector<string> history;
@@ -87,85 +91,283 @@ static void print_command_debug(const Command &cmd) {
     cout << "--------------------------\n";
 }
 
-int main() {
-    load_history(); // load history from previous sessions
+// What one command line did: its exit status, and whether the shell
+// should keep reading (false after `exit`)
+struct LineResult {
+    int status = 0;
+    bool keep_running = true;
+};
 
-    string line;
+static LineResult run_line(const string &line, bool interactive) {
+    LineResult r;
 
-    signal(SIGINT, SIG_IGN);
-    initialize_executor();
+    // What background recompiles reported, ahead of this line's output
+    watch_print_reports();
 
-    while (true) {
+    history.push_back(line);
+    if (interactive) {
+        append_history_line(line);
+    }
 
-        // Print current working directory to test cd builtin
-        char cwd[PATH_MAX];
-        if (getcwd(cwd, sizeof(cwd))) {
-            cout << "[cwd] " << cwd << "\n";
+    Command cmd;
+    string error;
+    if (!parse_command(line, cmd, error)) {
+        cerr << "Parse error: " << error << "\n";
+        r.status = 2;
+        return r;
+    }
+
+    // History builtin: print command history
+    if (!cmd.commands.empty() &&
+        !cmd.commands.front().argv.empty() &&
+        cmd.commands.front().argv[0] == "history") {
+        for (size_t i = 0; i < history.size(); ++i) {
+            cout << (i + 1) << "  " << history[i] << "\n";
         }
+        return r;
+    }
 
-        cout << "mysh> ";
-        cout.flush();
+    // Program commands run inside the shell, so they can neither go to
+    // the background nor read input: refuse that instead of ignoring it
+    for (const SimpleCommand &simple : cmd.commands) {
+        if (simple.argv.empty() ||
+            !(is_program_stage(simple.argv) || simple.argv[0] == "debug")) {
+            continue;
+        }
+        const char *why = cmd.background ? "cannot run in the background"
+                        : !simple.input_redirection.empty() ? "does not read input"
+                        : nullptr;
+        if (why) {
+            cerr << simple.argv[0] << ": " << why << "\n";
+            r.status = 1;
+            return r;
+        }
+    }
 
-        if (!getline(cin, line)) {
-            cout << "\n";
-            break;
+    // Program control commands (our new OS layer). In a pipeline, with a
+    // redirection or in the background, execute_command runs them as
+    // in-process stages instead.
+    if (!cmd.commands.empty() &&
+        !cmd.commands.front().argv.empty()) {
+
+        vector<string>& args = cmd.commands.front().argv;
+        const SimpleCommand &front = cmd.commands.front();
+        const bool plain = cmd.commands.size() == 1 && !cmd.background &&
+                           front.input_redirection.empty() &&
+                           front.output_redirection.empty();
+
+        if ((plain || !is_program_stage(args)) && handle_program_commands(args)) {
+            // handled by program manager
+            r.status = builtin_status();
+            return r;
         }
+    }
 
-        if (line.empty()) {
+    // Builtins first
+    if (is_builtin(cmd)) {
+        r.keep_running = run_builtin(cmd);
+        r.status = builtin_status();
+        // builtin handled, go to next prompt
+        reap_background_jobs();
+        return r;
+    }
+
+    if (interactive) {
+        print_command_debug(cmd);
+    }
+
+    // The children share our stdout: what the shell printed goes first
+    cout.flush();
+    fflush(stdout);
+
+    r.keep_running = execute_command(cmd);
+    r.status = last_exit_status();
+
+    reap_background_jobs();
+    return r;
+}
+
+// Splits a -c argument into command lines at ';' and newlines outside
+// quotes; the quotes themselves are left for parse_command
+static vector<string> split_commands(const string &text) {
+    vector<string> lines;
+    string current;
+    char quote = 0;
+    for (char c : text) {
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == ';' || c == '\n') {
+            lines.push_back(current);
+            current.clear();
             continue;
         }
+        current.push_back(c);
+    }
+    lines.push_back(current);
+    return lines;
+}
 
-        history.push_back(line);
-        append_history_line(line);
+// --records: one line per command for the calling script to parse,
+//   line=<n> status=<n> pid=<n|-> cmd=<command as written>
+// pid is the program the command submitted or named. Kept apart from
+// the commands' own output, which goes to stdout as usual.
+static FILE *records = nullptr;
+
+static void write_record(int lineno, const LineResult &r, const string &line) {
+    int pid = take_program_pid();
+    if (!records) return;
+    fprintf(records, "line=%d status=%d pid=", lineno, r.status);
+    if (pid < 0) fputs("-", records);
+    else fprintf(records, "%d", pid);
+    size_t start = line.find_first_not_of(" \t");
+    size_t end = line.find_last_not_of(" \t");
+    fprintf(records, " cmd=%s\n", line.substr(start, end - start + 1).c_str());
+    fflush(records);
+}
+
+static bool is_blank(const string &line) {
+    for (char c : line) {
+        if (!isspace(static_cast<unsigned char>(c))) return false;
+    }
+    return true;
+}
 
-        Command cmd;
-        string error;
-        if (!parse_command(line, cmd, error)) {
-            cerr << "Parse error: " << error << "\n";
+// Batch mode: no prompts, no history file and no debug output. Every
+// line runs; the exit status is 0 when all of them succeeded, otherwise
+// the status of the last one that failed, which is also reported on
+// stderr as "<source>:<line>: status <n>: <command>".
+static int run_batch(istream &in, const string &source) {
+    compiler_verbose = 0;
+    int status = 0;
+    int lineno = 0;
+    string line;
+    while (getline(in, line)) {
+        lineno++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#') {
             continue;
         }
 
-        // History builtin: print command history
-        if (!cmd.commands.empty() &&
-            !cmd.commands.front().argv.empty() &&
-            cmd.commands.front().argv[0] == "history") {
-            for (size_t i = 0; i < history.size(); ++i) {
-                cout << (i + 1) << "  " << history[i] << "\n";
-            }
-            continue;
+        LineResult r = run_line(line, false);
+        write_record(lineno, r, line);
+        if (r.status != 0) {
+            status = r.status;
+            cout.flush();
+            cerr << source << ":" << lineno << ": status " << r.status << ": " << line << "\n";
         }
+        if (!r.keep_running) {
+            break;
+        }
+    }
+    return status;
+}
 
-        // Program control commands (our new OS layer)
-        if (!cmd.commands.empty() &&
-            !cmd.commands.front().argv.empty()) {
+static int run_commands(const string &text) {
+    compiler_verbose = 0;
+    int status = 0;
+    int lineno = 0;
+    for (const string &line : split_commands(text)) {
+        lineno++;
+        if (is_blank(line)) {
+            continue;
+        }
+        LineResult r = run_line(line, false);
+        write_record(lineno, r, line);
+        if (r.status != 0) {
+            status = r.status;
+        }
+        if (!r.keep_running) {
+            break;
+        }
+    }
+    return status;
+}
 
-            vector<string>& args = cmd.commands.front().argv;
+static int usage() {
+    cerr << "Usage: edm_shell [--records <file>] [--batch <script> | -c \"<cmds>\"]\n"
+         << "  --batch <script>  run the commands in <script> ('-' reads stdin)\n"
+         << "  -c \"<cmds>\"       run commands separated by ';' or newlines\n"
+         << "  --records <file>  write one status record per command to <file>\n";
+    return 2;
+}
 
-            if (handle_program_commands(args)) {
-                // handled by program manager
-                continue;
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        int arg = 1;
+        if (string(argv[1]) == "--records" && argc > 2) {
+            // close-on-exec: the commands' children must not inherit it
+            records = fopen(argv[2], "we");
+            if (!records) {
+                perror(argv[2]);
+                return 2;
             }
+            arg = 3;
+        }
+        string mode = arg < argc ? argv[arg] : "";
+        if (argc != arg + 2 || (mode != "--batch" && mode != "-c")) {
+            return usage();
         }
 
-        // Builtins first
-        if (is_builtin(cmd)) {
-            bool keep_running = run_builtin(cmd);
-            if (!keep_running) {
-                // exit command
-                break;
-            }
-            // builtin handled, go to next prompt
-            reap_background_jobs();
-            continue;
+        initialize_executor();
+        if (mode == "-c") {
+            return run_commands(argv[arg + 1]);
         }
+        string script = argv[arg + 1];
+        if (script == "-") {
+            return run_batch(cin, "<stdin>");
+        }
+        ifstream in(script);
+        if (!in) {
+            perror(script.c_str());
+            return 2;
+        }
+        return run_batch(in, script);
+    }
 
-        print_command_debug(cmd);
+    load_history(); // load history from previous sessions
+
+    string line;
+
+    signal(SIGINT, SIG_IGN);
+    initialize_executor();
+    const bool stdin_is_tty = isatty(STDIN_FILENO);
+
+    while (true) {
+
+        // Print current working directory to test cd builtin
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd))) {
+            cout << "[cwd] " << cwd << "\n";
+        }
+
+        cout << "mysh> ";
+        cout.flush();
 
-        if (!execute_command(cmd)) {
+        // On a terminal, background jobs are reported as they finish; a
+        // terminal hands over one line per read, so cin never holds input
+        // the wait cannot see
+        if (stdin_is_tty) {
+            while (!wait_for_input(STDIN_FILENO)) {
+                cout << "mysh> ";
+                cout.flush();
+            }
+        }
+
+        if (!getline(cin, line)) {
+            cout << "\n";
             break;
         }
 
-        reap_background_jobs();
+        if (line.empty()) {
+            continue;
+        }
+
+        if (!run_line(line, true).keep_running) {
+            break;
+        }
     }
 
     return 0;
@@ -0,0 +1,242 @@
+#include "../include/watcher.hpp"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "../../core/compiler.h"
+#include "../../debugger/vm_debug.h"
+}
+
+namespace {
+
+struct Watch {
+    std::string path;
+    std::string dir;
+    std::string name;       // file name inside dir, as inotify reports it
+    int wd = -1;
+    IR *pending = nullptr;  // compiled, not installed yet
+    int rebuilds = 0;
+    int failures = 0;
+    std::vector<std::string> messages;  // until watch_print_reports
+};
+
+// Editors save either in place or by writing a new file and renaming it
+// over the old one, so the directory is watched rather than the file.
+constexpr uint32_t kEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+// Saves tend to arrive as bursts of events; wait for a quiet spell
+// before recompiling.
+constexpr int kSettleMs = 50;
+
+std::mutex lock;                // guards everything below
+std::map<int, Watch> watches;   // by pid
+int inotify_fd = -1;
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+std::string dir_of(const std::string &path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+std::string base_of(const std::string &path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Queues a report for the shell to print before its next command line,
+// so it never lands in the middle of, or inside, a command's output
+void note(Watch &w, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char *text = nullptr;
+    if (vasprintf(&text, fmt, ap) >= 0) {
+        w.messages.emplace_back(text);
+        std::free(text);
+    }
+    va_end(ap);
+}
+
+// Pids whose file was named by the events in buf
+void collect(const char *buf, ssize_t len, std::set<int> &dirty) {
+    for (const char *p = buf; p < buf + len;) {
+        const inotify_event *ev = reinterpret_cast<const inotify_event *>(p);
+        p += sizeof(inotify_event) + ev->len;
+        if (!ev->len) continue;
+
+        std::lock_guard<std::mutex> g(lock);
+        for (auto &[pid, w] : watches) {
+            if (w.wd == ev->wd && w.name == ev->name) dirty.insert(pid);
+        }
+    }
+}
+
+void rebuild(int pid) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> g(lock);
+        auto it = watches.find(pid);
+        if (it == watches.end()) return;
+        path = it->second.path;
+    }
+
+    // Compile into a scratch program so the live one is untouched, with
+    // its errors captured rather than printed from this thread
+    auto start = std::chrono::steady_clock::now();
+    Program *scratch = program_create(pid, path.c_str());
+    char *diag_text = nullptr;
+    size_t diag_len = 0;
+    FILE *diag = open_memstream(&diag_text, &diag_len);
+    bool ok = diag && compile_program_to(scratch, diag) != 0;
+    if (diag) std::fclose(diag);
+    IR *ir = scratch->ir;
+    scratch->ir = nullptr;
+    program_destroy(scratch);
+    double ms = ms_since(start);
+    std::string errors = diag_text ? diag_text : "";
+    std::free(diag_text);
+
+    std::lock_guard<std::mutex> g(lock);
+    auto it = watches.find(pid);
+    if (it == watches.end()) {      // unwatched while compiling
+        if (ir) ir_free(ir);
+        return;
+    }
+    Watch &w = it->second;
+    for (size_t at = 0; at < errors.size();) {
+        size_t end = errors.find('\n', at);
+        if (end == std::string::npos) end = errors.size();
+        note(w, "[watch] PID %d: %s\n", pid, errors.substr(at, end - at).c_str());
+        at = end + 1;
+    }
+    if (!ok) {
+        w.failures++;
+        note(w, "[watch] PID %d: recompiling %s failed, keeping the previous IR\n",
+             pid, path.c_str());
+        return;
+    }
+    if (w.pending) ir_free(w.pending);
+    w.pending = ir;
+    w.rebuilds++;
+    note(w, "[watch] PID %d: recompiled %s in %.2f ms\n", pid, path.c_str(), ms);
+}
+
+void watch_loop() {
+    alignas(inotify_event) char buf[16 * 1024];
+    pollfd pfd = { inotify_fd, POLLIN, 0 };
+
+    for (;;) {
+        std::set<int> dirty;
+        int timeout = -1;
+        while (poll(&pfd, 1, timeout) > 0) {
+            ssize_t n = read(inotify_fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            collect(buf, n, dirty);
+            timeout = kSettleMs;
+        }
+        for (int pid : dirty) rebuild(pid);
+    }
+}
+
+bool start_thread() {
+    if (inotify_fd >= 0) return true;
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        std::perror("inotify_init1");
+        return false;
+    }
+    // Lives as long as the shell; nothing to join on exit
+    std::thread(watch_loop).detach();
+    return true;
+}
+
+} // namespace
+
+bool watch_program(Program *p) {
+    std::lock_guard<std::mutex> g(lock);
+    if (watches.count(p->pid)) return true;
+    if (!start_thread()) return false;
+
+    Watch w;
+    w.path = p->source_path;
+    w.dir = dir_of(w.path);
+    w.name = base_of(w.path);
+
+    // Watching a directory twice returns the same descriptor
+    w.wd = inotify_add_watch(inotify_fd, w.dir.c_str(), kEvents);
+    if (w.wd < 0) {
+        std::perror(w.dir.c_str());
+        return false;
+    }
+    watches[p->pid] = w;
+    return true;
+}
+
+void unwatch_program(int pid) {
+    std::lock_guard<std::mutex> g(lock);
+    auto it = watches.find(pid);
+    if (it == watches.end()) return;
+
+    int wd = it->second.wd;
+    if (it->second.pending) ir_free(it->second.pending);
+    watches.erase(it);
+
+    for (auto &[other, w] : watches) {
+        if (w.wd == wd) return;     // directory still in use
+    }
+    inotify_rm_watch(inotify_fd, wd);
+}
+
+void watch_install_pending(std::map<int, Program *> &programs) {
+    std::lock_guard<std::mutex> g(lock);
+    for (auto &[pid, w] : watches) {
+        if (!w.pending) continue;
+        auto it = programs.find(pid);
+        if (it == programs.end()) continue;
+
+        Program *p = it->second;
+        vm_release(p->vm);
+        p->vm = nullptr;
+        if (p->ir) ir_free(p->ir);
+        p->ir = w.pending;
+        p->state = PROGRAM_READY;
+        w.pending = nullptr;
+    }
+}
+
+void watch_print_reports() {
+    std::lock_guard<std::mutex> g(lock);
+    for (auto &[pid, w] : watches) {
+        for (const std::string &m : w.messages) std::fputs(m.c_str(), stdout);
+        w.messages.clear();
+    }
+    std::fflush(stdout);
+}
+
+void print_watches() {
+    std::lock_guard<std::mutex> g(lock);
+    if (watches.empty()) {
+        std::printf("No programs are being watched.\n");
+        return;
+    }
+    std::printf("%-6s %-9s %-9s %-8s  %s\n", "PID", "REBUILDS", "FAILURES", "PENDING", "SOURCE");
+    for (auto &[pid, w] : watches) {
+        std::printf("%-6d %-9d %-9d %-8s  %s\n", pid, w.rebuilds, w.failures,
+                    w.pending ? "yes" : "no", w.path.c_str());
+    }
+}